@@ -0,0 +1,190 @@
+#include "Benchmark.h"
+#include <algorithm>
+#include <numeric>
+#include <stdio.h>
+
+Benchmark::Benchmark(uint32_t frameCount, uint32_t warmupFrameCount)
+{
+	_frameCount = frameCount;
+	_warmupFrameCount = warmupFrameCount;
+	_frameMs.reserve(frameCount);
+	_frameLimiterMs.reserve(frameCount);
+	_presentWaitMs.reserve(frameCount);
+	_fenceWaitMs.reserve(frameCount);
+	_cullMs.reserve(frameCount);
+	_acquireMs.reserve(frameCount);
+	_updateUniformBuffersMs.reserve(frameCount);
+	_recordMs.reserve(frameCount);
+	_submitMs.reserve(frameCount);
+	_presentMs.reserve(frameCount);
+	_acquireToPresentMs.reserve(frameCount);
+	_gpuRenderPassMs.reserve(frameCount);
+	_acquireToDisplayMs.reserve(frameCount);
+	_inputToDisplayMs.reserve(frameCount);
+}
+
+Benchmark::~Benchmark()
+{
+}
+
+void Benchmark::AddFrame(double frameMs, const FrameTimings & timings)
+{
+	_framesSeen++;
+	if (_framesSeen <= _warmupFrameCount || IsDone())
+	{
+		return;
+	}
+
+	_frameMs.push_back(frameMs);
+	_frameLimiterMs.push_back(timings.frameLimiterMs);
+	_presentWaitMs.push_back(timings.presentWaitMs);
+	_fenceWaitMs.push_back(timings.fenceWaitMs);
+	_cullMs.push_back(timings.cullMs);
+	_acquireMs.push_back(timings.acquireMs);
+	_updateUniformBuffersMs.push_back(timings.updateUniformBuffersMs);
+	_recordMs.push_back(timings.recordMs);
+	_submitMs.push_back(timings.submitMs);
+	_presentMs.push_back(timings.presentMs);
+	_acquireToPresentMs.push_back(timings.acquireToPresentMs);
+	if (timings.gpuRenderPassMs >= 0.0)
+	{
+		_gpuRenderPassMs.push_back(timings.gpuRenderPassMs);
+	}
+	if (timings.acquireToDisplayMs >= 0.0)
+	{
+		_acquireToDisplayMs.push_back(timings.acquireToDisplayMs);
+		_inputToDisplayMs.push_back(timings.inputToDisplayMs);
+	}
+}
+
+bool Benchmark::IsDone() const
+{
+	return _frameMs.size() >= _frameCount;
+}
+
+void Benchmark::SetDeviceName(const std::string & deviceName)
+{
+	_deviceName = deviceName;
+}
+
+void Benchmark::SetResolution(uint32_t width, uint32_t height)
+{
+	_width = width;
+	_height = height;
+}
+
+void Benchmark::SetMemoryStats(const MemoryAllocatorStats & memoryStats)
+{
+	_memoryStats = memoryStats;
+}
+
+void Benchmark::SetMeshOptimizationStats(const std::vector<MeshOptimizationStats>& meshStats)
+{
+	_meshStats = meshStats;
+}
+
+void Benchmark::WriteJson(std::ostream & out) const
+{
+	out << "{\n";
+	out << "  \"device\": ";
+	_WriteString(out, _deviceName);
+	out << ",\n";
+	out << "  \"width\": " << _width << ",\n";
+	out << "  \"height\": " << _height << ",\n";
+	out << "  \"frames\": " << _frameMs.size() << ",\n";
+	out << "  \"warmup_frames\": " << _warmupFrameCount << ",\n";
+	_WriteSeries(out, "  ", "frame_ms", _frameMs, false);
+	out << "  \"cpu\": {\n";
+	_WriteSeries(out, "    ", "frame_limiter_ms", _frameLimiterMs, false);
+	_WriteSeries(out, "    ", "present_wait_ms", _presentWaitMs, false);
+	_WriteSeries(out, "    ", "fence_wait_ms", _fenceWaitMs, false);
+	_WriteSeries(out, "    ", "cull_ms", _cullMs, false);
+	_WriteSeries(out, "    ", "acquire_ms", _acquireMs, false);
+	_WriteSeries(out, "    ", "update_uniform_buffers_ms", _updateUniformBuffersMs, false);
+	_WriteSeries(out, "    ", "record_ms", _recordMs, false);
+	_WriteSeries(out, "    ", "submit_ms", _submitMs, false);
+	_WriteSeries(out, "    ", "present_ms", _presentMs, false);
+	_WriteSeries(out, "    ", "acquire_to_present_ms", _acquireToPresentMs, true);
+	out << "  },\n";
+	out << "  \"gpu\": {\n";
+	_WriteSeries(out, "    ", "render_pass_ms", _gpuRenderPassMs, true);
+	out << "  },\n";
+	out << "  \"latency\": {\n";
+	_WriteSeries(out, "    ", "acquire_to_display_ms", _acquireToDisplayMs, false);
+	_WriteSeries(out, "    ", "input_to_display_ms", _inputToDisplayMs, true);
+	out << "  },\n";
+	out << "  \"memory\": { ";
+	out << "\"blocks\": " << _memoryStats.blockCount << ", ";
+	out << "\"allocations\": " << _memoryStats.allocationCount << ", ";
+	out << "\"bytes_reserved\": " << _memoryStats.bytesReserved << ", ";
+	out << "\"bytes_used\": " << _memoryStats.bytesUsed;
+	out << " },\n";
+	out << "  \"meshes\": [";
+	for (size_t i = 0; i < _meshStats.size(); i++)
+	{
+		const MeshOptimizationStats& mesh = _meshStats[i];
+		out << (i == 0 ? "\n" : ",\n") << "    { ";
+		out << "\"acmr_before\": " << mesh.before.acmr << ", ";
+		out << "\"acmr_after\": " << mesh.after.acmr << ", ";
+		out << "\"atvr_before\": " << mesh.before.atvr << ", ";
+		out << "\"atvr_after\": " << mesh.after.atvr << " }";
+	}
+	out << (_meshStats.empty() ? "]\n" : "\n  ]\n");
+	out << "}\n";
+}
+
+void Benchmark::_WriteString(std::ostream & out, const std::string & value)
+{
+	out << '"';
+	for (char c : value)
+	{
+		switch (c)
+		{
+		case '"': out << "\\\""; break;
+		case '\\': out << "\\\\"; break;
+		case '\n': out << "\\n"; break;
+		case '\r': out << "\\r"; break;
+		case '\t': out << "\\t"; break;
+		default:
+			if (static_cast<unsigned char>(c) < 0x20)
+			{
+				char escaped[8];
+				snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+				out << escaped;
+			}
+			else
+			{
+				out << c;
+			}
+		}
+	}
+	out << '"';
+}
+
+double Benchmark::_Percentile(const std::vector<double>& sortedValues, double percentile)
+{
+	if (sortedValues.empty())
+	{
+		return 0.0;
+	}
+	// Nearest rank, so the reported value is always an observed frame
+	size_t rank = static_cast<size_t>(percentile / 100.0 * sortedValues.size() + 0.5);
+	rank = std::min(std::max(rank, size_t(1)), sortedValues.size());
+	return sortedValues[rank - 1];
+}
+
+void Benchmark::_WriteSeries(std::ostream & out, const char * indent, const char * name, std::vector<double> values, bool last)
+{
+	std::sort(values.begin(), values.end());
+	double mean = values.empty() ? 0.0 : std::accumulate(values.begin(), values.end(), 0.0) / values.size();
+
+	out << indent;
+	_WriteString(out, name);
+	out << ": { ";
+	out << "\"mean\": " << mean << ", ";
+	out << "\"p50\": " << _Percentile(values, 50.0) << ", ";
+	out << "\"p95\": " << _Percentile(values, 95.0) << ", ";
+	out << "\"p99\": " << _Percentile(values, 99.0) << ", ";
+	out << "\"max\": " << (values.empty() ? 0.0 : values.back());
+	out << " }" << (last ? "" : ",") << "\n";
+}
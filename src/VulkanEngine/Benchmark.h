@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <ostream>
+#include "MemoryAllocator.h"
+#include "MeshOptimize.h"
+
+// CPU time of each DrawFrame stage plus GPU time of the render pass, in milliseconds.
+// GPU time lags the CPU stages by the frames in flight and is negative until a result is available.
+// The display latencies need VK_KHR_present_wait, they belong to the presents seen completing this frame and are
+// negative when there were none
+struct FrameTimings
+{
+	double frameLimiterMs = 0.0;
+	double presentWaitMs = 0.0;
+	double fenceWaitMs = 0.0;
+	double cullMs = 0.0;
+	double acquireMs = 0.0;
+	double updateUniformBuffersMs = 0.0;
+	double recordMs = 0.0;
+	double submitMs = 0.0;
+	double presentMs = 0.0;
+	double acquireToPresentMs = 0.0;
+	double gpuRenderPassMs = -1.0;
+	double acquireToDisplayMs = -1.0;
+	double inputToDisplayMs = -1.0;
+};
+
+class Benchmark
+{
+public:
+	Benchmark(uint32_t frameCount, uint32_t warmupFrameCount);
+	~Benchmark();
+
+	void AddFrame(double frameMs, const FrameTimings& timings);
+	bool IsDone() const;
+
+	void SetDeviceName(const std::string& deviceName);
+	void SetResolution(uint32_t width, uint32_t height);
+	void SetMemoryStats(const MemoryAllocatorStats& memoryStats);
+	void SetMeshOptimizationStats(const std::vector<MeshOptimizationStats>& meshStats);
+	void WriteJson(std::ostream& out) const;
+
+private:
+	// Quoted and escaped as a JSON string, device names are free form text
+	static void _WriteString(std::ostream& out, const std::string& value);
+	static double _Percentile(const std::vector<double>& sortedValues, double percentile);
+	static void _WriteSeries(std::ostream& out, const char* indent, const char* name, std::vector<double> values, bool last);
+
+	uint32_t _frameCount = 0;
+	uint32_t _warmupFrameCount = 0;
+	uint32_t _framesSeen = 0;
+
+	std::string _deviceName;
+	uint32_t _width = 0;
+	uint32_t _height = 0;
+	MemoryAllocatorStats _memoryStats;
+	std::vector<MeshOptimizationStats> _meshStats;
+
+	std::vector<double> _frameMs;
+	std::vector<double> _frameLimiterMs;
+	std::vector<double> _presentWaitMs;
+	std::vector<double> _fenceWaitMs;
+	std::vector<double> _cullMs;
+	std::vector<double> _acquireMs;
+	std::vector<double> _updateUniformBuffersMs;
+	std::vector<double> _recordMs;
+	std::vector<double> _submitMs;
+	std::vector<double> _presentMs;
+	std::vector<double> _acquireToPresentMs;
+	std::vector<double> _gpuRenderPassMs;
+	std::vector<double> _acquireToDisplayMs;
+	std::vector<double> _inputToDisplayMs;
+};
@@ -0,0 +1,152 @@
+#include "Culling.h"
+
+#if defined( __AVX__ )
+#include <immintrin.h>
+#define CULLING_AVX
+#endif
+#if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#include <emmintrin.h>
+#define CULLING_SSE
+#elif defined( __ARM_NEON ) || defined( _M_ARM64 )
+#include <arm_neon.h>
+#define CULLING_NEON
+#endif
+
+Frustum ExtractFrustum(const glm::mat4 & viewProjection)
+{
+	// Gribb and Hartmann, the matrix is column major so row i is m[0][i] .. m[3][i]
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; i++)
+	{
+		rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+	}
+
+	Frustum frustum;
+	frustum.planes[0] = rows[3] + rows[0];
+	frustum.planes[1] = rows[3] - rows[0];
+	frustum.planes[2] = rows[3] + rows[1];
+	frustum.planes[3] = rows[3] - rows[1];
+	frustum.planes[4] = rows[2];
+	frustum.planes[5] = rows[3] - rows[2];
+	for (auto& plane : frustum.planes)
+	{
+		plane = plane / glm::length(glm::vec3(plane.x, plane.y, plane.z));
+	}
+	return frustum;
+}
+
+void BoundingSpheres::Resize(size_t sphereCount)
+{
+	count = sphereCount;
+	size_t padded = (sphereCount + 7) / 8 * 8;
+	centerX.resize(padded, 0.0f);
+	centerY.resize(padded, 0.0f);
+	centerZ.resize(padded, 0.0f);
+	radius.resize(padded, 0.0f);
+}
+
+void BoundingSpheres::Set(size_t index, const glm::vec3 & center, float sphereRadius)
+{
+	centerX[index] = center.x;
+	centerY[index] = center.y;
+	centerZ[index] = center.z;
+	radius[index] = sphereRadius;
+}
+
+void CullSpheres(const Frustum & frustum, const BoundingSpheres & spheres, uint8_t * visible)
+{
+	// A sphere is outside once its centre is further than its radius behind any plane
+	size_t i = 0;
+#if defined( CULLING_AVX )
+	__m256 planes8[6][4];
+	for (int p = 0; p < 6; p++)
+	{
+		for (int c = 0; c < 4; c++)
+		{
+			planes8[p][c] = _mm256_set1_ps(frustum.planes[p][c]);
+		}
+	}
+	for (; i + 8 <= spheres.count; i += 8)
+	{
+		__m256 x = _mm256_loadu_ps(&spheres.centerX[i]);
+		__m256 y = _mm256_loadu_ps(&spheres.centerY[i]);
+		__m256 z = _mm256_loadu_ps(&spheres.centerZ[i]);
+		__m256 negativeRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&spheres.radius[i]));
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (int p = 0; p < 6; p++)
+		{
+			__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(planes8[p][0], x), _mm256_mul_ps(planes8[p][1], y)), _mm256_add_ps(_mm256_mul_ps(planes8[p][2], z), planes8[p][3]));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negativeRadius, _CMP_GE_OQ));
+		}
+		int mask = _mm256_movemask_ps(inside);
+		for (int j = 0; j < 8; j++)
+		{
+			visible[i + j] = (mask >> j) & 1;
+		}
+	}
+#endif
+#if defined( CULLING_SSE )
+	__m128 planes4[6][4];
+	for (int p = 0; p < 6; p++)
+	{
+		for (int c = 0; c < 4; c++)
+		{
+			planes4[p][c] = _mm_set1_ps(frustum.planes[p][c]);
+		}
+	}
+	for (; i + 4 <= spheres.count; i += 4)
+	{
+		__m128 x = _mm_loadu_ps(&spheres.centerX[i]);
+		__m128 y = _mm_loadu_ps(&spheres.centerY[i]);
+		__m128 z = _mm_loadu_ps(&spheres.centerZ[i]);
+		__m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&spheres.radius[i]));
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (int p = 0; p < 6; p++)
+		{
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planes4[p][0], x), _mm_mul_ps(planes4[p][1], y)), _mm_add_ps(_mm_mul_ps(planes4[p][2], z), planes4[p][3]));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negativeRadius));
+		}
+		int mask = _mm_movemask_ps(inside);
+		for (int j = 0; j < 4; j++)
+		{
+			visible[i + j] = (mask >> j) & 1;
+		}
+	}
+#elif defined( CULLING_NEON )
+	float32x4_t planes4[6][4];
+	for (int p = 0; p < 6; p++)
+	{
+		for (int c = 0; c < 4; c++)
+		{
+			planes4[p][c] = vdupq_n_f32(frustum.planes[p][c]);
+		}
+	}
+	for (; i + 4 <= spheres.count; i += 4)
+	{
+		float32x4_t x = vld1q_f32(&spheres.centerX[i]);
+		float32x4_t y = vld1q_f32(&spheres.centerY[i]);
+		float32x4_t z = vld1q_f32(&spheres.centerZ[i]);
+		float32x4_t negativeRadius = vnegq_f32(vld1q_f32(&spheres.radius[i]));
+		uint32x4_t inside = vdupq_n_u32(~0u);
+		for (int p = 0; p < 6; p++)
+		{
+			float32x4_t distance = vmlaq_f32(vmlaq_f32(vmlaq_f32(planes4[p][3], planes4[p][0], x), planes4[p][1], y), planes4[p][2], z);
+			inside = vandq_u32(inside, vcgeq_f32(distance, negativeRadius));
+		}
+		visible[i + 0] = vgetq_lane_u32(inside, 0) & 1;
+		visible[i + 1] = vgetq_lane_u32(inside, 1) & 1;
+		visible[i + 2] = vgetq_lane_u32(inside, 2) & 1;
+		visible[i + 3] = vgetq_lane_u32(inside, 3) & 1;
+	}
+#endif
+	for (; i < spheres.count; i++)
+	{
+		bool inside = true;
+		for (const auto& plane : frustum.planes)
+		{
+			float distance = plane.x * spheres.centerX[i] + plane.y * spheres.centerY[i] + plane.z * spheres.centerZ[i] + plane.w;
+			inside = inside && distance >= -spheres.radius[i];
+		}
+		visible[i] = inside ? 1 : 0;
+	}
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "Vertex.h"
+#include "MeshSimplify.h"
+
+// Left, right, bottom, top, near and far planes, normalised with the normal pointing inside
+struct Frustum
+{
+	glm::vec4 planes[6];
+};
+
+// Planes of a Vulkan (0 to 1 depth) clip space, e.g. of proj * view
+Frustum ExtractFrustum(const glm::mat4& viewProjection);
+
+// World space bounding spheres in structure of arrays layout, so the culling kernels load one component of
+// several spheres per instruction. The arrays are padded to a multiple of 8
+struct BoundingSpheres
+{
+	std::vector<float> centerX;
+	std::vector<float> centerY;
+	std::vector<float> centerZ;
+	std::vector<float> radius;
+	size_t count = 0;
+
+	void Resize(size_t sphereCount);
+	void Set(size_t index, const glm::vec3& center, float sphereRadius);
+};
+
+// Writes 1 to visible[i] if sphere i touches the frustum and 0 otherwise.
+// Uses AVX, SSE or NEON, whichever the build targets, for 8 or 4 spheres at a time
+void CullSpheres(const Frustum& frustum, const BoundingSpheres& spheres, uint8_t* visible);
+
+// Layouts shared with Shaders/cull.comp (std430). The cull pass tests every instance against the frustum, picks its
+// LOD and appends it to its (mesh, LOD) group, the draw pass turns the group counts into indirect draws
+struct GpuInstance
+{
+	glm::mat4 model;
+	uint32_t mesh;
+	uint32_t material;
+	uint32_t padding[2];
+};
+
+static_assert(MAX_MESH_LODS == 4, "cull.comp holds the LOD errors in a vec4");
+
+// Group (mesh, lod) is firstGroup + lod, its visible instances are written from firstOutputInstance + lod * instanceCount
+struct GpuMesh
+{
+	glm::mat4 dequantization;
+	glm::vec4 boundingSphere;
+	float lodErrors[MAX_MESH_LODS];
+	uint32_t lodCount;
+	uint32_t firstGroup;
+	uint32_t firstOutputInstance;
+	uint32_t instanceCount;
+};
+
+// One submesh draw of a group, the draw pass fills in the instance count
+struct GpuDrawTemplate
+{
+	uint32_t indexCount;
+	uint32_t firstIndex;
+	int32_t vertexOffset;
+	uint32_t group;
+	uint32_t firstInstance;
+};
+
+// Draw counts of the 16 and 32 bit index draws, the largest on-screen size of a visible instance in pixels as float
+// bits for texture streaming, then one instance count per group
+struct GpuCullCounters
+{
+	uint32_t drawCounts[2];
+	uint32_t maxPixels;
+	uint32_t padding;
+};
+
+// local_size_x of both passes
+const uint32_t GPU_CULL_GROUP_SIZE = 64;
+
+// Push constants, within the 128 bytes every device supports. eye.w is the near plane distance,
+// lodScale converts the object space size over the distance into pixels
+struct GpuCullConstants
+{
+	glm::vec4 planes[6];
+	glm::vec4 eye;
+	float lodScale;
+	uint32_t instanceCount;
+	uint32_t drawCount16;
+	uint32_t drawCount;
+};
@@ -0,0 +1,42 @@
+#include "DeletionQueue.h"
+#include <assert.h>
+
+DeletionQueue::DeletionQueue()
+{
+}
+
+DeletionQueue::~DeletionQueue()
+{
+	Flush();
+}
+
+void DeletionQueue::Push(uint64_t retireValue, std::function<void()> destroy)
+{
+	assert((_entries.empty() || _entries.back().retireValue <= retireValue) && "DeletionQueue: retire values must not decrease");
+
+	Entry entry;
+	entry.retireValue = retireValue;
+	entry.destroy = std::move(destroy);
+	_entries.push_back(std::move(entry));
+}
+
+void DeletionQueue::Collect(uint64_t completedValue)
+{
+	while (!_entries.empty() && _entries.front().retireValue <= completedValue)
+	{
+		// Popped first, a destroy may push again
+		std::function<void()> destroy = std::move(_entries.front().destroy);
+		_entries.pop_front();
+		destroy();
+	}
+}
+
+void DeletionQueue::Flush()
+{
+	Collect(UINT64_MAX);
+}
+
+size_t DeletionQueue::GetPendingCount() const
+{
+	return _entries.size();
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdint.h>
+#include <deque>
+#include <functional>
+
+// Defers destroying Vulkan objects until the GPU has finished every frame that could still use them, so resources
+// can be replaced at runtime without waiting for the device to go idle. Values are those of the renderer's
+// FrameScheduler: an object last used by the frame with value n is destroyed once n has completed.
+// Not thread safe, call from the render thread.
+class DeletionQueue
+{
+public:
+	DeletionQueue();
+	// Runs whatever is left, the GPU must be done with it
+	~DeletionQueue();
+
+	// Values must not decrease from one push to the next, entries run in the order they were pushed
+	void Push(uint64_t retireValue, std::function<void()> destroy);
+	// Runs every entry whose value has completed
+	void Collect(uint64_t completedValue);
+	// Runs every entry, the GPU must be idle
+	void Flush();
+	size_t GetPendingCount() const;
+
+private:
+	struct Entry
+	{
+		uint64_t retireValue = 0;
+		std::function<void()> destroy;
+	};
+
+	std::deque<Entry> _entries;
+};
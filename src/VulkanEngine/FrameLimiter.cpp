@@ -0,0 +1,102 @@
+#include "FrameLimiter.h"
+#include <algorithm>
+#include <thread>
+
+#if defined( _WIN32 )
+#include <windows.h>
+#include <mmsystem.h>
+#pragma comment(lib, "winmm.lib")
+#endif
+
+// Slack for the work estimate and the last part of a wait that is spun instead of slept, sleeps overshoot
+static const std::chrono::microseconds FRAME_LIMITER_MARGIN(500);
+static const std::chrono::microseconds FRAME_LIMITER_SPIN(1500);
+static const double FRAME_LIMITER_WORK_DECAY = 0.98;
+
+FrameLimiter::FrameLimiter()
+{
+}
+
+FrameLimiter::~FrameLimiter()
+{
+	SetFrameRate(0.0);
+}
+
+void FrameLimiter::SetFrameRate(double framesPerSecond)
+{
+	_framesPerSecond = std::max(framesPerSecond, 0.0);
+	_period = _framesPerSecond > 0.0 ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / _framesPerSecond)) : Clock::duration::zero();
+	_deadline = Clock::time_point();
+
+#if defined( _WIN32 )
+	// The default 15.6 ms scheduler tick is coarser than a frame
+	if (_framesPerSecond > 0.0 && !_timerPeriodRaised)
+	{
+		timeBeginPeriod(1);
+		_timerPeriodRaised = true;
+	}
+	else if (_framesPerSecond == 0.0 && _timerPeriodRaised)
+	{
+		timeEndPeriod(1);
+		_timerPeriodRaised = false;
+	}
+#endif
+}
+
+double FrameLimiter::GetFrameRate() const
+{
+	return _framesPerSecond;
+}
+
+double FrameLimiter::Wait()
+{
+	Clock::time_point now = Clock::now();
+	_frameStart = now;
+	if (_period == Clock::duration::zero())
+	{
+		return 0.0;
+	}
+
+	// Behind schedule, e.g. the first frame or after a hitch: start right away and take the schedule from here
+	Clock::time_point start = _deadline - _workEstimate - FRAME_LIMITER_MARGIN;
+	if (_deadline <= now || start <= now)
+	{
+		_deadline = std::max(_deadline, now + _workEstimate + FRAME_LIMITER_MARGIN);
+		return 0.0;
+	}
+
+	_SleepUntil(start);
+	_frameStart = Clock::now();
+	return std::chrono::duration<double, std::milli>(_frameStart - now).count();
+}
+
+void FrameLimiter::EndFrame()
+{
+	if (_period == Clock::duration::zero())
+	{
+		return;
+	}
+
+	Clock::time_point now = Clock::now();
+	Clock::duration work = now - _frameStart;
+	_workEstimate = std::max(work, std::chrono::duration_cast<Clock::duration>(_workEstimate * FRAME_LIMITER_WORK_DECAY));
+
+	// A frame that ran a whole period late doesn't make the following ones rush to catch up
+	_deadline += _period;
+	if (_deadline + _period < now)
+	{
+		_deadline = now + _period;
+	}
+}
+
+void FrameLimiter::_SleepUntil(Clock::time_point time)
+{
+	while (time - Clock::now() > FRAME_LIMITER_SPIN)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	while (Clock::now() < time)
+	{
+		std::this_thread::yield();
+	}
+}
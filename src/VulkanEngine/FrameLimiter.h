@@ -0,0 +1,35 @@
+#pragma once
+
+#include <chrono>
+
+// Caps the frame rate by sleeping before input is sampled rather than after the frame, so each frame starts as
+// late as the recent frames allow and is built from the freshest input. The work estimate is the slowest recent
+// frame, decaying slowly so one spike doesn't hold the start early for long.
+// Not thread safe, call from the render thread.
+class FrameLimiter
+{
+public:
+	FrameLimiter();
+	~FrameLimiter();
+
+	// 0 turns the limiter off
+	void SetFrameRate(double framesPerSecond);
+	double GetFrameRate() const;
+
+	// Call right before sampling input, returns the time slept in milliseconds
+	double Wait();
+	// Call once the frame has been presented
+	void EndFrame();
+
+private:
+	typedef std::chrono::high_resolution_clock Clock;
+
+	void _SleepUntil(Clock::time_point time);
+
+	double _framesPerSecond = 0.0;
+	Clock::duration _period = Clock::duration::zero();
+	Clock::duration _workEstimate = Clock::duration::zero();
+	Clock::time_point _deadline;
+	Clock::time_point _frameStart;
+	bool _timerPeriodRaised = false;
+};
@@ -0,0 +1,194 @@
+#include "FrameScheduler.h"
+#include "Renderer.h"
+#include <algorithm>
+
+FrameScheduler::FrameScheduler(Renderer * renderer, uint32_t framesInFlight)
+{
+	_renderer = renderer;
+	_framesInFlight = std::max(framesInFlight, 1u);
+
+	if (_renderer->SupportsTimelineSemaphores())
+	{
+		_waitSemaphores = (PFN_vkWaitSemaphoresKHR)vkGetDeviceProcAddr(_renderer->GetVulkanDevice(), "vkWaitSemaphoresKHR");
+		_getSemaphoreCounterValue = (PFN_vkGetSemaphoreCounterValueKHR)vkGetDeviceProcAddr(_renderer->GetVulkanDevice(), "vkGetSemaphoreCounterValueKHR");
+
+		VkSemaphoreTypeCreateInfoKHR semaphoreTypeInfo = {};
+		semaphoreTypeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+		semaphoreTypeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+		semaphoreTypeInfo.initialValue = 0;
+
+		VkSemaphoreCreateInfo semaphoreInfo = {};
+		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		semaphoreInfo.pNext = &semaphoreTypeInfo;
+
+		ErrorCheck(vkCreateSemaphore(_renderer->GetVulkanDevice(), &semaphoreInfo, nullptr, &_timeline));
+	}
+	else
+	{
+		_InitSlotFences();
+	}
+}
+
+FrameScheduler::~FrameScheduler()
+{
+	WaitIdle();
+	vkDestroySemaphore(_renderer->GetVulkanDevice(), _timeline, nullptr);
+	_DeInitSlotFences();
+}
+
+void FrameScheduler::BeginFrame()
+{
+	uint64_t frameValue = GetFrameValue();
+	if (frameValue > _framesInFlight)
+	{
+		Wait(frameValue - _framesInFlight);
+	}
+}
+
+void FrameScheduler::Submit(const std::vector<VkCommandBuffer>& commandBuffers, const std::vector<VkSemaphore>& waitSemaphores, const std::vector<VkPipelineStageFlags>& waitStages, const std::vector<VkSemaphore>& signalSemaphores)
+{
+	uint64_t frameValue = GetFrameValue();
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
+	submitInfo.pWaitSemaphores = waitSemaphores.data();
+	submitInfo.pWaitDstStageMask = waitStages.data();
+	submitInfo.commandBufferCount = static_cast<uint32_t>(commandBuffers.size());
+	submitInfo.pCommandBuffers = commandBuffers.data();
+
+	VkFence fence = VK_NULL_HANDLE;
+	std::vector<VkSemaphore> semaphores = signalSemaphores;
+	// Binary semaphores ignore their value
+	std::vector<uint64_t> signalValues(signalSemaphores.size(), 0);
+	VkTimelineSemaphoreSubmitInfoKHR timelineInfo = {};
+	if (_timeline != VK_NULL_HANDLE)
+	{
+		semaphores.push_back(_timeline);
+		signalValues.push_back(frameValue);
+		timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+		timelineInfo.signalSemaphoreValueCount = static_cast<uint32_t>(signalValues.size());
+		timelineInfo.pSignalSemaphoreValues = signalValues.data();
+		submitInfo.pNext = &timelineInfo;
+	}
+	else
+	{
+		// Only reset right before the submit that signals it again, a frame given up on earlier leaves the fence alone
+		uint32_t slot = GetFrameIndex();
+		fence = _slotFences[slot];
+		ErrorCheck(vkResetFences(_renderer->GetVulkanDevice(), 1, &fence));
+		_slotValues[slot] = frameValue;
+	}
+	submitInfo.signalSemaphoreCount = static_cast<uint32_t>(semaphores.size());
+	submitInfo.pSignalSemaphores = semaphores.data();
+
+	ErrorCheck(vkQueueSubmit(_renderer->GetVulkanQueue(), 1, &submitInfo, fence));
+	_submittedValue = frameValue;
+}
+
+void FrameScheduler::SetFramesInFlight(uint32_t framesInFlight)
+{
+	WaitIdle();
+	_framesInFlight = std::max(framesInFlight, 1u);
+	if (_timeline == VK_NULL_HANDLE)
+	{
+		_DeInitSlotFences();
+		_InitSlotFences();
+	}
+}
+
+uint32_t FrameScheduler::GetFramesInFlight() const
+{
+	return _framesInFlight;
+}
+
+uint32_t FrameScheduler::GetFrameIndex() const
+{
+	return static_cast<uint32_t>(GetFrameValue() % _framesInFlight);
+}
+
+uint64_t FrameScheduler::GetFrameValue() const
+{
+	return _submittedValue + 1;
+}
+
+uint64_t FrameScheduler::GetSubmittedValue() const
+{
+	return _submittedValue;
+}
+
+uint64_t FrameScheduler::GetCompletedValue()
+{
+	if (_timeline != VK_NULL_HANDLE)
+	{
+		uint64_t value = 0;
+		ErrorCheck(_getSemaphoreCounterValue(_renderer->GetVulkanDevice(), _timeline, &value));
+		_completedValue = std::max(_completedValue, value);
+		return _completedValue;
+	}
+
+	// Frames complete in submission order, the newest signalled fence tells how far the GPU got
+	for (uint32_t slot = 0; slot < _framesInFlight; slot++)
+	{
+		if (_slotValues[slot] > _completedValue && vkGetFenceStatus(_renderer->GetVulkanDevice(), _slotFences[slot]) == VK_SUCCESS)
+		{
+			_completedValue = _slotValues[slot];
+		}
+	}
+	return _completedValue;
+}
+
+void FrameScheduler::Wait(uint64_t value)
+{
+	// Values that were never submitted would never signal
+	value = std::min(value, _submittedValue);
+	if (value <= _completedValue)
+	{
+		return;
+	}
+
+	if (_timeline != VK_NULL_HANDLE)
+	{
+		VkSemaphoreWaitInfoKHR waitInfo = {};
+		waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+		waitInfo.semaphoreCount = 1;
+		waitInfo.pSemaphores = &_timeline;
+		waitInfo.pValues = &value;
+		ErrorCheck(_waitSemaphores(_renderer->GetVulkanDevice(), &waitInfo, UINT64_MAX));
+		_completedValue = value;
+		return;
+	}
+
+	// The slot of a submitted value holds it or a later frame, which completes after it
+	uint32_t slot = static_cast<uint32_t>(value % _framesInFlight);
+	ErrorCheck(vkWaitForFences(_renderer->GetVulkanDevice(), 1, &_slotFences[slot], VK_TRUE, UINT64_MAX));
+	_completedValue = _slotValues[slot];
+}
+
+void FrameScheduler::WaitIdle()
+{
+	Wait(_submittedValue);
+}
+
+void FrameScheduler::_InitSlotFences()
+{
+	VkFenceCreateInfo fenceInfo = {};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+	_slotFences.resize(_framesInFlight);
+	_slotValues.assign(_framesInFlight, 0);
+	for (auto &fence : _slotFences)
+	{
+		ErrorCheck(vkCreateFence(_renderer->GetVulkanDevice(), &fenceInfo, nullptr, &fence));
+	}
+}
+
+void FrameScheduler::_DeInitSlotFences()
+{
+	for (auto &fence : _slotFences)
+	{
+		vkDestroyFence(_renderer->GetVulkanDevice(), fence, nullptr);
+	}
+	_slotFences.clear();
+	_slotValues.clear();
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vector>
+#include "Shared.h"
+
+class Renderer;
+
+// Paces the renderer's frames on one timeline semaphore, the commands of every window go into the frame's one submit.
+// Frame n signals the value n when it is submitted and may only begin once frame n - framesInFlight has completed, so per frame resources indexed by GetFrameIndex() are free
+// again by the time BeginFrame returns. A frame that is never submitted, e.g. because the swapchain was out of date,
+// keeps its value and slot for the next attempt.
+// Without VK_KHR_timeline_semaphore the same values are tracked with one fence per slot.
+// Not thread safe, call from the render thread.
+class FrameScheduler
+{
+public:
+	FrameScheduler(Renderer* renderer, uint32_t framesInFlight);
+	// Waits for every submitted frame
+	~FrameScheduler();
+
+	// Blocks until the slot of the next frame has been retired
+	void BeginFrame();
+	// Submits the frame's commands to the graphics queue in one batch and signals its value. The binary semaphores
+	// are those of the swapchains, waitStages has one entry per wait semaphore
+	void Submit(const std::vector<VkCommandBuffer>& commandBuffers, const std::vector<VkSemaphore>& waitSemaphores, const std::vector<VkPipelineStageFlags>& waitStages, const std::vector<VkSemaphore>& signalSemaphores);
+
+	// Waits for the GPU to go idle, the values carry on
+	void SetFramesInFlight(uint32_t framesInFlight);
+	uint32_t GetFramesInFlight() const;
+	// Slot of the frame being recorded, 0 .. GetFramesInFlight() - 1
+	uint32_t GetFrameIndex() const;
+	// Value the frame being recorded signals once the GPU has finished it
+	uint64_t GetFrameValue() const;
+	// Value of the last submitted frame, the newest one that may still be using resources replaced while recording
+	uint64_t GetSubmittedValue() const;
+	// Highest value whose frame the GPU has finished, resources last used by a frame with a value up to this can be released
+	uint64_t GetCompletedValue();
+	void Wait(uint64_t value);
+	void WaitIdle();
+
+private:
+	void _InitSlotFences();
+	void _DeInitSlotFences();
+
+	Renderer* _renderer = nullptr;
+	uint32_t _framesInFlight = 0;
+	uint64_t _submittedValue = 0;
+	uint64_t _completedValue = 0;
+
+	VkSemaphore _timeline = VK_NULL_HANDLE;
+	PFN_vkWaitSemaphoresKHR _waitSemaphores = nullptr;
+	PFN_vkGetSemaphoreCounterValueKHR _getSemaphoreCounterValue = nullptr;
+
+	// Fence fallback, _slotFences[i] belongs to the frame with value _slotValues[i]
+	std::vector<VkFence> _slotFences;
+	std::vector<uint64_t> _slotValues;
+};
@@ -0,0 +1,129 @@
+#include "JobSystem.h"
+#include <algorithm>
+#include <memory>
+
+// Worker index of the current thread, 0 for threads that don't belong to the pool
+static thread_local uint32_t t_worker = 0;
+
+JobSystem::JobSystem(uint32_t threadCount)
+{
+	if (threadCount == 0)
+	{
+		threadCount = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+	}
+	for (uint32_t i = 0; i < threadCount; i++)
+	{
+		_threads.emplace_back(&JobSystem::_WorkerLoop, this, i + 1);
+	}
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_quit = true;
+	}
+	_jobAvailable.notify_all();
+	for (auto &thread : _threads)
+	{
+		thread.join();
+	}
+}
+
+uint32_t JobSystem::GetWorkerCount() const
+{
+	return static_cast<uint32_t>(_threads.size()) + 1;
+}
+
+void JobSystem::Submit(std::function<void(uint32_t worker)> job)
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_jobs.push_back(std::move(job));
+		_activeJobs++;
+	}
+	_jobAvailable.notify_one();
+}
+
+void JobSystem::ParallelFor(uint32_t count, const std::function<void(uint32_t index, uint32_t worker)>& function)
+{
+	if (count == 0)
+	{
+		return;
+	}
+
+	// Shared so helpers that only get scheduled after the loop is finished find no work instead of a dead stack frame
+	struct State
+	{
+		std::atomic<uint32_t> next{ 0 };
+		std::atomic<uint32_t> done{ 0 };
+		uint32_t count = 0;
+		const std::function<void(uint32_t, uint32_t)>* function = nullptr;
+		std::mutex mutex;
+		std::condition_variable finished;
+	};
+	auto state = std::make_shared<State>();
+	state->count = count;
+	state->function = &function;
+
+	auto run = [](State& state, uint32_t worker)
+	{
+		for (;;)
+		{
+			uint32_t index = state.next++;
+			if (index >= state.count)
+			{
+				break;
+			}
+			(*state.function)(index, worker);
+			if (++state.done == state.count)
+			{
+				std::lock_guard<std::mutex> lock(state.mutex);
+				state.finished.notify_all();
+			}
+		}
+	};
+
+	uint32_t helperCount = std::min(static_cast<uint32_t>(_threads.size()), count - 1);
+	for (uint32_t i = 0; i < helperCount; i++)
+	{
+		Submit([state, run](uint32_t worker) { run(*state, worker); });
+	}
+	run(*state, t_worker);
+
+	std::unique_lock<std::mutex> lock(state->mutex);
+	state->finished.wait(lock, [&]() { return state->done == state->count; });
+}
+
+void JobSystem::WaitIdle()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	_jobsDone.wait(lock, [this]() { return _activeJobs == 0; });
+}
+
+void JobSystem::_WorkerLoop(uint32_t worker)
+{
+	t_worker = worker;
+	for (;;)
+	{
+		std::function<void(uint32_t)> job;
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_jobAvailable.wait(lock, [this]() { return _quit || !_jobs.empty(); });
+			if (_quit && _jobs.empty())
+			{
+				return;
+			}
+			job = std::move(_jobs.front());
+			_jobs.pop_front();
+		}
+
+		job(worker);
+
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_activeJobs--;
+		}
+		_jobsDone.notify_all();
+	}
+}
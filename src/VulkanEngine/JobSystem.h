@@ -0,0 +1,41 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed pool of worker threads.
+// Worker indices are stable: 0 is the render thread, 1 .. GetWorkerCount() - 1 are the pool threads,
+// so callers can keep per-worker resources such as command pools in a plain array.
+// ParallelFor may also be called from inside a job, the calling thread then works under its own worker index.
+class JobSystem
+{
+public:
+	// threadCount 0 picks one thread per hardware thread minus the calling thread
+	JobSystem(uint32_t threadCount = 0);
+	~JobSystem();
+
+	uint32_t GetWorkerCount() const;
+
+	// Runs job on a pool thread and returns immediately
+	void Submit(std::function<void(uint32_t worker)> job);
+	// Runs function(index, worker) for every index in [0, count) and returns once all of them are done,
+	// the calling thread takes part in the work
+	void ParallelFor(uint32_t count, const std::function<void(uint32_t index, uint32_t worker)>& function);
+	void WaitIdle();
+
+private:
+	void _WorkerLoop(uint32_t worker);
+
+	std::vector<std::thread> _threads;
+	std::deque<std::function<void(uint32_t)>> _jobs;
+	std::mutex _mutex;
+	std::condition_variable _jobAvailable;
+	std::condition_variable _jobsDone;
+	uint32_t _activeJobs = 0;
+	bool _quit = false;
+};
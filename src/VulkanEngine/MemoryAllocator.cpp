@@ -0,0 +1,269 @@
+#include "MemoryAllocator.h"
+#include <algorithm>
+#include <stdexcept>
+
+static VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+MemoryAllocator::MemoryAllocator(VkDevice device, const VkPhysicalDeviceProperties & gpuProperties, const VkPhysicalDeviceMemoryProperties & gpuMemoryProperties)
+{
+	_device = device;
+	_gpuMemoryProperties = gpuMemoryProperties;
+	_bufferImageGranularity = std::max(gpuProperties.limits.bufferImageGranularity, VkDeviceSize(1));
+}
+
+MemoryAllocator::~MemoryAllocator()
+{
+	for (uint32_t i = 0; i < VK_MAX_MEMORY_TYPES; i++)
+	{
+		for (auto &block : _blocks[i])
+		{
+			if (block.allocationCount > 0)
+			{
+				std::cout << "MemoryAllocator: " << block.allocationCount << " allocations leaked in memory type " << i << std::endl;
+			}
+			_DestroyBlock(block);
+		}
+		_blocks[i].clear();
+	}
+}
+
+Allocation MemoryAllocator::Allocate(const VkMemoryRequirements & memoryRequirements, VkMemoryPropertyFlags properties, bool linear)
+{
+	uint32_t memoryTypeIndex = FindMemoryTypeIndex(&_gpuMemoryProperties, &memoryRequirements, properties);
+
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	Block* target = nullptr;
+	VkDeviceSize offset = 0;
+	for (auto &block : _blocks[memoryTypeIndex])
+	{
+		if (_AllocateFromBlock(block, memoryRequirements, linear, offset))
+		{
+			target = &block;
+			break;
+		}
+	}
+
+	if (target == nullptr)
+	{
+		Block& block = _CreateBlock(memoryTypeIndex, memoryRequirements.size);
+		if (!_AllocateFromBlock(block, memoryRequirements, linear, offset))
+		{
+			throw std::runtime_error("failed to sub-allocate from a new memory block!");
+		}
+		target = &block;
+	}
+
+	Allocation allocation;
+	allocation.memory = target->memory;
+	allocation.offset = offset;
+	allocation.size = memoryRequirements.size;
+	allocation.memoryTypeIndex = memoryTypeIndex;
+	allocation.mapped = target->mapped ? static_cast<char*>(target->mapped) + offset : nullptr;
+	return allocation;
+}
+
+void MemoryAllocator::Free(Allocation & allocation)
+{
+	if (allocation.memory == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	for (auto &block : _blocks[allocation.memoryTypeIndex])
+	{
+		if (block.memory != allocation.memory)
+		{
+			continue;
+		}
+
+		auto it = block.chunks.find(allocation.offset);
+		assert(it != block.chunks.end() && !it->second.free && "MemoryAllocator: freeing an unknown allocation");
+
+		it->second.free = true;
+		block.used -= it->second.size;
+		block.allocationCount--;
+
+		auto next = std::next(it);
+		if (next != block.chunks.end() && next->second.free)
+		{
+			it->second.size += next->second.size;
+			block.chunks.erase(next);
+		}
+		if (it != block.chunks.begin())
+		{
+			auto prev = std::prev(it);
+			if (prev->second.free)
+			{
+				prev->second.size += it->second.size;
+				block.chunks.erase(it);
+			}
+		}
+		break;
+	}
+
+	allocation = Allocation();
+}
+
+VkDeviceSize MemoryAllocator::ReleaseEmptyBlocks()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	VkDeviceSize released = 0;
+	for (uint32_t i = 0; i < VK_MAX_MEMORY_TYPES; i++)
+	{
+		for (auto it = _blocks[i].begin(); it != _blocks[i].end();)
+		{
+			if (it->allocationCount == 0)
+			{
+				released += it->size;
+				_DestroyBlock(*it);
+				it = _blocks[i].erase(it);
+			}
+			else
+			{
+				++it;
+			}
+		}
+	}
+	return released;
+}
+
+MemoryAllocatorStats MemoryAllocator::GetStats() const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	MemoryAllocatorStats stats;
+	for (uint32_t i = 0; i < VK_MAX_MEMORY_TYPES; i++)
+	{
+		for (auto &block : _blocks[i])
+		{
+			stats.blockCount++;
+			stats.allocationCount += block.allocationCount;
+			stats.bytesReserved += block.size;
+			stats.bytesUsed += block.used;
+		}
+	}
+	return stats;
+}
+
+bool MemoryAllocator::_AllocateFromBlock(Block & block, const VkMemoryRequirements & memoryRequirements, bool linear, VkDeviceSize & offset)
+{
+	if (block.size - block.used < memoryRequirements.size)
+	{
+		return false;
+	}
+
+	for (auto it = block.chunks.begin(); it != block.chunks.end(); ++it)
+	{
+		if (!it->second.free || it->second.size < memoryRequirements.size)
+		{
+			continue;
+		}
+
+		VkDeviceSize chunkStart = it->first;
+		VkDeviceSize chunkEnd = it->first + it->second.size;
+		VkDeviceSize start = AlignUp(chunkStart, memoryRequirements.alignment);
+
+		// Linear and optimal resources must not share a bufferImageGranularity page
+		if (it != block.chunks.begin())
+		{
+			auto prev = std::prev(it);
+			if (!prev->second.free && prev->second.linear != linear && _OnSamePage(prev->first + prev->second.size - 1, start))
+			{
+				start = AlignUp(start, _bufferImageGranularity);
+			}
+		}
+		if (start + memoryRequirements.size > chunkEnd)
+		{
+			continue;
+		}
+		auto next = std::next(it);
+		if (next != block.chunks.end() && !next->second.free && next->second.linear != linear && _OnSamePage(start + memoryRequirements.size - 1, next->first))
+		{
+			continue;
+		}
+
+		if (start > chunkStart)
+		{
+			it->second.size = start - chunkStart;
+		}
+		else
+		{
+			block.chunks.erase(it);
+		}
+
+		Chunk used;
+		used.size = memoryRequirements.size;
+		used.free = false;
+		used.linear = linear;
+		block.chunks[start] = used;
+
+		if (start + memoryRequirements.size < chunkEnd)
+		{
+			Chunk remainder;
+			remainder.size = chunkEnd - (start + memoryRequirements.size);
+			block.chunks[start + memoryRequirements.size] = remainder;
+		}
+
+		block.used += memoryRequirements.size;
+		block.allocationCount++;
+		offset = start;
+		return true;
+	}
+	return false;
+}
+
+MemoryAllocator::Block & MemoryAllocator::_CreateBlock(uint32_t memoryTypeIndex, VkDeviceSize size)
+{
+	// Small heaps (e.g. the host visible part of VRAM) get smaller blocks so one block can't exhaust them
+	const VkMemoryType& memoryType = _gpuMemoryProperties.memoryTypes[memoryTypeIndex];
+	VkDeviceSize heapSize = _gpuMemoryProperties.memoryHeaps[memoryType.heapIndex].size;
+	VkDeviceSize blockSize = std::max(size, std::min(_blockSize, heapSize / 8));
+
+	Block block;
+	block.size = blockSize;
+
+	VkMemoryAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.allocationSize = blockSize;
+	allocInfo.memoryTypeIndex = memoryTypeIndex;
+
+	if (vkAllocateMemory(_device, &allocInfo, nullptr, &block.memory) != VK_SUCCESS) {
+		throw std::runtime_error("failed to allocate memory block!");
+	}
+
+	if (memoryType.propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+	{
+		ErrorCheck(vkMapMemory(_device, block.memory, 0, VK_WHOLE_SIZE, 0, &block.mapped));
+	}
+
+	Chunk chunk;
+	chunk.size = blockSize;
+	block.chunks[0] = chunk;
+
+	_blocks[memoryTypeIndex].push_back(std::move(block));
+	return _blocks[memoryTypeIndex].back();
+}
+
+void MemoryAllocator::_DestroyBlock(Block & block)
+{
+	if (block.mapped)
+	{
+		vkUnmapMemory(_device, block.memory);
+		block.mapped = nullptr;
+	}
+	vkFreeMemory(_device, block.memory, nullptr);
+	block.memory = VK_NULL_HANDLE;
+}
+
+bool MemoryAllocator::_OnSamePage(VkDeviceSize endOfA, VkDeviceSize startOfB) const
+{
+	VkDeviceSize pageMask = ~(_bufferImageGranularity - 1);
+	return (endOfA & pageMask) == (startOfB & pageMask);
+}
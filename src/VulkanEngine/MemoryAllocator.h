@@ -0,0 +1,74 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <vector>
+#include "Shared.h"
+
+// A sub-range of one of the allocator's VkDeviceMemory blocks.
+// mapped is set for host visible memory, the owning block stays mapped for its whole lifetime.
+struct Allocation
+{
+	VkDeviceMemory	memory = VK_NULL_HANDLE;
+	VkDeviceSize	offset = 0;
+	VkDeviceSize	size = 0;
+	uint32_t		memoryTypeIndex = UINT32_MAX;
+	void		*	mapped = nullptr;
+};
+
+struct MemoryAllocatorStats
+{
+	uint32_t		blockCount = 0;
+	uint32_t		allocationCount = 0;
+	VkDeviceSize	bytesReserved = 0;
+	VkDeviceSize	bytesUsed = 0;
+};
+
+class MemoryAllocator
+{
+public:
+	MemoryAllocator(VkDevice device, const VkPhysicalDeviceProperties& gpuProperties, const VkPhysicalDeviceMemoryProperties& gpuMemoryProperties);
+	~MemoryAllocator();
+
+	// linear is true for buffers and linear tiled images, it decides whether bufferImageGranularity applies between neighbours
+	Allocation Allocate(const VkMemoryRequirements& memoryRequirements, VkMemoryPropertyFlags properties, bool linear);
+	void Free(Allocation& allocation);
+
+	// Releases blocks that no longer hold any allocation. Returns the number of bytes given back to the driver.
+	// There is no defragmentation: live allocations are never moved, so a block held by a single small allocation
+	// stays reserved, and Free merging neighbouring free ranges is the only compaction. Moving an allocation would
+	// need its owner to recreate and rebind the resource, which the allocator knows nothing about
+	VkDeviceSize ReleaseEmptyBlocks();
+	MemoryAllocatorStats GetStats() const;
+
+private:
+	struct Chunk
+	{
+		VkDeviceSize size = 0;
+		bool free = true;
+		bool linear = false;
+	};
+
+	struct Block
+	{
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize size = 0;
+		VkDeviceSize used = 0;
+		uint32_t allocationCount = 0;
+		void* mapped = nullptr;
+		std::map<VkDeviceSize, Chunk> chunks;
+	};
+
+	bool _AllocateFromBlock(Block& block, const VkMemoryRequirements& memoryRequirements, bool linear, VkDeviceSize& offset);
+	Block& _CreateBlock(uint32_t memoryTypeIndex, VkDeviceSize size);
+	void _DestroyBlock(Block& block);
+	bool _OnSamePage(VkDeviceSize endOfA, VkDeviceSize startOfB) const;
+
+	VkDevice _device = VK_NULL_HANDLE;
+	VkPhysicalDeviceMemoryProperties _gpuMemoryProperties = {};
+	VkDeviceSize _bufferImageGranularity = 1;
+	VkDeviceSize _blockSize = 64 * 1024 * 1024;
+
+	std::vector<Block> _blocks[VK_MAX_MEMORY_TYPES];
+	mutable std::mutex _mutex;
+};
@@ -0,0 +1,215 @@
+#include "MeshCache.h"
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sys/stat.h>
+
+#if defined( _WIN32 )
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+static const uint32_t MESH_CACHE_MAGIC = 0x4853454d; // "MESH"
+static const uint32_t MESH_CACHE_VERSION = 5;
+
+MeshCacheFile::MeshCacheFile()
+{
+}
+
+MeshCacheFile::~MeshCacheFile()
+{
+	Close();
+}
+
+bool MeshCacheFile::Open(const std::string & cachePath, const std::string & sourcePath)
+{
+	Close();
+
+	uint64_t sourceSize = 0;
+	int64_t sourceModifiedTime = 0;
+	if (!_GetSourceStamp(sourcePath, sourceSize, sourceModifiedTime))
+	{
+		return false;
+	}
+
+#if defined( _WIN32 )
+	HANDLE file = CreateFileA(cachePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+	_file = file;
+	LARGE_INTEGER fileSize = {};
+	GetFileSizeEx(file, &fileSize);
+	_size = static_cast<size_t>(fileSize.QuadPart);
+	if (_size > 0)
+	{
+		_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		_data = _mapping ? static_cast<const char*>(MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+	}
+#else
+	_file = open(cachePath.c_str(), O_RDONLY);
+	if (_file < 0)
+	{
+		return false;
+	}
+	struct stat fileStat = {};
+	fstat(_file, &fileStat);
+	_size = static_cast<size_t>(fileStat.st_size);
+	if (_size > 0)
+	{
+		void* data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, _file, 0);
+		_data = data != MAP_FAILED ? static_cast<const char*>(data) : nullptr;
+	}
+#endif
+
+	if (_data == nullptr || _size < sizeof(MeshCacheHeader))
+	{
+		Close();
+		return false;
+	}
+
+	_header = reinterpret_cast<const MeshCacheHeader*>(_data);
+	uint64_t expectedSize = sizeof(MeshCacheHeader) + uint64_t(_header->vertexCount) * sizeof(Vertex) + uint64_t(_header->indexCount) * sizeof(uint32_t) + uint64_t(_header->submeshCount) * sizeof(Submesh);
+	bool valid = _header->magic == MESH_CACHE_MAGIC &&
+		_header->version == MESH_CACHE_VERSION &&
+		_header->vertexSize == sizeof(Vertex) &&
+		_header->sourceSize == sourceSize &&
+		_header->sourceModifiedTime == sourceModifiedTime &&
+		expectedSize == _size;
+	if (!valid)
+	{
+		std::cout << "Mesh cache " << cachePath << " is stale, rebuilding" << std::endl;
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void MeshCacheFile::Close()
+{
+#if defined( _WIN32 )
+	if (_data)
+	{
+		UnmapViewOfFile(_data);
+	}
+	if (_mapping)
+	{
+		CloseHandle(_mapping);
+		_mapping = nullptr;
+	}
+	if (_file)
+	{
+		CloseHandle(_file);
+		_file = nullptr;
+	}
+#else
+	if (_data)
+	{
+		munmap(const_cast<char*>(_data), _size);
+	}
+	if (_file >= 0)
+	{
+		close(_file);
+		_file = -1;
+	}
+#endif
+	_data = nullptr;
+	_size = 0;
+	_header = nullptr;
+}
+
+const MeshCacheHeader & MeshCacheFile::GetHeader() const
+{
+	return *_header;
+}
+
+const Vertex * MeshCacheFile::GetVertices() const
+{
+	return reinterpret_cast<const Vertex*>(_data + sizeof(MeshCacheHeader));
+}
+
+const uint32_t * MeshCacheFile::GetIndices() const
+{
+	return reinterpret_cast<const uint32_t*>(_data + sizeof(MeshCacheHeader) + size_t(_header->vertexCount) * sizeof(Vertex));
+}
+
+const Submesh * MeshCacheFile::GetSubmeshes() const
+{
+	return reinterpret_cast<const Submesh*>(reinterpret_cast<const char*>(GetIndices()) + size_t(_header->indexCount) * sizeof(uint32_t));
+}
+
+std::string MeshCacheFile::GetCachePath(const std::string & sourcePath)
+{
+	return sourcePath + ".meshcache";
+}
+
+bool MeshCacheFile::Write(const std::string & cachePath, const std::string & sourcePath, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, const std::vector<Submesh>& submeshes, const MeshLods& lods, const MeshOptimizationStats& optimizationStats)
+{
+	MeshCacheHeader header;
+	header.magic = MESH_CACHE_MAGIC;
+	header.version = MESH_CACHE_VERSION;
+	header.vertexSize = sizeof(Vertex);
+	header.vertexCount = static_cast<uint32_t>(vertices.size());
+	header.indexCount = static_cast<uint32_t>(indices.size());
+	header.submeshCount = static_cast<uint32_t>(submeshes.size());
+	header.optimizationStats = optimizationStats;
+	header.lods = lods;
+	if (!_GetSourceStamp(sourcePath, header.sourceSize, header.sourceModifiedTime))
+	{
+		return false;
+	}
+
+	if (!vertices.empty())
+	{
+		header.boundsMin = vertices[0].pos;
+		header.boundsMax = vertices[0].pos;
+	}
+	for (const auto& vertex : vertices)
+	{
+		header.boundsMin = glm::min(header.boundsMin, vertex.pos);
+		header.boundsMax = glm::max(header.boundsMax, vertex.pos);
+	}
+
+	// Written under a temporary name so a crash half way through can't leave a truncated cache behind
+	std::string tempPath = cachePath + ".tmp";
+	std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+	{
+		std::cout << "Failed to write mesh cache " << cachePath << std::endl;
+		return false;
+	}
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(vertices.data()), vertices.size() * sizeof(Vertex));
+	file.write(reinterpret_cast<const char*>(indices.data()), indices.size() * sizeof(uint32_t));
+	file.write(reinterpret_cast<const char*>(submeshes.data()), submeshes.size() * sizeof(Submesh));
+	file.close();
+	if (!file)
+	{
+		std::remove(tempPath.c_str());
+		return false;
+	}
+
+	std::remove(cachePath.c_str());
+	return std::rename(tempPath.c_str(), cachePath.c_str()) == 0;
+}
+
+bool MeshCacheFile::_GetSourceStamp(const std::string & sourcePath, uint64_t & size, int64_t & modifiedTime)
+{
+#if defined( _WIN32 )
+	struct _stat64 sourceStat = {};
+	if (_stat64(sourcePath.c_str(), &sourceStat) != 0)
+#else
+	struct stat sourceStat = {};
+	if (stat(sourcePath.c_str(), &sourceStat) != 0)
+#endif
+	{
+		return false;
+	}
+	size = static_cast<uint64_t>(sourceStat.st_size);
+	modifiedTime = static_cast<int64_t>(sourceStat.st_mtime);
+	return true;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "Vertex.h"
+#include "MeshOptimize.h"
+#include "MeshSimplify.h"
+
+// Header of a binary mesh file, followed by vertexCount Vertex, indexCount uint32_t and submeshCount Submesh, tightly packed.
+// The submeshes are LOD major, submeshCount / lods.lodCount of them per LOD.
+// sourceSize and sourceModifiedTime are those of the model the file was converted from, a cache whose
+// source changed since is rebuilt. The streams are stored optimised, optimizationStats records the gain.
+struct MeshCacheHeader
+{
+	uint32_t	magic = 0;
+	uint32_t	version = 0;
+	uint64_t	sourceSize = 0;
+	int64_t		sourceModifiedTime = 0;
+	uint32_t	vertexSize = 0;
+	uint32_t	vertexCount = 0;
+	uint32_t	indexCount = 0;
+	uint32_t	submeshCount = 0;
+	glm::vec3	boundsMin = glm::vec3(0.0f);
+	glm::vec3	boundsMax = glm::vec3(0.0f);
+	MeshOptimizationStats optimizationStats;
+	MeshLods	lods;
+};
+
+// Read only memory mapping of a mesh cache file, the vertex and index streams point straight into the mapping
+class MeshCacheFile
+{
+public:
+	MeshCacheFile();
+	~MeshCacheFile();
+
+	// Returns false if the cache is missing, malformed or older than sourcePath
+	bool Open(const std::string& cachePath, const std::string& sourcePath);
+	void Close();
+
+	const MeshCacheHeader& GetHeader() const;
+	const Vertex* GetVertices() const;
+	const uint32_t* GetIndices() const;
+	const Submesh* GetSubmeshes() const;
+
+	static std::string GetCachePath(const std::string& sourcePath);
+	static bool Write(const std::string& cachePath, const std::string& sourcePath, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, const std::vector<Submesh>& submeshes, const MeshLods& lods, const MeshOptimizationStats& optimizationStats);
+
+private:
+	static bool _GetSourceStamp(const std::string& sourcePath, uint64_t& size, int64_t& modifiedTime);
+
+	const char* _data = nullptr;
+	size_t _size = 0;
+	const MeshCacheHeader* _header = nullptr;
+
+#if defined( _WIN32 )
+	void* _file = nullptr;
+	void* _mapping = nullptr;
+#else
+	int _file = -1;
+#endif
+};
@@ -0,0 +1,151 @@
+#include "MeshImport.h"
+#include "JobSystem.h"
+#include <algorithm>
+
+// Fewer indices than this aren't worth a job of their own
+static const uint32_t MIN_INDICES_PER_RANGE = 16 * 1024;
+
+// Linear probing table of vertex indices into an external vertex array, sized once up front
+class VertexTable
+{
+public:
+	explicit VertexTable(size_t maxVertices)
+	{
+		size_t capacity = 16;
+		while (capacity < maxVertices * 2)
+		{
+			capacity *= 2;
+		}
+		_slots.assign(capacity, UINT32_MAX);
+		_mask = capacity - 1;
+	}
+
+	// Returns the index of an equal vertex already in vertices, or appends vertex and returns its new index
+	uint32_t FindOrAdd(const Vertex& vertex, std::vector<Vertex>& vertices)
+	{
+		size_t slot = HashVertex(vertex) & _mask;
+		for (;;)
+		{
+			uint32_t index = _slots[slot];
+			if (index == UINT32_MAX)
+			{
+				index = static_cast<uint32_t>(vertices.size());
+				_slots[slot] = index;
+				vertices.push_back(vertex);
+				return index;
+			}
+			if (vertices[index] == vertex)
+			{
+				return index;
+			}
+			slot = (slot + 1) & _mask;
+		}
+	}
+
+private:
+	std::vector<uint32_t> _slots;
+	size_t _mask = 0;
+};
+
+struct IndexRange
+{
+	const tinyobj::shape_t* shape = nullptr;
+	size_t begin = 0;
+	size_t end = 0;
+	size_t firstIndex = 0;
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+	std::vector<uint32_t> remap;
+};
+
+void BuildObjMesh(const tinyobj::attrib_t & attrib, const std::vector<tinyobj::shape_t>& shapes, JobSystem * jobSystem, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+{
+	size_t indexCount = 0;
+	for (const auto& shape : shapes)
+	{
+		indexCount += shape.mesh.indices.size();
+	}
+
+	// Large shapes are split too, so a model that is a single shape still spreads over all workers
+	size_t rangeSize = std::max<size_t>(MIN_INDICES_PER_RANGE, (indexCount + jobSystem->GetWorkerCount() - 1) / jobSystem->GetWorkerCount());
+	std::vector<IndexRange> ranges;
+	size_t firstIndex = 0;
+	for (const auto& shape : shapes)
+	{
+		for (size_t begin = 0; begin < shape.mesh.indices.size(); begin += rangeSize)
+		{
+			IndexRange range;
+			range.shape = &shape;
+			range.begin = begin;
+			range.end = std::min(begin + rangeSize, shape.mesh.indices.size());
+			range.firstIndex = firstIndex;
+			firstIndex += range.end - range.begin;
+			ranges.push_back(std::move(range));
+		}
+	}
+
+	jobSystem->ParallelFor(static_cast<uint32_t>(ranges.size()), [&](uint32_t r, uint32_t /*worker*/)
+	{
+		IndexRange& range = ranges[r];
+		size_t count = range.end - range.begin;
+		range.vertices.reserve(count);
+		range.indices.resize(count);
+		VertexTable table(count);
+
+		for (size_t i = 0; i < count; i++)
+		{
+			const tinyobj::index_t& index = range.shape->mesh.indices[range.begin + i];
+			Vertex vertex = {};
+
+			vertex.pos = {
+				attrib.vertices[3 * index.vertex_index + 0],
+				attrib.vertices[3 * index.vertex_index + 1],
+				attrib.vertices[3 * index.vertex_index + 2]
+			};
+
+			vertex.texCoord = {
+				attrib.texcoords[2 * index.texcoord_index + 0],
+				1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
+			};
+
+			if (index.normal_index >= 0)
+			{
+				vertex.normal = {
+					attrib.normals[3 * index.normal_index + 0],
+					attrib.normals[3 * index.normal_index + 1],
+					attrib.normals[3 * index.normal_index + 2]
+				};
+			}
+
+			range.indices[i] = table.FindOrAdd(vertex, range.vertices);
+		}
+	});
+
+	// Only the per-range unique vertices go through the shared table, which keeps the serial part small
+	size_t rangeVertexCount = 0;
+	for (const auto& range : ranges)
+	{
+		rangeVertexCount += range.vertices.size();
+	}
+	vertices.clear();
+	vertices.reserve(rangeVertexCount);
+	VertexTable table(rangeVertexCount);
+	for (auto& range : ranges)
+	{
+		range.remap.resize(range.vertices.size());
+		for (size_t i = 0; i < range.vertices.size(); i++)
+		{
+			range.remap[i] = table.FindOrAdd(range.vertices[i], vertices);
+		}
+	}
+
+	indices.resize(indexCount);
+	jobSystem->ParallelFor(static_cast<uint32_t>(ranges.size()), [&](uint32_t r, uint32_t /*worker*/)
+	{
+		const IndexRange& range = ranges[r];
+		for (size_t i = 0; i < range.indices.size(); i++)
+		{
+			indices[range.firstIndex + i] = range.remap[range.indices[i]];
+		}
+	});
+}
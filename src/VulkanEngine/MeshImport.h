@@ -0,0 +1,12 @@
+#pragma once
+
+#include <vector>
+#include <tiny_obj_loader.h>
+#include "Vertex.h"
+
+class JobSystem;
+
+// Turns tinyobj's per-corner indices into a deduplicated vertex stream and a triangle list.
+// The index stream is cut into ranges that are deduplicated in parallel with per-range open addressing tables,
+// the per-range unique vertices are then merged into one table and the ranges remapped, again in parallel.
+void BuildObjMesh(const tinyobj::attrib_t& attrib, const std::vector<tinyobj::shape_t>& shapes, JobSystem* jobSystem, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
@@ -0,0 +1,361 @@
+#include "MeshOptimize.h"
+#include <algorithm>
+#include <numeric>
+
+// FIFO cache simulated with per-vertex timestamps, a vertex is cached while fewer than cacheSize misses happened since its own
+class VertexCacheSimulator
+{
+public:
+	VertexCacheSimulator(size_t vertexCount, uint32_t cacheSize)
+		: _timestamps(vertexCount, 0), _cacheSize(cacheSize), _time(cacheSize + 1)
+	{
+	}
+
+	// Returns the number of misses of one triangle
+	uint32_t AddTriangle(const uint32_t* triangle)
+	{
+		uint32_t misses = 0;
+		for (int i = 0; i < 3; i++)
+		{
+			uint32_t vertex = triangle[i];
+			if (_time - _timestamps[vertex] > _cacheSize)
+			{
+				_timestamps[vertex] = _time++;
+				misses++;
+			}
+		}
+		return misses;
+	}
+
+	void Reset()
+	{
+		_time += _cacheSize + 1;
+	}
+
+private:
+	std::vector<uint32_t> _timestamps;
+	uint32_t _cacheSize;
+	uint32_t _time;
+};
+
+VertexCacheStats AnalyzeVertexCache(const uint32_t * indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize)
+{
+	VertexCacheStats stats;
+	if (indexCount < 3 || vertexCount == 0)
+	{
+		return stats;
+	}
+
+	VertexCacheSimulator cache(vertexCount, cacheSize);
+	std::vector<bool> referenced(vertexCount, false);
+	size_t misses = 0;
+	size_t uniqueVertices = 0;
+	for (size_t i = 0; i + 2 < indexCount; i += 3)
+	{
+		misses += cache.AddTriangle(indices + i);
+		for (int j = 0; j < 3; j++)
+		{
+			if (!referenced[indices[i + j]])
+			{
+				referenced[indices[i + j]] = true;
+				uniqueVertices++;
+			}
+		}
+	}
+
+	stats.acmr = static_cast<float>(misses) / static_cast<float>(indexCount / 3);
+	stats.atvr = static_cast<float>(misses) / static_cast<float>(uniqueVertices);
+	return stats;
+}
+
+void OptimizeVertexCache(uint32_t * indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize)
+{
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+	{
+		return;
+	}
+
+	// Vertex to triangle adjacency in one flat array
+	std::vector<uint32_t> liveTriangles(vertexCount, 0);
+	for (size_t i = 0; i < triangleCount * 3; i++)
+	{
+		liveTriangles[indices[i]]++;
+	}
+	std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+	}
+	std::vector<uint32_t> adjacency(triangleCount * 3);
+	std::vector<uint32_t> cursors(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		for (int j = 0; j < 3; j++)
+		{
+			adjacency[cursors[indices[t * 3 + j]]++] = static_cast<uint32_t>(t);
+		}
+	}
+
+	std::vector<uint32_t> timestamps(vertexCount, 0);
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<uint32_t> deadEnds;
+	std::vector<uint32_t> candidates;
+	std::vector<uint32_t> output;
+	output.reserve(triangleCount * 3);
+	uint32_t time = cacheSize + 1;
+	size_t scanCursor = 0;
+
+	int64_t fanning = 0;
+	while (fanning >= 0)
+	{
+		// Emit every remaining triangle around the fanning vertex
+		candidates.clear();
+		for (uint32_t a = adjacencyOffsets[fanning]; a < adjacencyOffsets[fanning + 1]; a++)
+		{
+			uint32_t triangle = adjacency[a];
+			if (emitted[triangle])
+			{
+				continue;
+			}
+			for (int j = 0; j < 3; j++)
+			{
+				uint32_t vertex = indices[triangle * 3 + j];
+				output.push_back(vertex);
+				deadEnds.push_back(vertex);
+				candidates.push_back(vertex);
+				liveTriangles[vertex]--;
+				if (time - timestamps[vertex] > cacheSize)
+				{
+					timestamps[vertex] = time++;
+				}
+			}
+			emitted[triangle] = true;
+		}
+
+		// Prefer the candidate that stays in the cache while its remaining triangles are emitted and entered it earliest
+		int64_t next = -1;
+		int64_t bestPriority = -1;
+		for (uint32_t vertex : candidates)
+		{
+			if (liveTriangles[vertex] == 0)
+			{
+				continue;
+			}
+			int64_t priority = 0;
+			if (time - timestamps[vertex] + 2 * liveTriangles[vertex] <= cacheSize)
+			{
+				priority = time - timestamps[vertex];
+			}
+			if (priority > bestPriority)
+			{
+				bestPriority = priority;
+				next = vertex;
+			}
+		}
+
+		// Dead end, fall back to recently used vertices, then to a linear scan
+		while (next < 0 && !deadEnds.empty())
+		{
+			uint32_t vertex = deadEnds.back();
+			deadEnds.pop_back();
+			if (liveTriangles[vertex] > 0)
+			{
+				next = vertex;
+			}
+		}
+		while (next < 0 && scanCursor < vertexCount)
+		{
+			if (liveTriangles[scanCursor] > 0)
+			{
+				next = static_cast<int64_t>(scanCursor);
+			}
+			scanCursor++;
+		}
+		fanning = next;
+	}
+
+	std::copy(output.begin(), output.end(), indices);
+}
+
+void OptimizeOverdraw(uint32_t * indices, size_t indexCount, const Vertex * vertices, size_t vertexCount, float threshold, uint32_t cacheSize)
+{
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+	{
+		return;
+	}
+
+	// A triangle that misses on all three vertices starts a hard cluster, the cache restarts there anyway
+	std::vector<size_t> hardBoundaries;
+	VertexCacheSimulator cache(vertexCount, cacheSize);
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		if (cache.AddTriangle(indices + t * 3) == 3)
+		{
+			hardBoundaries.push_back(t);
+		}
+	}
+	hardBoundaries.push_back(triangleCount);
+
+	// Hard clusters are cut further wherever the ACMR so far stays within threshold of the whole cluster's
+	std::vector<size_t> clusters;
+	for (size_t h = 0; h + 1 < hardBoundaries.size(); h++)
+	{
+		size_t start = hardBoundaries[h];
+		size_t end = hardBoundaries[h + 1];
+
+		cache.Reset();
+		size_t clusterMisses = 0;
+		for (size_t t = start; t < end; t++)
+		{
+			clusterMisses += cache.AddTriangle(indices + t * 3);
+		}
+		float clusterThreshold = threshold * static_cast<float>(clusterMisses) / static_cast<float>(end - start);
+
+		cache.Reset();
+		clusters.push_back(start);
+		size_t softStart = start;
+		size_t softMisses = 0;
+		for (size_t t = start; t < end; t++)
+		{
+			softMisses += cache.AddTriangle(indices + t * 3);
+			if (t + 1 < end && static_cast<float>(softMisses) / static_cast<float>(t + 1 - softStart) <= clusterThreshold)
+			{
+				clusters.push_back(t + 1);
+				softStart = t + 1;
+				softMisses = 0;
+				cache.Reset();
+			}
+		}
+	}
+	clusters.push_back(triangleCount);
+
+	glm::vec3 meshCentroid(0.0f);
+	for (size_t i = 0; i < triangleCount * 3; i++)
+	{
+		meshCentroid += vertices[indices[i]].pos;
+	}
+	meshCentroid /= static_cast<float>(triangleCount * 3);
+
+	// Area weighted centroid and normal per cluster, the sort key is how far the cluster faces away from the centre
+	size_t clusterCount = clusters.size() - 1;
+	std::vector<float> sortKeys(clusterCount);
+	for (size_t c = 0; c < clusterCount; c++)
+	{
+		glm::vec3 centroid(0.0f);
+		glm::vec3 normal(0.0f);
+		float area = 0.0f;
+		for (size_t t = clusters[c]; t < clusters[c + 1]; t++)
+		{
+			const glm::vec3& p0 = vertices[indices[t * 3 + 0]].pos;
+			const glm::vec3& p1 = vertices[indices[t * 3 + 1]].pos;
+			const glm::vec3& p2 = vertices[indices[t * 3 + 2]].pos;
+			glm::vec3 faceNormal = glm::cross(p1 - p0, p2 - p0);
+			float faceArea = glm::length(faceNormal);
+			centroid += (p0 + p1 + p2) * (faceArea / 3.0f);
+			normal += faceNormal;
+			area += faceArea;
+		}
+		float normalLength = glm::length(normal);
+		if (area == 0.0f || normalLength == 0.0f)
+		{
+			sortKeys[c] = 0.0f;
+			continue;
+		}
+		sortKeys[c] = glm::dot(centroid / area - meshCentroid, normal / normalLength);
+	}
+
+	std::vector<uint32_t> order(clusterCount);
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return sortKeys[a] > sortKeys[b]; });
+
+	std::vector<uint32_t> sorted;
+	sorted.reserve(triangleCount * 3);
+	for (uint32_t c : order)
+	{
+		sorted.insert(sorted.end(), indices + clusters[c] * 3, indices + clusters[c + 1] * 3);
+	}
+	std::copy(sorted.begin(), sorted.end(), indices);
+}
+
+size_t OptimizeVertexFetch(std::vector<Vertex>& vertices, uint32_t * indices, size_t indexCount)
+{
+	const uint32_t unused = UINT32_MAX;
+	std::vector<uint32_t> remap(vertices.size(), unused);
+	std::vector<Vertex> reordered;
+	reordered.reserve(vertices.size());
+	for (size_t i = 0; i < indexCount; i++)
+	{
+		uint32_t& newIndex = remap[indices[i]];
+		if (newIndex == unused)
+		{
+			newIndex = static_cast<uint32_t>(reordered.size());
+			reordered.push_back(vertices[indices[i]]);
+		}
+		indices[i] = newIndex;
+	}
+	vertices.swap(reordered);
+	return vertices.size();
+}
+
+std::vector<Submesh> SplitSubmeshes(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, uint32_t maxVertices)
+{
+	std::vector<Submesh> submeshes;
+	std::vector<Vertex> split;
+	split.reserve(vertices.size());
+
+	// remap is only valid for vertices whose stamp is the current submesh's, which saves clearing it at each cut
+	std::vector<uint32_t> remap(vertices.size(), 0);
+	std::vector<uint32_t> stamps(vertices.size(), UINT32_MAX);
+	Submesh current;
+	size_t triangleIndexCount = indices.size() / 3 * 3;
+	for (size_t i = 0; i < triangleIndexCount; i += 3)
+	{
+		uint32_t newVertices = 0;
+		for (int j = 0; j < 3; j++)
+		{
+			newVertices += stamps[indices[i + j]] != submeshes.size() ? 1 : 0;
+		}
+		if (current.vertexCount + newVertices > maxVertices)
+		{
+			submeshes.push_back(current);
+			current = Submesh();
+			current.firstIndex = static_cast<uint32_t>(i);
+			current.baseVertex = static_cast<uint32_t>(split.size());
+		}
+
+		uint32_t stamp = static_cast<uint32_t>(submeshes.size());
+		for (int j = 0; j < 3; j++)
+		{
+			uint32_t vertex = indices[i + j];
+			if (stamps[vertex] != stamp)
+			{
+				stamps[vertex] = stamp;
+				remap[vertex] = current.vertexCount++;
+				split.push_back(vertices[vertex]);
+			}
+			indices[i + j] = remap[vertex];
+		}
+		current.indexCount += 3;
+	}
+	if (current.indexCount > 0)
+	{
+		submeshes.push_back(current);
+	}
+
+	indices.resize(triangleIndexCount);
+	vertices.swap(split);
+	return submeshes;
+}
+
+MeshOptimizationStats OptimizeMesh(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+{
+	MeshOptimizationStats stats;
+	stats.before = AnalyzeVertexCache(indices.data(), indices.size(), vertices.size());
+	OptimizeVertexCache(indices.data(), indices.size(), vertices.size());
+	OptimizeOverdraw(indices.data(), indices.size(), vertices.data(), vertices.size());
+	OptimizeVertexFetch(vertices, indices.data(), indices.size());
+	stats.after = AnalyzeVertexCache(indices.data(), indices.size(), vertices.size());
+	return stats;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vector>
+#include "Vertex.h"
+
+// FIFO post-transform cache size the reordering targets and the statistics simulate
+const uint32_t VERTEX_CACHE_SIZE = 16;
+// Overdraw sorting may raise the ACMR of a cluster by this factor, 1 keeps the vertex cache order untouched
+const float OVERDRAW_ACMR_THRESHOLD = 1.05f;
+
+// Average cache miss ratio (transformed vertices per triangle, 0.5 at best) and average transform to vertex
+// ratio (transformed vertices per unique vertex, 1 at best) of an index stream under a FIFO cache
+struct VertexCacheStats
+{
+	float acmr = 0.0f;
+	float atvr = 0.0f;
+};
+
+struct MeshOptimizationStats
+{
+	VertexCacheStats before;
+	VertexCacheStats after;
+};
+
+VertexCacheStats AnalyzeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize = VERTEX_CACHE_SIZE);
+
+// Reorders the triangles for the post-transform cache with Tipsify (Sander et al. 2007), linear in the index count
+void OptimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize = VERTEX_CACHE_SIZE);
+// Splits a cache optimised stream into clusters wherever the cache restarts or the cluster ACMR allows, then sorts
+// the clusters so the ones facing away from the mesh centre, which tend to occlude the rest, are drawn first
+void OptimizeOverdraw(uint32_t* indices, size_t indexCount, const Vertex* vertices, size_t vertexCount, float threshold = OVERDRAW_ACMR_THRESHOLD, uint32_t cacheSize = VERTEX_CACHE_SIZE);
+// Renumbers the vertices in the order the indices first reference them so vertex fetch reads sequentially.
+// Unreferenced vertices are dropped, returns the new vertex count
+size_t OptimizeVertexFetch(std::vector<Vertex>& vertices, uint32_t* indices, size_t indexCount);
+
+// Triangles firstIndex .. firstIndex + indexCount of a mesh, with indices relative to baseVertex and below vertexCount
+struct Submesh
+{
+	uint32_t firstIndex = 0;
+	uint32_t indexCount = 0;
+	uint32_t baseVertex = 0;
+	uint32_t vertexCount = 0;
+};
+
+// Largest vertex count a submesh drawn with 16 bit indices can reference
+const uint32_t MAX_SUBMESH_VERTICES = 65536;
+
+// Cuts the triangles, in order, into submeshes of at most maxVertices vertices each so they can use 16 bit indices.
+// Each submesh gets its own contiguous vertex range in first use order, vertices shared across a cut are duplicated.
+// The indices are rewritten relative to their submesh's baseVertex
+std::vector<Submesh> SplitSubmeshes(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, uint32_t maxVertices = MAX_SUBMESH_VERTICES);
+
+// All three passes in the order they have to run in
+MeshOptimizationStats OptimizeMesh(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
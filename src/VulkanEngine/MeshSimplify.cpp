@@ -0,0 +1,310 @@
+#include "MeshSimplify.h"
+#include "JobSystem.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <unordered_map>
+
+// A LOD that keeps more than this fraction of the previous one's triangles ends the chain
+static const float MIN_MESH_LOD_GAIN = 0.85f;
+
+// Sum of the squared distance to a set of planes as a symmetric 4x4 matrix, weight counts the planes
+struct Quadric
+{
+	double a00 = 0.0, a01 = 0.0, a02 = 0.0, a03 = 0.0;
+	double a11 = 0.0, a12 = 0.0, a13 = 0.0;
+	double a22 = 0.0, a23 = 0.0;
+	double a33 = 0.0;
+	double weight = 0.0;
+
+	void AddPlane(const glm::vec3& normal, float distance)
+	{
+		double a = normal.x, b = normal.y, c = normal.z, d = distance;
+		a00 += a * a; a01 += a * b; a02 += a * c; a03 += a * d;
+		a11 += b * b; a12 += b * c; a13 += b * d;
+		a22 += c * c; a23 += c * d;
+		a33 += d * d;
+		weight += 1.0;
+	}
+
+	void Add(const Quadric& other)
+	{
+		a00 += other.a00; a01 += other.a01; a02 += other.a02; a03 += other.a03;
+		a11 += other.a11; a12 += other.a12; a13 += other.a13;
+		a22 += other.a22; a23 += other.a23;
+		a33 += other.a33;
+		weight += other.weight;
+	}
+
+	// Mean squared distance of p to the planes
+	double Evaluate(const glm::vec3& p) const
+	{
+		double x = p.x, y = p.y, z = p.z;
+		double q = a00 * x * x + 2.0 * a01 * x * y + 2.0 * a02 * x * z + 2.0 * a03 * x
+			+ a11 * y * y + 2.0 * a12 * y * z + 2.0 * a13 * y
+			+ a22 * z * z + 2.0 * a23 * z
+			+ a33;
+		return weight > 0.0 ? std::max(q, 0.0) / weight : 0.0;
+	}
+};
+
+struct Collapse
+{
+	uint32_t from;
+	uint32_t to;
+	double cost;
+};
+
+static void LockSeamsAndBorders(const Vertex* vertices, size_t vertexCount, const uint32_t* indices, size_t indexCount, std::vector<bool>& locked)
+{
+	// Vertices that share a position with another one sit on a UV or normal seam
+	std::vector<uint32_t> order(vertexCount);
+	std::iota(order.begin(), order.end(), 0);
+	auto lessPosition = [&](uint32_t a, uint32_t b)
+	{
+		const glm::vec3& pa = vertices[a].pos;
+		const glm::vec3& pb = vertices[b].pos;
+		return pa.x != pb.x ? pa.x < pb.x : pa.y != pb.y ? pa.y < pb.y : pa.z < pb.z;
+	};
+	std::sort(order.begin(), order.end(), lessPosition);
+	for (size_t i = 1; i < vertexCount; i++)
+	{
+		if (vertices[order[i - 1]].pos == vertices[order[i]].pos)
+		{
+			locked[order[i - 1]] = true;
+			locked[order[i]] = true;
+		}
+	}
+
+	// Edges without exactly two triangles are borders, which includes the cuts between submeshes
+	std::unordered_map<uint64_t, uint32_t> edgeTriangles;
+	edgeTriangles.reserve(indexCount);
+	for (size_t i = 0; i < indexCount; i += 3)
+	{
+		for (int j = 0; j < 3; j++)
+		{
+			uint32_t a = indices[i + j];
+			uint32_t b = indices[i + (j + 1) % 3];
+			edgeTriangles[(uint64_t(std::min(a, b)) << 32) | std::max(a, b)]++;
+		}
+	}
+	for (const auto& edge : edgeTriangles)
+	{
+		if (edge.second != 2)
+		{
+			locked[uint32_t(edge.first >> 32)] = true;
+			locked[uint32_t(edge.first)] = true;
+		}
+	}
+}
+
+static bool CollapseFlipsTriangle(const Vertex* vertices, const uint32_t* indices, const uint32_t* adjacency, uint32_t adjacencyBegin, uint32_t adjacencyEnd, uint32_t from, uint32_t to)
+{
+	for (uint32_t a = adjacencyBegin; a < adjacencyEnd; a++)
+	{
+		const uint32_t* triangle = indices + adjacency[a] * 3;
+		if (triangle[0] == to || triangle[1] == to || triangle[2] == to)
+		{
+			// Becomes degenerate and goes away
+			continue;
+		}
+		glm::vec3 p[3];
+		glm::vec3 moved[3];
+		for (int j = 0; j < 3; j++)
+		{
+			p[j] = vertices[triangle[j]].pos;
+			moved[j] = triangle[j] == from ? vertices[to].pos : p[j];
+		}
+		glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+		glm::vec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+		if (glm::dot(before, after) <= 0.0f)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+size_t SimplifyMesh(const Vertex * vertices, size_t vertexCount, const uint32_t * indices, size_t indexCount, size_t targetIndexCount, std::vector<uint32_t>& result, float & error)
+{
+	result.assign(indices, indices + indexCount / 3 * 3);
+	error = 0.0f;
+	if (result.size() <= targetIndexCount)
+	{
+		return result.size();
+	}
+
+	std::vector<bool> locked(vertexCount, false);
+	LockSeamsAndBorders(vertices, vertexCount, result.data(), result.size(), locked);
+
+	std::vector<Quadric> quadrics(vertexCount);
+	for (size_t i = 0; i < result.size(); i += 3)
+	{
+		const glm::vec3& p0 = vertices[result[i + 0]].pos;
+		const glm::vec3& p1 = vertices[result[i + 1]].pos;
+		const glm::vec3& p2 = vertices[result[i + 2]].pos;
+		glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+		float length = glm::length(normal);
+		if (length == 0.0f)
+		{
+			continue;
+		}
+		normal /= length;
+		for (int j = 0; j < 3; j++)
+		{
+			quadrics[result[i + j]].AddPlane(normal, -glm::dot(normal, p0));
+		}
+	}
+
+	// Each pass collapses the cheapest edges whose endpoints no other collapse of the pass touched
+	std::vector<uint32_t> liveTriangles(vertexCount);
+	std::vector<uint32_t> adjacencyOffsets(vertexCount + 1);
+	std::vector<uint32_t> adjacency;
+	std::vector<uint32_t> remap(vertexCount);
+	std::vector<bool> touched(vertexCount);
+	std::vector<Collapse> collapses;
+	double maxCost = 0.0;
+	while (result.size() > targetIndexCount)
+	{
+		size_t triangleCount = result.size() / 3;
+		std::fill(liveTriangles.begin(), liveTriangles.end(), 0);
+		for (uint32_t vertex : result)
+		{
+			liveTriangles[vertex]++;
+		}
+		for (size_t v = 0; v < vertexCount; v++)
+		{
+			adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+		}
+		adjacency.resize(result.size());
+		std::vector<uint32_t> cursors(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (size_t t = 0; t < triangleCount; t++)
+		{
+			for (int j = 0; j < 3; j++)
+			{
+				adjacency[cursors[result[t * 3 + j]]++] = static_cast<uint32_t>(t);
+			}
+		}
+
+		collapses.clear();
+		for (size_t i = 0; i < result.size(); i += 3)
+		{
+			for (int j = 0; j < 3; j++)
+			{
+				uint32_t a = result[i + j];
+				uint32_t b = result[i + (j + 1) % 3];
+				if (!locked[a])
+				{
+					Quadric merged = quadrics[a];
+					merged.Add(quadrics[b]);
+					collapses.push_back({ a, b, merged.Evaluate(vertices[b].pos) });
+				}
+				if (!locked[b])
+				{
+					Quadric merged = quadrics[b];
+					merged.Add(quadrics[a]);
+					collapses.push_back({ b, a, merged.Evaluate(vertices[a].pos) });
+				}
+			}
+		}
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+		// A collapse removes about two triangles, stop before overshooting the target
+		size_t maxCollapses = (triangleCount - targetIndexCount / 3) / 2 + 1;
+		size_t collapseCount = 0;
+		std::iota(remap.begin(), remap.end(), 0);
+		std::fill(touched.begin(), touched.end(), false);
+		for (const Collapse& collapse : collapses)
+		{
+			if (collapseCount >= maxCollapses)
+			{
+				break;
+			}
+			if (touched[collapse.from] || touched[collapse.to])
+			{
+				continue;
+			}
+			if (CollapseFlipsTriangle(vertices, result.data(), adjacency.data(), adjacencyOffsets[collapse.from], adjacencyOffsets[collapse.from + 1], collapse.from, collapse.to))
+			{
+				continue;
+			}
+			remap[collapse.from] = collapse.to;
+			quadrics[collapse.to].Add(quadrics[collapse.from]);
+			touched[collapse.from] = true;
+			touched[collapse.to] = true;
+			maxCost = std::max(maxCost, collapse.cost);
+			collapseCount++;
+		}
+		if (collapseCount == 0)
+		{
+			break;
+		}
+
+		// Touched vertices are never both source and target in one pass, a single remap lookup is enough
+		size_t write = 0;
+		for (size_t i = 0; i < result.size(); i += 3)
+		{
+			uint32_t a = remap[result[i + 0]];
+			uint32_t b = remap[result[i + 1]];
+			uint32_t c = remap[result[i + 2]];
+			if (a == b || b == c || c == a)
+			{
+				continue;
+			}
+			result[write++] = a;
+			result[write++] = b;
+			result[write++] = c;
+		}
+		result.resize(write);
+	}
+
+	error = static_cast<float>(std::sqrt(maxCost));
+	return result.size();
+}
+
+MeshLods BuildMeshLods(const std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, std::vector<Submesh>& submeshes, JobSystem * jobSystem)
+{
+	MeshLods lods;
+	size_t submeshCount = submeshes.size();
+	std::vector<std::vector<uint32_t>> lodIndices(submeshCount);
+	std::vector<float> submeshErrors(submeshCount, 0.0f);
+	size_t previousIndexCount = indices.size();
+
+	for (uint32_t lod = 1; lod < MAX_MESH_LODS; lod++)
+	{
+		// Each LOD is simplified from the previous one, the errors add up to a bound relative to LOD 0
+		jobSystem->ParallelFor(static_cast<uint32_t>(submeshCount), [&](uint32_t s, uint32_t /*worker*/)
+		{
+			const Submesh& submesh = submeshes[s];
+			std::vector<uint32_t> source = lod == 1 ? std::vector<uint32_t>(indices.begin() + submesh.firstIndex, indices.begin() + submesh.firstIndex + submesh.indexCount) : lodIndices[s];
+			size_t targetIndexCount = static_cast<size_t>(source.size() / 3 * MESH_LOD_REDUCTION) * 3;
+			float error = 0.0f;
+			SimplifyMesh(vertices.data() + submesh.baseVertex, submesh.vertexCount, source.data(), source.size(), targetIndexCount, lodIndices[s], error);
+			OptimizeVertexCache(lodIndices[s].data(), lodIndices[s].size(), submesh.vertexCount);
+			submeshErrors[s] += error;
+		});
+
+		size_t lodIndexCount = 0;
+		for (const auto& submeshIndices : lodIndices)
+		{
+			lodIndexCount += submeshIndices.size();
+		}
+		if (lodIndexCount == 0 || lodIndexCount > previousIndexCount * MIN_MESH_LOD_GAIN)
+		{
+			break;
+		}
+
+		for (size_t s = 0; s < submeshCount; s++)
+		{
+			Submesh submesh = submeshes[s];
+			submesh.firstIndex = static_cast<uint32_t>(indices.size());
+			submesh.indexCount = static_cast<uint32_t>(lodIndices[s].size());
+			indices.insert(indices.end(), lodIndices[s].begin(), lodIndices[s].end());
+			submeshes.push_back(submesh);
+		}
+		lods.errors[lod] = *std::max_element(submeshErrors.begin(), submeshErrors.end());
+		lods.lodCount++;
+		previousIndexCount = lodIndexCount;
+	}
+	return lods;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <vector>
+#include "Vertex.h"
+#include "MeshOptimize.h"
+
+class JobSystem;
+
+const uint32_t MAX_MESH_LODS = 4;
+// Each LOD aims for this fraction of the previous one's triangles
+const float MESH_LOD_REDUCTION = 0.5f;
+
+// errors[lod] is the object space distance the LOD may deviate from the full resolution mesh, 0 for LOD 0
+struct MeshLods
+{
+	uint32_t lodCount = 1;
+	float errors[MAX_MESH_LODS] = {};
+};
+
+// Quadric error metric edge collapse (Garland and Heckbert 1997) that only moves vertices onto existing ones, so the
+// result indexes the same vertices. Vertices on borders, UV seams and non manifold edges never move.
+// Returns the index count of result and writes the largest error of the collapses made
+size_t SimplifyMesh(const Vertex* vertices, size_t vertexCount, const uint32_t* indices, size_t indexCount, size_t targetIndexCount, std::vector<uint32_t>& result, float& error);
+
+// Appends LODs 1 .. MAX_MESH_LODS - 1 of every submesh behind the full resolution indices. The submesh list becomes
+// LOD major, LOD l of submesh s is submeshes[l * submeshCount + s], each LOD reusing the submesh's vertex range.
+// Stops early once a LOD no longer gets noticeably smaller
+MeshLods BuildMeshLods(const std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, std::vector<Submesh>& submeshes, JobSystem* jobSystem);
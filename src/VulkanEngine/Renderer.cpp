@@ -1,19 +1,47 @@
 #include "Renderer.h"
 #include "Window.h"
-
-Renderer::Renderer()
+#include "Uploader.h"
+#include "JobSystem.h"
+#include "FrameScheduler.h"
+#include "SharedResources.h"
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+
+Renderer::Renderer(bool headless)
 {
+	_headless = headless;
 	_SetupLayersAndExtensions();
 	_SetupDebug();
 	_InitInstance();
 	_InitDebug();
 	_InitDevice();
+	_InitPipelineCache();
+	_memoryAllocator = new MemoryAllocator(_device, _gpuProperties, _gpuMemoryProperties);
+	_uploader = new Uploader(this);
+	_jobSystem = new JobSystem();
+	_frameScheduler = new FrameScheduler(this, _framesInFlight);
+	_sharedResources = new SharedResources(this);
 }
 
 
 Renderer::~Renderer()
 {
-	delete _window;
+	vkDeviceWaitIdle(_device);
+	_deletionQueue.Flush();
+	// Whatever the windows and the shared resources release from here on is destroyed right away
+	delete _frameScheduler;
+	_frameScheduler = nullptr;
+	for (auto window : _windows)
+	{
+		delete window;
+	}
+	_windows.clear();
+	delete _sharedResources;
+	delete _jobSystem;
+	delete _uploader;
+	delete _memoryAllocator;
+	_DeInitPipelineCache();
 	_DeInitDevice();
 	_DeInitDebug();
 	_DeInitInstance();
@@ -21,17 +49,177 @@ Renderer::~Renderer()
 
 Window * Renderer::OpenWindow(uint32_t size_x, uint32_t size_y, std::string name)
 {
-	_window = new Window(this, size_x,size_y,name);
-	return _window;
+	Window* window = new Window(this, size_x, size_y, name);
+	_windows.push_back(window);
+	return window;
 }
 
 bool Renderer::Run()
 {
-	if (_window != nullptr )
+	_uploader->Update();
+	// Both waits come before the OS events are polled, so the frame is built from input sampled as late as possible
+	for (auto window : _windows)
+	{
+		window->_WaitForPresents();
+	}
+	double frameLimiterMs = _frameLimiter.Wait();
+	auto inputSampleTime = std::chrono::high_resolution_clock::now();
+
+	bool run = true;
+	for (auto window : _windows)
+	{
+		window->_frameTimings.frameLimiterMs = frameLimiterMs;
+		window->_inputSampleTime = inputSampleTime;
+		run = window->Update() && run;
+	}
+	return run;
+}
+
+void Renderer::DrawFrame()
+{
+	auto fenceWaitStart = std::chrono::high_resolution_clock::now();
+	_frameScheduler->BeginFrame();
+	_deletionQueue.Collect(_frameScheduler->GetCompletedValue());
+	double fenceWaitMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - fenceWaitStart).count();
+
+	// The texture is shared, it is streamed at the largest size any window shows it
+	float maxTexturePixels = 0.0f;
+	for (auto window : _windows)
+	{
+		maxTexturePixels = std::max(maxTexturePixels, window->_GetMaxTexturePixels());
+	}
+	_sharedResources->BeginFrame(maxTexturePixels);
+
+	// A window whose swapchain is out of date sits the frame out
+	std::vector<Window*> windows;
+	for (auto window : _windows)
+	{
+		window->_frameTimings.fenceWaitMs = fenceWaitMs;
+		if (window->_AcquireImage())
+		{
+			windows.push_back(window);
+		}
+	}
+	if (windows.empty())
+	{
+		// Nothing was submitted, the frame keeps its value and slot for the next attempt
+		return;
+	}
+	_sharedResources->WaitForUploads();
+
+	// Windows record one after the other, they share the frame's command pools and the scene's visibility
+	std::vector<VkCommandBuffer> commandBuffers;
+	std::vector<VkSemaphore> waitSemaphores;
+	std::vector<VkPipelineStageFlags> waitStages;
+	std::vector<VkSemaphore> signalSemaphores;
+	std::vector<VkSwapchainKHR> swapchains;
+	std::vector<uint32_t> imageIndices;
+	std::vector<uint64_t> presentIds;
+	for (auto window : windows)
+	{
+		commandBuffers.push_back(window->_RecordFrame());
+		if (!window->_headless)
+		{
+			waitSemaphores.push_back(window->_imageAvailableSemaphores[window->currentFrame]);
+			waitStages.push_back(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+			signalSemaphores.push_back(window->_renderFinishedSemaphores[window->currentFrame]);
+			swapchains.push_back(window->_swapchain);
+			imageIndices.push_back(window->_imageIndex);
+			presentIds.push_back(++window->_presentId);
+		}
+	}
+
+	auto submitStart = std::chrono::high_resolution_clock::now();
+	_frameScheduler->Submit(commandBuffers, waitSemaphores, waitStages, signalSemaphores);
+	auto presentStart = std::chrono::high_resolution_clock::now();
+	double submitMs = std::chrono::duration<double, std::milli>(presentStart - submitStart).count();
+
+	std::vector<VkResult> presentResults(swapchains.size(), VK_SUCCESS);
+	if (!swapchains.empty())
+	{
+		VkPresentInfoKHR presentInfo = {};
+		presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+		presentInfo.waitSemaphoreCount = static_cast<uint32_t>(signalSemaphores.size());
+		presentInfo.pWaitSemaphores = signalSemaphores.data();
+		presentInfo.swapchainCount = static_cast<uint32_t>(swapchains.size());
+		presentInfo.pSwapchains = swapchains.data();
+		presentInfo.pImageIndices = imageIndices.data();
+		presentInfo.pResults = presentResults.data();
+
+		VkPresentIdKHR presentIdInfo = {};
+		if (_waitForPresent != nullptr)
+		{
+			presentIdInfo.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+			presentIdInfo.swapchainCount = static_cast<uint32_t>(presentIds.size());
+			presentIdInfo.pPresentIds = presentIds.data();
+			presentInfo.pNext = &presentIdInfo;
+		}
+
+		// Each window handles the result of its own swapchain
+		VkResult result = vkQueuePresentKHR(_queue, &presentInfo);
+		if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR && result != VK_ERROR_OUT_OF_DATE_KHR) {
+			throw std::runtime_error("failed to present swap chain image!");
+		}
+	}
+	auto presentEnd = std::chrono::high_resolution_clock::now();
+	double presentMs = std::chrono::duration<double, std::milli>(presentEnd - presentStart).count();
+	_frameLimiter.EndFrame();
+
+	size_t presentIndex = 0;
+	for (auto window : windows)
+	{
+		window->_frameTimings.submitMs = submitMs;
+		window->_frameTimings.presentMs = window->_headless ? 0.0 : presentMs;
+		window->_EndFrame(window->_headless ? VK_SUCCESS : presentResults[presentIndex++], presentEnd);
+	}
+}
+
+void Renderer::SetFramesInFlight(uint32_t framesInFlight)
+{
+	framesInFlight = std::max(framesInFlight, 1u);
+	if (framesInFlight == _framesInFlight)
 	{
-		return _window->Update();
+		return;
+	}
+	// The scheduler keeps counting, so values handed out before stay valid
+	vkDeviceWaitIdle(_device);
+	_framesInFlight = framesInFlight;
+	_frameScheduler->SetFramesInFlight(framesInFlight);
+	_sharedResources->SetFramesInFlight(framesInFlight);
+	for (auto window : _windows)
+	{
+		window->_SetFramesInFlight(framesInFlight);
 	}
-	return true;
+}
+
+uint32_t Renderer::GetFramesInFlight() const
+{
+	return _framesInFlight;
+}
+
+void Renderer::SetFrameRateLimit(double framesPerSecond)
+{
+	_frameLimiter.SetFrameRate(framesPerSecond);
+}
+
+void Renderer::DestroyDeferred(std::function<void()> destroy)
+{
+	if (_frameScheduler == nullptr)
+	{
+		destroy();
+		return;
+	}
+	_deletionQueue.Push(_frameScheduler->GetSubmittedValue(), destroy);
+}
+
+FrameScheduler * Renderer::GetFrameScheduler() const
+{
+	return _frameScheduler;
+}
+
+SharedResources * Renderer::GetSharedResources() const
+{
+	return _sharedResources;
 }
 
 const VkInstance Renderer::GetVulkanInstance() const
@@ -59,6 +247,21 @@ const uint32_t Renderer::GetVulkanGraphicsQueueFamilyIndex() const
 	return _graphicsFamilyIndex;
 }
 
+const uint32_t Renderer::GetVulkanGraphicsQueueTimestampValidBits() const
+{
+	return _graphicsQueueTimestampValidBits;
+}
+
+const VkQueue Renderer::GetVulkanTransferQueue() const
+{
+	return _transferQueue;
+}
+
+const uint32_t Renderer::GetVulkanTransferQueueFamilyIndex() const
+{
+	return _transferFamilyIndex;
+}
+
 const VkPhysicalDeviceProperties & Renderer::GetVulkanPhysicalDeviceProperties() const
 {
 	return _gpuProperties;
@@ -74,8 +277,68 @@ const VkSampleCountFlagBits Renderer::GetMaxSampleCount() const
 	return _msaaSamples;
 }
 
+const VkPhysicalDeviceFeatures & Renderer::GetEnabledFeatures() const
+{
+	return _enabledFeatures;
+}
+
+PFN_vkCmdDrawIndexedIndirectCountKHR Renderer::GetCmdDrawIndexedIndirectCount() const
+{
+	return _cmdDrawIndexedIndirectCount;
+}
+
+PFN_vkWaitForPresentKHR Renderer::GetWaitForPresent() const
+{
+	return _waitForPresent;
+}
+
+const bool Renderer::SupportsTimelineSemaphores() const
+{
+	return _timelineSemaphores;
+}
+
+const bool Renderer::SupportsDescriptorIndexing() const
+{
+	return _descriptorIndexing;
+}
+
+const VkPhysicalDeviceDescriptorIndexingPropertiesEXT & Renderer::GetDescriptorIndexingProperties() const
+{
+	return _descriptorIndexingProperties;
+}
+
+const VkPipelineCache Renderer::GetVulkanPipelineCache() const
+{
+	return _pipelineCache;
+}
+
+MemoryAllocator * Renderer::GetMemoryAllocator() const
+{
+	return _memoryAllocator;
+}
+
+Uploader * Renderer::GetUploader() const
+{
+	return _uploader;
+}
+
+JobSystem * Renderer::GetJobSystem() const
+{
+	return _jobSystem;
+}
+
+const bool Renderer::IsHeadless() const
+{
+	return _headless;
+}
+
 void Renderer::_SetupLayersAndExtensions()
 {
+	// Headless rendering has no surface to present to, so none of the WSI extensions are required
+	if (_headless)
+	{
+		return;
+	}
 	//_instanceExtensions.push_back(VK_KHR_DISPLAY_EXTENSION_NAME);
 	_instanceExtensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
 	AddRequiredPlatformInstanceExtensions(&_instanceExtensions);
@@ -84,6 +347,35 @@ void Renderer::_SetupLayersAndExtensions()
 
 void Renderer::_InitInstance()
 {
+	{
+		// Render nodes usually run without the SDK, drop the layers that are not installed instead of failing instance creation
+		uint32_t layerCount = 0;
+		vkEnumerateInstanceLayerProperties(&layerCount, nullptr);
+		std::vector<VkLayerProperties> layerPropertiesList(layerCount);
+		vkEnumerateInstanceLayerProperties(&layerCount, layerPropertiesList.data());
+		for (auto it = _instanceLayers.begin(); it != _instanceLayers.end();)
+		{
+			bool found = false;
+			for (auto &i : layerPropertiesList)
+			{
+				if (strcmp(i.layerName, *it) == 0)
+				{
+					found = true;
+					break;
+				}
+			}
+			if (!found)
+			{
+				std::cout << "Instance layer " << *it << " not available, skipping" << std::endl;
+				it = _instanceLayers.erase(it);
+			}
+			else
+			{
+				++it;
+			}
+		}
+	}
+
 	VkApplicationInfo applicationInfo{};
 	applicationInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
 	applicationInfo.apiVersion = VK_API_VERSION_1_1;
@@ -129,6 +421,8 @@ void Renderer::_InitDevice()
 		std::vector<VkQueueFamilyProperties> familyPropertyList(familyCount);
 		vkGetPhysicalDeviceQueueFamilyProperties(_gpu, &familyCount, familyPropertyList.data());
 		getGraphicsFamilyIndex(familyPropertyList.data(), familyCount);
+		_graphicsQueueTimestampValidBits = familyPropertyList[_graphicsFamilyIndex].timestampValidBits;
+		getTransferFamilyIndex(familyPropertyList.data(), familyCount);
 	}
 
 	{
@@ -158,20 +452,139 @@ void Renderer::_InitDevice()
 
 	float queuePriorities[] { 1.0f };
 
-	VkDeviceQueueCreateInfo deviceQueueCreateInfo{};
-	deviceQueueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-	deviceQueueCreateInfo.queueFamilyIndex = _graphicsFamilyIndex;
-	deviceQueueCreateInfo.queueCount = 1;
-	deviceQueueCreateInfo.pQueuePriorities = queuePriorities;
+	std::vector<VkDeviceQueueCreateInfo> deviceQueueCreateInfos(1);
+	deviceQueueCreateInfos[0].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+	deviceQueueCreateInfos[0].queueFamilyIndex = _graphicsFamilyIndex;
+	deviceQueueCreateInfos[0].queueCount = 1;
+	deviceQueueCreateInfos[0].pQueuePriorities = queuePriorities;
+	if (_transferFamilyIndex != _graphicsFamilyIndex)
+	{
+		deviceQueueCreateInfos.push_back(deviceQueueCreateInfos[0]);
+		deviceQueueCreateInfos[1].queueFamilyIndex = _transferFamilyIndex;
+	}
 
 	VkPhysicalDeviceFeatures deviceFeatures = {};
 	deviceFeatures.samplerAnisotropy = VK_TRUE;
 	deviceFeatures.sampleRateShading = VK_TRUE;
+	// GPU driven rendering, windows fall back to CPU culling without them
+	deviceFeatures.multiDrawIndirect = _gpuFeatures.multiDrawIndirect;
+	deviceFeatures.drawIndirectFirstInstance = _gpuFeatures.drawIndirectFirstInstance;
+	_enabledFeatures = deviceFeatures;
+
+	// Both core only from Vulkan 1.2. The indirect draws are compacted on the GPU and frames are paced on a
+	// timeline semaphore when they are there
+	bool drawIndirectCount = false;
+	bool timelineSemaphore = false;
+	// Windows measure and pace against the moment a frame is actually presented when both are there
+	bool presentId = false;
+	bool presentWait = false;
+	// Materials index one bindless texture array when it is there, otherwise every instance samples the first texture
+	bool descriptorIndexing = false;
+	{
+		uint32_t extensionCount = 0;
+		vkEnumerateDeviceExtensionProperties(_gpu, nullptr, &extensionCount, nullptr);
+		std::vector<VkExtensionProperties> extensionPropertiesList(extensionCount);
+		vkEnumerateDeviceExtensionProperties(_gpu, nullptr, &extensionCount, extensionPropertiesList.data());
+		for (auto &i : extensionPropertiesList)
+		{
+			if (strcmp(i.extensionName, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME) == 0)
+			{
+				_deviceExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+				drawIndirectCount = true;
+			}
+			else if (strcmp(i.extensionName, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME) == 0)
+			{
+				timelineSemaphore = true;
+			}
+			else if (strcmp(i.extensionName, VK_KHR_PRESENT_ID_EXTENSION_NAME) == 0)
+			{
+				presentId = true;
+			}
+			else if (strcmp(i.extensionName, VK_KHR_PRESENT_WAIT_EXTENSION_NAME) == 0)
+			{
+				presentWait = true;
+			}
+			else if (strcmp(i.extensionName, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME) == 0)
+			{
+				descriptorIndexing = true;
+			}
+		}
+	}
+
+	// Both depend on VK_KHR_swapchain, which headless devices don't enable
+	presentWait = !_headless && presentWait && presentId;
+
+	// Only structures of extensions the device has may be chained, the same chain then enables the features
+	VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timelineSemaphoreFeatures = {};
+	timelineSemaphoreFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+	VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures = {};
+	presentIdFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+	VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures = {};
+	presentWaitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT descriptorIndexingFeatures = {};
+	descriptorIndexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+	auto buildFeatureChain = [&]()
+	{
+		void* chain = nullptr;
+		if (timelineSemaphore)
+		{
+			timelineSemaphoreFeatures.pNext = chain;
+			chain = &timelineSemaphoreFeatures;
+		}
+		if (presentWait)
+		{
+			presentIdFeatures.pNext = chain;
+			presentWaitFeatures.pNext = &presentIdFeatures;
+			chain = &presentWaitFeatures;
+		}
+		if (descriptorIndexing)
+		{
+			descriptorIndexingFeatures.pNext = chain;
+			chain = &descriptorIndexingFeatures;
+		}
+		return chain;
+	};
+
+	if (timelineSemaphore || presentWait || descriptorIndexing)
+	{
+		VkPhysicalDeviceFeatures2 features = {};
+		features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features.pNext = buildFeatureChain();
+		vkGetPhysicalDeviceFeatures2(_gpu, &features);
+		timelineSemaphore = timelineSemaphore && timelineSemaphoreFeatures.timelineSemaphore == VK_TRUE;
+		presentWait = presentWait && presentIdFeatures.presentId == VK_TRUE && presentWaitFeatures.presentWait == VK_TRUE;
+		descriptorIndexing = descriptorIndexing && descriptorIndexingFeatures.shaderSampledImageArrayNonUniformIndexing == VK_TRUE && descriptorIndexingFeatures.descriptorBindingSampledImageUpdateAfterBind == VK_TRUE &&
+			descriptorIndexingFeatures.descriptorBindingPartiallyBound == VK_TRUE && descriptorIndexingFeatures.runtimeDescriptorArray == VK_TRUE;
+	}
+	if (timelineSemaphore)
+	{
+		_deviceExtensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+	}
+	if (presentWait)
+	{
+		_deviceExtensions.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+		_deviceExtensions.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+	}
+	if (descriptorIndexing)
+	{
+		// VK_KHR_maintenance3, which it builds on, is core in 1.1
+		_deviceExtensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+
+		_descriptorIndexingProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT;
+		VkPhysicalDeviceProperties2 properties = {};
+		properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		properties.pNext = &_descriptorIndexingProperties;
+		vkGetPhysicalDeviceProperties2(_gpu, &properties);
+		_descriptorIndexingProperties.pNext = nullptr;
+	}
+	_timelineSemaphores = timelineSemaphore;
+	_descriptorIndexing = descriptorIndexing;
 
 	VkDeviceCreateInfo deviceCreateInfo{};
 	deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-	deviceCreateInfo.queueCreateInfoCount = 1;
-	deviceCreateInfo.pQueueCreateInfos = &deviceQueueCreateInfo;
+	deviceCreateInfo.pNext = buildFeatureChain();
+	deviceCreateInfo.queueCreateInfoCount = static_cast<uint32_t>(deviceQueueCreateInfos.size());
+	deviceCreateInfo.pQueueCreateInfos = deviceQueueCreateInfos.data();
 //	deviceCreateInfo.enabledLayerCount = _deviceLayers.size();
 //	deviceCreateInfo.ppEnabledLayerNames = _deviceLayers.data();
 	deviceCreateInfo.enabledExtensionCount = _deviceExtensions.size();
@@ -182,7 +595,17 @@ void Renderer::_InitDevice()
 
 	ErrorCheck(vkCreateDevice( _gpu, &deviceCreateInfo, nullptr, &_device));
 
+	if (drawIndirectCount)
+	{
+		_cmdDrawIndexedIndirectCount = (PFN_vkCmdDrawIndexedIndirectCountKHR)vkGetDeviceProcAddr(_device, "vkCmdDrawIndexedIndirectCountKHR");
+	}
+	if (presentWait)
+	{
+		_waitForPresent = (PFN_vkWaitForPresentKHR)vkGetDeviceProcAddr(_device, "vkWaitForPresentKHR");
+	}
+
 	vkGetDeviceQueue(_device, _graphicsFamilyIndex, 0, &_queue);
+	vkGetDeviceQueue(_device, _transferFamilyIndex, 0, &_transferQueue);
 
 	_msaaSamples = getMaxUsableSampleCount();
 }
@@ -193,6 +616,70 @@ void Renderer::_DeInitDevice()
 	_device = 0;
 }
 
+void Renderer::_InitPipelineCache()
+{
+	std::ostringstream fileName;
+	fileName << "pipeline_cache_" << std::hex << _gpuProperties.vendorID << "_" << _gpuProperties.deviceID << ".bin";
+	_pipelineCacheFileName = fileName.str();
+
+	std::vector<char> cacheData;
+	std::ifstream file(_pipelineCacheFileName, std::ios::ate | std::ios::binary);
+	if (file.is_open())
+	{
+		cacheData.resize(static_cast<size_t>(file.tellg()));
+		file.seekg(0);
+		file.read(cacheData.data(), cacheData.size());
+		file.close();
+	}
+
+	// A cache written by another driver or GPU is rejected up front rather than trusting the driver to ignore it
+	// Header layout: length, version, vendorID, deviceID, pipelineCacheUUID
+	const size_t headerSize = 4 * sizeof(uint32_t) + VK_UUID_SIZE;
+	bool valid = cacheData.size() >= headerSize;
+	if (valid)
+	{
+		uint32_t header[4];
+		memcpy(header, cacheData.data(), sizeof(header));
+		valid = header[0] >= headerSize &&
+			header[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+			header[2] == _gpuProperties.vendorID &&
+			header[3] == _gpuProperties.deviceID &&
+			memcmp(cacheData.data() + sizeof(header), _gpuProperties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+	}
+	if (!valid && !cacheData.empty())
+	{
+		std::cout << "Pipeline cache " << _pipelineCacheFileName << " does not match this device, discarding" << std::endl;
+	}
+
+	VkPipelineCacheCreateInfo pipelineCacheCreateInfo{};
+	pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	pipelineCacheCreateInfo.initialDataSize = valid ? cacheData.size() : 0;
+	pipelineCacheCreateInfo.pInitialData = valid ? cacheData.data() : nullptr;
+
+	ErrorCheck(vkCreatePipelineCache(_device, &pipelineCacheCreateInfo, nullptr, &_pipelineCache));
+}
+
+void Renderer::_DeInitPipelineCache()
+{
+	size_t dataSize = 0;
+	ErrorCheck(vkGetPipelineCacheData(_device, _pipelineCache, &dataSize, nullptr));
+	std::vector<char> cacheData(dataSize);
+	ErrorCheck(vkGetPipelineCacheData(_device, _pipelineCache, &dataSize, cacheData.data()));
+
+	std::ofstream file(_pipelineCacheFileName, std::ios::binary | std::ios::trunc);
+	if (file.is_open())
+	{
+		file.write(cacheData.data(), dataSize);
+	}
+	else
+	{
+		std::cout << "Failed to write pipeline cache " << _pipelineCacheFileName << std::endl;
+	}
+
+	vkDestroyPipelineCache(_device, _pipelineCache, nullptr);
+	_pipelineCache = VK_NULL_HANDLE;
+}
+
 #if BUILD_ENABLE_VULKAN_DEBUG
 VKAPI_ATTR VkBool32 VKAPI_CALL
 VulkanDebugCallback(
@@ -335,6 +822,32 @@ void Renderer::getGraphicsFamilyIndex(VkQueueFamilyProperties * queueList, uint3
 	}
 }
 
+void Renderer::getTransferFamilyIndex(VkQueueFamilyProperties * queueList, uint32_t queueCount)
+{
+	// Prefer a transfer only family (the DMA engines), then any non graphics family, and share the graphics queue as a last resort
+	_transferFamilyIndex = _graphicsFamilyIndex;
+	bool foundAsyncCompute = false;
+	for (uint32_t i = 0; i < queueCount; i++)
+	{
+		VkQueueFlags flags = queueList[i].queueFlags;
+		if (flags & VK_QUEUE_GRAPHICS_BIT)
+		{
+			continue;
+		}
+		if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & VK_QUEUE_COMPUTE_BIT))
+		{
+			_transferFamilyIndex = i;
+			break;
+		}
+		if ((flags & (VK_QUEUE_TRANSFER_BIT | VK_QUEUE_COMPUTE_BIT)) && !foundAsyncCompute)
+		{
+			_transferFamilyIndex = i;
+			foundAsyncCompute = true;
+		}
+	}
+	std::cout << "Using queue family " << _transferFamilyIndex << " for transfers" << std::endl;
+}
+
 VkSampleCountFlagBits Renderer::getMaxUsableSampleCount()
 {
 
@@ -7,25 +7,68 @@
 #include "Shared.h"
 #include "Platform.h"
 #include "BUILD_OPTIONS.h"
+#include "MemoryAllocator.h"
+#include "FrameLimiter.h"
+#include "DeletionQueue.h"
+#include <functional>
+
+// Frames the CPU may record ahead of the GPU, SetFramesInFlight changes it at runtime
+const uint32_t DEFAULT_FRAMES_IN_FLIGHT = 2;
 
 class Window;
+class Uploader;
+class JobSystem;
+class FrameScheduler;
+class SharedResources;
 class Renderer
 {
 public:
-	Renderer();
+	Renderer(bool headless = false);
 	~Renderer();
 
+	// Every window draws the renderer's shared scene with its own camera
 	Window* OpenWindow(uint32_t size_x, uint32_t size_y, std::string name);
+	// Handles the OS events of every window, false once any of them is closed
 	bool Run();
+	// Records every window into one submit and presents all swapchains with one vkQueuePresentKHR
+	void DrawFrame();
+
+	// More frames in flight keep the GPU busier at the cost of latency, recreates every per frame resource
+	void									SetFramesInFlight(uint32_t framesInFlight);
+	uint32_t								GetFramesInFlight() const;
+	// Frames per second Run holds the loop to, 0 for no limit
+	void									SetFrameRateLimit(double framesPerSecond);
+	// Destroys once every submitted frame has completed, right away while the renderer is torn down
+	void									DestroyDeferred(std::function<void()> destroy);
+	FrameScheduler						*	GetFrameScheduler() const;
+	SharedResources						*	GetSharedResources() const;
 
 	const VkInstance						GetVulkanInstance()	const;
 	const VkPhysicalDevice					GetVulkanPhysicalDevice() const;
 	const VkDevice							GetVulkanDevice() const;
 	const VkQueue							GetVulkanQueue() const;
 	const uint32_t							GetVulkanGraphicsQueueFamilyIndex() const;
+	const uint32_t							GetVulkanGraphicsQueueTimestampValidBits() const;
+	const VkQueue							GetVulkanTransferQueue() const;
+	const uint32_t							GetVulkanTransferQueueFamilyIndex() const;
 	const VkPhysicalDeviceProperties		&	GetVulkanPhysicalDeviceProperties() const;
 	const VkPhysicalDeviceMemoryProperties	&	GetVulkanPhysicalDeviceMemoryProperties() const;
 	const VkSampleCountFlagBits				GetMaxSampleCount() const;
+	const VkPhysicalDeviceFeatures		&	GetEnabledFeatures() const;
+	// nullptr when VK_KHR_draw_indirect_count isn't available
+	PFN_vkCmdDrawIndexedIndirectCountKHR	GetCmdDrawIndexedIndirectCount() const;
+	// nullptr unless VK_KHR_present_id and VK_KHR_present_wait are both enabled, presents then carry a VkPresentIdKHR
+	PFN_vkWaitForPresentKHR					GetWaitForPresent() const;
+	// VK_KHR_timeline_semaphore is enabled
+	const bool								SupportsTimelineSemaphores() const;
+	// VK_EXT_descriptor_indexing is enabled with non-uniform indexing into partially bound, update after bind sampled image arrays
+	const bool								SupportsDescriptorIndexing() const;
+	const VkPhysicalDeviceDescriptorIndexingPropertiesEXT	&	GetDescriptorIndexingProperties() const;
+	const VkPipelineCache					GetVulkanPipelineCache() const;
+	MemoryAllocator						*	GetMemoryAllocator() const;
+	Uploader							*	GetUploader() const;
+	JobSystem							*	GetJobSystem() const;
+	const bool								IsHeadless() const;
 
 private:
 
@@ -37,12 +80,16 @@ private:
 	void _InitDevice();
 	void _DeInitDevice();
 
+	void _InitPipelineCache();
+	void _DeInitPipelineCache();
+
 	void _SetupDebug();
 	void _InitDebug();
 	void _DeInitDebug();
 
 	void pickPhysicalDevice(VkPhysicalDevice* physicalDevices, uint32_t physicalDevicesCount);
 	void getGraphicsFamilyIndex(VkQueueFamilyProperties* queueList, uint32_t queueCount);
+	void getTransferFamilyIndex(VkQueueFamilyProperties* queueList, uint32_t queueCount);
 	VkSampleCountFlagBits getMaxUsableSampleCount();
 
 	VkInstance	_instance = VK_NULL_HANDLE;
@@ -50,10 +97,25 @@ private:
 	VkPhysicalDevice _gpu = VK_NULL_HANDLE;
 	VkQueue _queue = VK_NULL_HANDLE;
 	uint32_t _graphicsFamilyIndex = 0;
+	uint32_t _graphicsQueueTimestampValidBits = 0;
+	VkQueue _transferQueue = VK_NULL_HANDLE;
+	uint32_t _transferFamilyIndex = 0;
 	VkPhysicalDeviceFeatures _gpuFeatures = {};
+	VkPhysicalDeviceFeatures _enabledFeatures = {};
+	PFN_vkCmdDrawIndexedIndirectCountKHR _cmdDrawIndexedIndirectCount = nullptr;
+	PFN_vkWaitForPresentKHR _waitForPresent = nullptr;
+	bool _timelineSemaphores = false;
+	bool _descriptorIndexing = false;
+	VkPhysicalDeviceDescriptorIndexingPropertiesEXT _descriptorIndexingProperties = {};
 	VkPhysicalDeviceProperties _gpuProperties = {};
 	VkPhysicalDeviceMemoryProperties _gpuMemoryProperties = {};
 	VkSampleCountFlagBits _msaaSamples = VK_SAMPLE_COUNT_1_BIT;
+	bool _headless = false;
+	VkPipelineCache _pipelineCache = VK_NULL_HANDLE;
+	MemoryAllocator* _memoryAllocator = nullptr;
+	Uploader* _uploader = nullptr;
+	JobSystem* _jobSystem = nullptr;
+	std::string _pipelineCacheFileName;
 
 	std::vector<const char*> _instanceLayers;
 	std::vector<const char*> _instanceExtensions;
@@ -63,6 +125,12 @@ private:
 	VkDebugReportCallbackEXT _debugReport = nullptr;
 	VkDebugReportCallbackCreateInfoEXT debugCallbackCreateInfo{};
 
-	Window* _window = nullptr;
+	std::vector<Window*> _windows;
+	SharedResources* _sharedResources = nullptr;
+
+	uint32_t _framesInFlight = DEFAULT_FRAMES_IN_FLIGHT;
+	FrameScheduler* _frameScheduler = nullptr;
+	DeletionQueue _deletionQueue;
+	FrameLimiter _frameLimiter;
 };
 
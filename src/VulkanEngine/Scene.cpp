@@ -0,0 +1,232 @@
+#include "Scene.h"
+#include <assert.h>
+#include <algorithm>
+
+Scene::Scene()
+{
+}
+
+Scene::~Scene()
+{
+}
+
+MeshHandle Scene::AddMesh(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
+{
+	glm::vec3 boundsMin = vertices.empty() ? glm::vec3(0.0f) : vertices[0].pos;
+	glm::vec3 boundsMax = boundsMin;
+	for (const auto& vertex : vertices)
+	{
+		boundsMin = glm::min(boundsMin, vertex.pos);
+		boundsMax = glm::max(boundsMax, vertex.pos);
+	}
+	std::vector<Vertex> splitVertices = vertices;
+	std::vector<uint32_t> splitIndices = indices;
+	std::vector<Submesh> submeshes = SplitSubmeshes(splitVertices, splitIndices);
+	return AddMesh(splitVertices.data(), static_cast<uint32_t>(splitVertices.size()), splitIndices.data(), static_cast<uint32_t>(splitIndices.size()), submeshes.data(), static_cast<uint32_t>(submeshes.size()), MeshLods(), boundsMin, boundsMax);
+}
+
+MeshHandle Scene::AddMesh(const Vertex * vertices, uint32_t vertexCount, const uint32_t * indices, uint32_t indexCount, const Submesh * submeshes, uint32_t submeshCount, const MeshLods & lods, const glm::vec3 & boundsMin, const glm::vec3 & boundsMax)
+{
+	MeshHandle mesh = ReserveMesh();
+	SetMeshGeometry(mesh, vertices, vertexCount, indices, indexCount, submeshes, submeshCount, lods, boundsMin, boundsMax);
+	return mesh;
+}
+
+MeshHandle Scene::ReserveMesh()
+{
+	_meshes.push_back(Mesh());
+	return static_cast<MeshHandle>(_meshes.size() - 1);
+}
+
+void Scene::SetMeshGeometry(MeshHandle handle, const Vertex * vertices, uint32_t vertexCount, const uint32_t * indices, uint32_t indexCount, const Submesh * submeshes, uint32_t submeshCount, const MeshLods & lods, const glm::vec3 & boundsMin, const glm::vec3 & boundsMax)
+{
+	assert(handle < _meshes.size() && _meshes[handle].indexCount == 0);
+	Mesh& mesh = _meshes[handle];
+	mesh.firstIndex = static_cast<uint32_t>(_indices.size());
+	mesh.indexCount = indexCount;
+	mesh.vertexOffset = static_cast<int32_t>(_vertices.size());
+	mesh.vertexCount = vertexCount;
+	mesh.boundsMin = boundsMin;
+	mesh.boundsMax = boundsMax;
+	mesh.firstSubmesh = static_cast<uint32_t>(_submeshes.size());
+	mesh.submeshCount = submeshCount / lods.lodCount;
+	mesh.lodCount = lods.lodCount;
+	std::copy(lods.errors, lods.errors + MAX_MESH_LODS, mesh.lodErrors);
+
+	_submeshes.insert(_submeshes.end(), submeshes, submeshes + submeshCount);
+	_vertices.insert(_vertices.end(), vertices, vertices + vertexCount);
+	_indices.insert(_indices.end(), indices, indices + indexCount);
+	_geometryVersion++;
+}
+
+InstanceHandle Scene::AddInstance(MeshHandle mesh, const glm::mat4 & transform)
+{
+	assert(mesh < _meshes.size());
+	_instanceMeshes.push_back(mesh);
+	_instanceTransforms.push_back(transform);
+	_instanceMaterials.push_back(0);
+	_instanceLods.push_back(0);
+	_instanceVisible.push_back(1);
+	_drawsDirty = true;
+	_layoutVersion++;
+
+	return static_cast<InstanceHandle>(_instanceMeshes.size() - 1);
+}
+
+void Scene::SetInstanceTransform(InstanceHandle instance, const glm::mat4 & transform)
+{
+	_instanceTransforms[instance] = transform;
+}
+
+const glm::mat4 & Scene::GetInstanceTransform(InstanceHandle instance) const
+{
+	return _instanceTransforms[instance];
+}
+
+MeshHandle Scene::GetInstanceMesh(InstanceHandle instance) const
+{
+	return _instanceMeshes[instance];
+}
+
+void Scene::SetInstanceMaterial(InstanceHandle instance, uint32_t material)
+{
+	_instanceMaterials[instance] = material;
+}
+
+uint32_t Scene::GetInstanceMaterial(InstanceHandle instance) const
+{
+	return _instanceMaterials[instance];
+}
+
+void Scene::SetInstanceLod(InstanceHandle instance, uint32_t lod)
+{
+	// _BuildDraws indexes its counters by the LOD, one past the mesh's last would run into the next mesh
+	lod = std::min(lod, _meshes[_instanceMeshes[instance]].lodCount - 1);
+	if (_instanceLods[instance] != lod)
+	{
+		_instanceLods[instance] = lod;
+		_drawsDirty = true;
+	}
+}
+
+void Scene::SetInstanceVisibility(const std::vector<uint8_t>& visible)
+{
+	assert(visible.size() == _instanceVisible.size());
+	if (visible != _instanceVisible)
+	{
+		_instanceVisible = visible;
+		_drawsDirty = true;
+	}
+}
+
+const std::vector<Vertex>& Scene::GetVertices() const
+{
+	return _vertices;
+}
+
+const std::vector<uint32_t>& Scene::GetIndices() const
+{
+	return _indices;
+}
+
+const std::vector<Mesh>& Scene::GetMeshes() const
+{
+	return _meshes;
+}
+
+const std::vector<Submesh>& Scene::GetSubmeshes() const
+{
+	return _submeshes;
+}
+
+uint32_t Scene::GetInstanceCount() const
+{
+	return static_cast<uint32_t>(_instanceMeshes.size());
+}
+
+uint64_t Scene::GetGeometryVersion() const
+{
+	return _geometryVersion;
+}
+
+uint64_t Scene::GetLayoutVersion() const
+{
+	return _layoutVersion;
+}
+
+const std::vector<MeshDraw>& Scene::GetDraws()
+{
+	if (_drawsDirty)
+	{
+		_BuildDraws();
+	}
+	return _draws;
+}
+
+void Scene::WriteInstanceData(InstanceData * dst, uint32_t materialCount, const std::vector<glm::mat4>& meshTransforms)
+{
+	if (_drawsDirty)
+	{
+		_BuildDraws();
+	}
+	for (size_t i = 0; i < _drawOrder.size(); i++)
+	{
+		InstanceHandle instance = _drawOrder[i];
+		MeshHandle mesh = _instanceMeshes[instance];
+		dst[i].model = mesh < meshTransforms.size() ? _instanceTransforms[instance] * meshTransforms[mesh] : _instanceTransforms[instance];
+		dst[i].material = materialCount > 0 ? std::min(_instanceMaterials[instance], materialCount - 1) : 0;
+	}
+}
+
+void Scene::WriteGpuInstances(GpuInstance * dst, uint32_t materialCount) const
+{
+	for (InstanceHandle instance = 0; instance < _instanceMeshes.size(); instance++)
+	{
+		dst[instance].model = _instanceTransforms[instance];
+		dst[instance].mesh = _instanceMeshes[instance];
+		dst[instance].material = materialCount > 0 ? std::min(_instanceMaterials[instance], materialCount - 1) : 0;
+	}
+}
+
+void Scene::_BuildDraws()
+{
+	// Counting sort of the visible instances by mesh and LOD, the per-key counts become the draws
+	std::vector<uint32_t> counts(_meshes.size() * MAX_MESH_LODS, 0);
+	for (InstanceHandle instance = 0; instance < _instanceMeshes.size(); instance++)
+	{
+		if (_instanceVisible[instance])
+		{
+			counts[_instanceMeshes[instance] * MAX_MESH_LODS + _instanceLods[instance]]++;
+		}
+	}
+
+	_draws.clear();
+	std::vector<uint32_t> cursors(counts.size(), 0);
+	uint32_t firstInstance = 0;
+	for (uint32_t key = 0; key < counts.size(); key++)
+	{
+		cursors[key] = firstInstance;
+		if (counts[key] == 0)
+		{
+			continue;
+		}
+		MeshDraw draw;
+		draw.mesh = key / MAX_MESH_LODS;
+		draw.lod = key % MAX_MESH_LODS;
+		draw.firstInstance = firstInstance;
+		draw.instanceCount = counts[key];
+		_draws.push_back(draw);
+		firstInstance += counts[key];
+	}
+
+	_drawOrder.resize(firstInstance);
+	for (InstanceHandle instance = 0; instance < _instanceMeshes.size(); instance++)
+	{
+		if (!_instanceVisible[instance])
+		{
+			continue;
+		}
+		_drawOrder[cursors[_instanceMeshes[instance] * MAX_MESH_LODS + _instanceLods[instance]]++] = instance;
+	}
+	_drawsDirty = false;
+}
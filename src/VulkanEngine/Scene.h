@@ -0,0 +1,106 @@
+#pragma once
+
+#include <vector>
+#include "Vertex.h"
+#include "MeshOptimize.h"
+#include "MeshSimplify.h"
+#include "Culling.h"
+
+typedef uint32_t MeshHandle;
+typedef uint32_t InstanceHandle;
+
+// Range of the scene's shared vertex and index arrays that belongs to one mesh
+struct Mesh
+{
+	uint32_t firstIndex = 0;
+	uint32_t indexCount = 0;
+	int32_t vertexOffset = 0;
+	uint32_t vertexCount = 0;
+	glm::vec3 boundsMin = glm::vec3(0.0f);
+	glm::vec3 boundsMax = glm::vec3(0.0f);
+	// LOD l is made of submeshes firstSubmesh + l * submeshCount .. firstSubmesh + (l + 1) * submeshCount of the
+	// scene, their ranges are relative to the mesh's. Every LOD shares the mesh's vertices
+	uint32_t firstSubmesh = 0;
+	uint32_t submeshCount = 0;
+	uint32_t lodCount = 1;
+	float lodErrors[MAX_MESH_LODS] = {};
+};
+
+// One instanced draw, instances firstInstance .. firstInstance + instanceCount of the draw ordered instance data
+struct MeshDraw
+{
+	MeshHandle mesh = 0;
+	uint32_t lod = 0;
+	uint32_t firstInstance = 0;
+	uint32_t instanceCount = 0;
+};
+
+// Meshes share one vertex and one index array, instances are grouped by mesh and LOD so that the number of
+// draws depends on the number of unique meshes only.
+// The geometry version changes when meshes are added, the layout version when instances are added,
+// transforms can change every frame without invalidating either.
+class Scene
+{
+public:
+	Scene();
+	~Scene();
+
+	// Splits the mesh into submeshes first
+	MeshHandle AddMesh(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices);
+	// Copies the streams as they are, for data that is already split and knows its bounds such as a mapped mesh cache
+	MeshHandle AddMesh(const Vertex* vertices, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount, const Submesh* submeshes, uint32_t submeshCount, const MeshLods& lods, const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+	// Hands out a handle for a mesh whose geometry arrives later, it can be instanced right away and draws nothing until then
+	MeshHandle ReserveMesh();
+	void SetMeshGeometry(MeshHandle mesh, const Vertex* vertices, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount, const Submesh* submeshes, uint32_t submeshCount, const MeshLods& lods, const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+	InstanceHandle AddInstance(MeshHandle mesh, const glm::mat4& transform);
+	void SetInstanceTransform(InstanceHandle instance, const glm::mat4& transform);
+	const glm::mat4& GetInstanceTransform(InstanceHandle instance) const;
+	MeshHandle GetInstanceMesh(InstanceHandle instance) const;
+	// Index of the instance's texture in the bindless array, SharedResources::LoadTexture hands them out. Defaults to 0
+	void SetInstanceMaterial(InstanceHandle instance, uint32_t material);
+	uint32_t GetInstanceMaterial(InstanceHandle instance) const;
+	// Changing the LOD or the visibility regroups the draws but doesn't change the layout version. The LOD is clamped
+	// to the mesh's last one
+	void SetInstanceLod(InstanceHandle instance, uint32_t lod);
+	// One entry per instance, hidden instances are left out of the draws
+	void SetInstanceVisibility(const std::vector<uint8_t>& visible);
+
+	const std::vector<Vertex>& GetVertices() const;
+	const std::vector<uint32_t>& GetIndices() const;
+	const std::vector<Mesh>& GetMeshes() const;
+	const std::vector<Submesh>& GetSubmeshes() const;
+	uint32_t GetInstanceCount() const;
+
+	uint64_t GetGeometryVersion() const;
+	uint64_t GetLayoutVersion() const;
+
+	const std::vector<MeshDraw>& GetDraws();
+	// Writes one entry per visible instance in the order GetDraws() refers to. meshTransforms, if not empty, holds
+	// one matrix per mesh that is applied before the instance transform. Materials are clamped below materialCount,
+	// a count of 0 writes material 0
+	void WriteInstanceData(InstanceData* dst, uint32_t materialCount, const std::vector<glm::mat4>& meshTransforms = {});
+	// Writes every instance in handle order for GPU culling, which ignores the LOD and visibility set here. Materials
+	// are clamped like in WriteInstanceData
+	void WriteGpuInstances(GpuInstance* dst, uint32_t materialCount) const;
+
+private:
+	void _BuildDraws();
+
+	std::vector<Vertex> _vertices;
+	std::vector<uint32_t> _indices;
+	std::vector<Mesh> _meshes;
+	std::vector<Submesh> _submeshes;
+
+	std::vector<MeshHandle> _instanceMeshes;
+	std::vector<glm::mat4> _instanceTransforms;
+	std::vector<uint32_t> _instanceMaterials;
+	std::vector<uint32_t> _instanceLods;
+	std::vector<uint8_t> _instanceVisible;
+
+	std::vector<InstanceHandle> _drawOrder;
+	std::vector<MeshDraw> _draws;
+	bool _drawsDirty = false;
+
+	uint64_t _geometryVersion = 0;
+	uint64_t _layoutVersion = 0;
+};
@@ -1,15 +1,27 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
-layout(binding = 1) uniform sampler2D texSampler;
+// Set 1 is SharedResources' bindless texture array, the material indexes it. Without descriptor
+// indexing (frag.spv) the array holds a single texture
+#ifdef DESCRIPTOR_INDEXING
+#extension GL_EXT_nonuniform_qualifier : require
+layout(set = 1, binding = 0) uniform texture2D textures[];
+#else
+layout(set = 1, binding = 0) uniform texture2D textures[1];
+#endif
+layout(set = 1, binding = 1) uniform sampler texSampler;
 
-layout(location = 0) in vec3 fragColor;
 layout(location = 1) in vec2 fragTexCoord;
+layout(location = 2) flat in uint fragMaterial;
 
 layout(location = 0) out vec4 outColor;
 
 void main() {
-    outColor = texture(texSampler, fragTexCoord);
+#ifdef DESCRIPTOR_INDEXING
+    outColor = texture(sampler2D(textures[nonuniformEXT(fragMaterial)], texSampler), fragTexCoord);
+#else
+    outColor = texture(sampler2D(textures[0], texSampler), fragTexCoord);
+#endif
 
 	if (outColor.a == 0.0) {
     	discard;
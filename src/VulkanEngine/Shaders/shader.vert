@@ -2,20 +2,22 @@
 #extension GL_ARB_separate_shader_objects : enable
 
 layout(binding = 0) uniform UniformBufferObject {
-    mat4 model;
     mat4 view;
     mat4 proj;
 } ubo;
 
+// Quantised positions are relative to the mesh bounds, inModel undoes that. Location 1 holds the
+// normal when the vertex layout has one
 layout(location = 0) in vec3 inPosition;
-layout(location = 1) in vec3 inColor;
 layout(location = 2) in vec2 inTexCoord;
+layout(location = 3) in mat4 inModel;
+layout(location = 7) in uint inMaterial;
 
-layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) flat out uint fragMaterial;
 
 void main() {
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
-    fragColor = inColor;
+    gl_Position = ubo.proj * ubo.view * inModel * vec4(inPosition, 1.0);
     fragTexCoord = inTexCoord;
+    fragMaterial = inMaterial;
 }
\ No newline at end of file
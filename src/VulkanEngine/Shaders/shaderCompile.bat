@@ -1,3 +1,5 @@
 glslangValidator.exe -V shader.vert
 glslangValidator.exe -V shader.frag
+glslangValidator.exe -V -DDESCRIPTOR_INDEXING shader.frag -o frag_bindless.spv
+glslangValidator.exe -V cull.comp -o cull.spv
 pause
\ No newline at end of file
@@ -0,0 +1,1613 @@
+#include "SharedResources.h"
+#include "Uploader.h"
+#include "JobSystem.h"
+#include "MeshCache.h"
+#include "MeshImport.h"
+#include "FrameScheduler.h"
+#include <algorithm>
+
+SharedResources::SharedResources(Renderer * renderer)
+{
+	_renderer = renderer;
+	_framesInFlight = renderer->GetFramesInFlight();
+	_gpuCulling = renderer->GetEnabledFeatures().drawIndirectFirstInstance == VK_TRUE;
+	_InitDepthStencilFormat();
+	_InitDescriptorSetLayout();
+	_InitShaderModules();
+	_InitCommandPool();
+	_InitFrameCommandBuffers();
+	_InitTextureImage();
+	_InitTextureSampler();
+	_InitBindlessDescriptorSets();
+	_InitCullPipelineLayout();
+	if (_gpuCulling)
+	{
+		_InitCullPipelines();
+	}
+}
+
+SharedResources::~SharedResources()
+{
+	// Decode jobs hold a pointer to the shared resources
+	_renderer->GetJobSystem()->WaitIdle();
+	try
+	{
+		_ProcessDecodedAssets();
+	}
+	catch (const std::exception& e)
+	{
+		std::cout << e.what() << std::endl;
+	}
+	_renderer->GetUploader()->WaitIdle();
+	_DeInitCullBuffers();
+	_DeInitCullPipelines();
+	_DeInitCullPipelineLayout();
+	_DeInitIndexBuffers();
+	_DeInitVertexBuffers();
+	_DeInitBindlessDescriptorSets();
+	_DeInitTextureSampler();
+	_DeInitTextureImage();
+	_DeInitFrameCommandBuffers();
+	_DeInitCommandPool();
+	_DeInitRenderPasses();
+	_DeInitShaderModules();
+	_DeInitDescriptorSetLayout();
+}
+
+void SharedResources::BeginFrame(float maxTexturePixels)
+{
+	_frameIndex = _renderer->GetFrameScheduler()->GetFrameIndex();
+	FrameCommandBuffers& frame = _frameCommandBuffers[_frameIndex];
+	ErrorCheck(vkResetCommandPool(_renderer->GetVulkanDevice(), frame.primaryPool, 0));
+	frame.primariesUsed = 0;
+	for (uint32_t worker = 0; worker < frame.workerPools.size(); worker++)
+	{
+		ErrorCheck(vkResetCommandPool(_renderer->GetVulkanDevice(), frame.workerPools[worker], 0));
+		frame.workerSecondariesUsed[worker] = 0;
+	}
+
+	_ProcessDecodedAssets();
+	_UpdateTextureStreaming(maxTexturePixels);
+	_UpdateBindlessDescriptorSet(_frameIndex);
+	_SyncScene();
+	if (_gpuCulling && _gpuInstanceBuffer != VK_NULL_HANDLE)
+	{
+		_scene.WriteGpuInstances(reinterpret_cast<GpuInstance*>(static_cast<char*>(_gpuInstanceBufferMemory.mapped) + _gpuInstanceSegmentSize * _frameIndex), _bindlessTextureCapacity);
+	}
+}
+
+void SharedResources::WaitForUploads()
+{
+	// Geometry is uploaded right before the frame that first draws it, the texture is only bound once it has arrived
+	if (!_renderer->GetUploader()->IsComplete(_assetUploadTicket))
+	{
+		_renderer->GetUploader()->Wait(_assetUploadTicket);
+	}
+}
+
+void SharedResources::SetFramesInFlight(uint32_t framesInFlight)
+{
+	_DeInitFrameCommandBuffers();
+	_framesInFlight = framesInFlight;
+	_InitFrameCommandBuffers();
+	_DeInitBindlessDescriptorSets();
+	_InitBindlessDescriptorSets();
+	// The GPU instance buffer has a segment per frame
+	_RebuildCullBuffers();
+}
+
+VkCommandBuffer SharedResources::GetPrimaryCommandBuffer()
+{
+	FrameCommandBuffers& frame = _frameCommandBuffers[_frameIndex];
+	if (frame.primariesUsed == frame.primaries.size())
+	{
+		VkCommandBufferAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = frame.primaryPool;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandBufferCount = 1;
+
+		frame.primaries.push_back(VK_NULL_HANDLE);
+		ErrorCheck(vkAllocateCommandBuffers(_renderer->GetVulkanDevice(), &allocInfo, &frame.primaries.back()));
+	}
+	return frame.primaries[frame.primariesUsed++];
+}
+
+VkCommandBuffer SharedResources::GetSecondaryCommandBuffer(uint32_t worker)
+{
+	FrameCommandBuffers& frame = _frameCommandBuffers[_frameIndex];
+	std::vector<VkCommandBuffer>& secondaries = frame.workerSecondaries[worker];
+	uint32_t& used = frame.workerSecondariesUsed[worker];
+	if (used == secondaries.size())
+	{
+		VkCommandBufferAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = frame.workerPools[worker];
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+		allocInfo.commandBufferCount = 1;
+
+		secondaries.push_back(VK_NULL_HANDLE);
+		ErrorCheck(vkAllocateCommandBuffers(_renderer->GetVulkanDevice(), &allocInfo, &secondaries.back()));
+	}
+	return secondaries[used++];
+}
+
+void SharedResources::_InitFrameCommandBuffers()
+{
+	// Pools are per frame in flight so a whole frame is recycled with one reset once its slot is free again,
+	// and per worker because a pool must only be used by one thread at a time
+	uint32_t workerCount = _renderer->GetJobSystem()->GetWorkerCount();
+	_frameCommandBuffers.resize(_framesInFlight);
+	for (auto &frame : _frameCommandBuffers)
+	{
+		VkCommandPoolCreateInfo poolInfo = {};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+		poolInfo.queueFamilyIndex = _renderer->GetVulkanGraphicsQueueFamilyIndex();
+
+		ErrorCheck(vkCreateCommandPool(_renderer->GetVulkanDevice(), &poolInfo, nullptr, &frame.primaryPool));
+
+		frame.workerPools.resize(workerCount);
+		frame.workerSecondaries.resize(workerCount);
+		frame.workerSecondariesUsed.assign(workerCount, 0);
+		for (auto &pool : frame.workerPools)
+		{
+			ErrorCheck(vkCreateCommandPool(_renderer->GetVulkanDevice(), &poolInfo, nullptr, &pool));
+		}
+	}
+	_frameIndex = 0;
+}
+
+void SharedResources::_DeInitFrameCommandBuffers()
+{
+	for (auto &frame : _frameCommandBuffers)
+	{
+		for (auto &pool : frame.workerPools)
+		{
+			vkDestroyCommandPool(_renderer->GetVulkanDevice(), pool, nullptr);
+		}
+		vkDestroyCommandPool(_renderer->GetVulkanDevice(), frame.primaryPool, nullptr);
+	}
+	_frameCommandBuffers.clear();
+}
+
+void SharedResources::_InitCommandPool()
+{
+	VkCommandPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.queueFamilyIndex = _renderer->GetVulkanGraphicsQueueFamilyIndex();
+
+	ErrorCheck(vkCreateCommandPool(_renderer->GetVulkanDevice(), &poolInfo, nullptr, &_commandPool));
+
+}
+
+void SharedResources::_DeInitCommandPool()
+{
+	vkDestroyCommandPool(_renderer->GetVulkanDevice(), _commandPool, nullptr);
+}
+
+void SharedResources::_InitDepthStencilFormat()
+{
+	std::vector<VkFormat> try_formats{
+		VK_FORMAT_D32_SFLOAT_S8_UINT,
+		VK_FORMAT_D24_UNORM_S8_UINT,
+		VK_FORMAT_D16_UNORM_S8_UINT,
+		VK_FORMAT_D32_SFLOAT,
+		VK_FORMAT_D16_UNORM
+	};
+	for (auto f : try_formats) {
+		VkFormatProperties format_properties{};
+		vkGetPhysicalDeviceFormatProperties(_renderer->GetVulkanPhysicalDevice(), f, &format_properties);
+		if (format_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) {
+			_depthStencilFormat = f;
+			break;
+		}
+	}
+	if (_depthStencilFormat == VK_FORMAT_UNDEFINED) {
+		assert(0 && "Depth stencil format not selected.");
+		std::exit(-1);
+	}
+}
+
+void SharedResources::_InitDescriptorSetLayout()
+{
+	VkDescriptorSetLayoutBinding uboLayoutBinding = {};
+	uboLayoutBinding.binding = 0;
+	uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	uboLayoutBinding.descriptorCount = 1;
+	uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	uboLayoutBinding.pImmutableSamplers = nullptr; // Optional
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = 1;
+	layoutInfo.pBindings = &uboLayoutBinding;
+
+	ErrorCheck(vkCreateDescriptorSetLayout(_renderer->GetVulkanDevice(), &layoutInfo, nullptr, &_descriptorSetLayout));
+
+	// Sampled images and one sampler rather than combined image samplers, so the array doesn't repeat the sampler
+	_bindlessTextureCapacity = 1;
+	if (_renderer->SupportsDescriptorIndexing())
+	{
+		const VkPhysicalDeviceDescriptorIndexingPropertiesEXT& properties = _renderer->GetDescriptorIndexingProperties();
+		_bindlessTextureCapacity = std::min({ MAX_BINDLESS_TEXTURES, properties.maxPerStageDescriptorUpdateAfterBindSampledImages, properties.maxDescriptorSetUpdateAfterBindSampledImages });
+	}
+
+	std::array<VkDescriptorSetLayoutBinding, 2> bindlessBindings = {};
+	bindlessBindings[0].binding = 0;
+	bindlessBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+	bindlessBindings[0].descriptorCount = _bindlessTextureCapacity;
+	bindlessBindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	bindlessBindings[1].binding = 1;
+	bindlessBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+	bindlessBindings[1].descriptorCount = 1;
+	bindlessBindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	VkDescriptorSetLayoutCreateInfo bindlessLayoutInfo = {};
+	bindlessLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	bindlessLayoutInfo.bindingCount = static_cast<uint32_t>(bindlessBindings.size());
+	bindlessLayoutInfo.pBindings = bindlessBindings.data();
+
+	// Slots past the loaded textures are never written
+	std::array<VkDescriptorBindingFlagsEXT, 2> bindingFlags = { VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT, 0 };
+	VkDescriptorSetLayoutBindingFlagsCreateInfoEXT bindingFlagsInfo = {};
+	bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+	bindingFlagsInfo.bindingCount = static_cast<uint32_t>(bindingFlags.size());
+	bindingFlagsInfo.pBindingFlags = bindingFlags.data();
+	if (_renderer->SupportsDescriptorIndexing())
+	{
+		bindlessLayoutInfo.pNext = &bindingFlagsInfo;
+		bindlessLayoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+	}
+
+	ErrorCheck(vkCreateDescriptorSetLayout(_renderer->GetVulkanDevice(), &bindlessLayoutInfo, nullptr, &_bindlessDescriptorSetLayout));
+
+	std::array<VkDescriptorSetLayout, 2> setLayouts = { _descriptorSetLayout, _bindlessDescriptorSetLayout };
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+	pipelineLayoutInfo.pSetLayouts = setLayouts.data();
+	pipelineLayoutInfo.pushConstantRangeCount = 0; // Optional
+	pipelineLayoutInfo.pPushConstantRanges = nullptr; // Optional
+
+	if (vkCreatePipelineLayout(_renderer->GetVulkanDevice(), &pipelineLayoutInfo, nullptr, &_pipelineLayout) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create pipeline layout!");
+	}
+}
+
+void SharedResources::_DeInitDescriptorSetLayout()
+{
+	vkDestroyPipelineLayout(_renderer->GetVulkanDevice(), _pipelineLayout, nullptr);
+	vkDestroyDescriptorSetLayout(_renderer->GetVulkanDevice(), _bindlessDescriptorSetLayout, nullptr);
+	vkDestroyDescriptorSetLayout(_renderer->GetVulkanDevice(), _descriptorSetLayout, nullptr);
+}
+
+void SharedResources::_InitBindlessDescriptorSets()
+{
+	std::array<VkDescriptorPoolSize, 2> poolSizes = {};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+	poolSizes[0].descriptorCount = _bindlessTextureCapacity * _framesInFlight;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_SAMPLER;
+	poolSizes[1].descriptorCount = _framesInFlight;
+
+	VkDescriptorPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.flags = _renderer->SupportsDescriptorIndexing() ? VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT : 0;
+	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolInfo.pPoolSizes = poolSizes.data();
+	poolInfo.maxSets = _framesInFlight;
+
+	ErrorCheck(vkCreateDescriptorPool(_renderer->GetVulkanDevice(), &poolInfo, nullptr, &_bindlessDescriptorPool));
+
+	std::vector<VkDescriptorSetLayout> layouts(_framesInFlight, _bindlessDescriptorSetLayout);
+	VkDescriptorSetAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = _bindlessDescriptorPool;
+	allocInfo.descriptorSetCount = _framesInFlight;
+	allocInfo.pSetLayouts = layouts.data();
+
+	_bindlessDescriptorSets.resize(_framesInFlight);
+	ErrorCheck(vkAllocateDescriptorSets(_renderer->GetVulkanDevice(), &allocInfo, _bindlessDescriptorSets.data()));
+	_bindlessDescriptorSetTextureVersions.assign(_framesInFlight, UINT64_MAX);
+
+	// Sets are rewritten at the start of their frame, until then each only needs to be valid
+	for (uint32_t frame = 0; frame < _framesInFlight; frame++)
+	{
+		_UpdateBindlessDescriptorSet(frame);
+	}
+}
+
+void SharedResources::_DeInitBindlessDescriptorSets()
+{
+	// Frees the sets along with the pool
+	vkDestroyDescriptorPool(_renderer->GetVulkanDevice(), _bindlessDescriptorPool, nullptr);
+	_bindlessDescriptorSets.clear();
+	_bindlessDescriptorSetTextureVersions.clear();
+}
+
+void SharedResources::_UpdateBindlessDescriptorSet(uint32_t frame)
+{
+	if (_bindlessDescriptorSetTextureVersions[frame] == _textureVersion)
+	{
+		return;
+	}
+	_bindlessDescriptorSetTextureVersions[frame] = _textureVersion;
+
+	// The placeholder fills the slots until their texture is resident, and every slot no texture was loaded into so
+	// that any material below the capacity samples something valid
+	uint32_t slotCount = _bindlessTextureCapacity;
+	std::vector<VkDescriptorImageInfo> imageInfos(slotCount);
+	for (uint32_t slot = 0; slot < slotCount; slot++)
+	{
+		VkImageView textureView = slot < _textures.size() && _textures[slot] != UINT32_MAX ? _textureStreamer->GetView(_textures[slot]) : VK_NULL_HANDLE;
+		imageInfos[slot].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		imageInfos[slot].imageView = textureView != VK_NULL_HANDLE ? textureView : _placeholderImageView;
+	}
+
+	VkDescriptorImageInfo samplerInfo = {};
+	samplerInfo.sampler = _textureSampler;
+
+	std::array<VkWriteDescriptorSet, 2> descriptorWrites = {};
+	descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrites[0].dstSet = _bindlessDescriptorSets[frame];
+	descriptorWrites[0].dstBinding = 0;
+	descriptorWrites[0].dstArrayElement = 0;
+	descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+	descriptorWrites[0].descriptorCount = slotCount;
+	descriptorWrites[0].pImageInfo = imageInfos.data();
+
+	descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrites[1].dstSet = _bindlessDescriptorSets[frame];
+	descriptorWrites[1].dstBinding = 1;
+	descriptorWrites[1].dstArrayElement = 0;
+	descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+	descriptorWrites[1].descriptorCount = 1;
+	descriptorWrites[1].pImageInfo = &samplerInfo;
+
+	vkUpdateDescriptorSets(_renderer->GetVulkanDevice(), static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+}
+
+void SharedResources::_InitShaderModules()
+{
+	_vertShaderModule = _CreateShaderModule(readFile("shaders/vert.spv"));
+	// shader.frag compiled with DESCRIPTOR_INDEXING indexes the texture array with the instance's material
+	_fragShaderModule = _CreateShaderModule(readFile(_renderer->SupportsDescriptorIndexing() ? "shaders/frag_bindless.spv" : "shaders/frag.spv"));
+}
+
+void SharedResources::_DeInitShaderModules()
+{
+	vkDestroyShaderModule(_renderer->GetVulkanDevice(), _fragShaderModule, nullptr);
+	vkDestroyShaderModule(_renderer->GetVulkanDevice(), _vertShaderModule, nullptr);
+}
+
+VkRenderPass SharedResources::GetRenderPass(VkFormat colorFormat, bool presentable)
+{
+	for (const auto &pass : _renderPasses)
+	{
+		if (pass.colorFormat == colorFormat && pass.presentable == presentable)
+		{
+			return pass.renderPass;
+		}
+	}
+
+	std::array<VkAttachmentDescription, 3> attachments{};
+	attachments[0].flags = 0;
+	attachments[0].format = colorFormat;
+	attachments[0].samples = _renderer->GetMaxSampleCount();
+	attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	attachments[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	attachments[0].finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	attachments[1].flags = 0;
+	attachments[1].format = _depthStencilFormat;
+	attachments[1].samples = _renderer->GetMaxSampleCount();
+	attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	attachments[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	attachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	attachments[1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	VkAttachmentReference subPass0DepthStencilAttachment{};
+	subPass0DepthStencilAttachment.attachment = 1;
+	subPass0DepthStencilAttachment.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	std::array<VkAttachmentReference, 1> subPass0ColorAttachments{};
+	subPass0ColorAttachments[0].attachment = 0;
+	subPass0ColorAttachments[0].layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+	VkAttachmentDescription colorAttachmentResolve = {};
+	colorAttachmentResolve.format = colorFormat;
+	colorAttachmentResolve.samples = VK_SAMPLE_COUNT_1_BIT;
+	colorAttachmentResolve.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	colorAttachmentResolve.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	colorAttachmentResolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	colorAttachmentResolve.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	colorAttachmentResolve.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	colorAttachmentResolve.finalLayout = presentable ? VK_IMAGE_LAYOUT_PRESENT_SRC_KHR : VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+	attachments[2] = colorAttachmentResolve;
+
+	VkAttachmentReference colorAttachmentResolveRef = {};
+	colorAttachmentResolveRef.attachment = 2;
+	colorAttachmentResolveRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+	std::array<VkSubpassDescription, 1> subPasses{};
+	subPasses[0].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subPasses[0].colorAttachmentCount = subPass0ColorAttachments.size();
+	subPasses[0].pColorAttachments = subPass0ColorAttachments.data();	
+	subPasses[0].pDepthStencilAttachment = &subPass0DepthStencilAttachment;
+	subPasses[0].pResolveAttachments = &colorAttachmentResolveRef;
+
+	VkSubpassDependency dependency = {};
+	dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+	dependency.dstSubpass = 0;
+	dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependency.srcAccessMask = 0;
+	dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+	VkRenderPassCreateInfo renderPassCreateInfo{};
+	renderPassCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	renderPassCreateInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+	renderPassCreateInfo.pAttachments = attachments.data();
+	renderPassCreateInfo.subpassCount = subPasses.size();
+	renderPassCreateInfo.pSubpasses = subPasses.data();
+	renderPassCreateInfo.dependencyCount = 1;
+	renderPassCreateInfo.pDependencies = &dependency;
+
+	RenderPassPipeline pass;
+	pass.colorFormat = colorFormat;
+	pass.presentable = presentable;
+	ErrorCheck(vkCreateRenderPass(_renderer->GetVulkanDevice(), &renderPassCreateInfo, nullptr, &pass.renderPass));
+	pass.graphicsPipeline = _CreateGraphicsPipeline(pass.renderPass);
+	_renderPasses.push_back(pass);
+	return pass.renderPass;
+}
+
+VkPipeline SharedResources::GetGraphicsPipeline(VkRenderPass renderPass) const
+{
+	for (const auto &pass : _renderPasses)
+	{
+		if (pass.renderPass == renderPass)
+		{
+			return pass.graphicsPipeline;
+		}
+	}
+	return VK_NULL_HANDLE;
+}
+
+void SharedResources::_DeInitRenderPasses()
+{
+	for (auto &pass : _renderPasses)
+	{
+		vkDestroyPipeline(_renderer->GetVulkanDevice(), pass.graphicsPipeline, nullptr);
+		vkDestroyRenderPass(_renderer->GetVulkanDevice(), pass.renderPass, nullptr);
+	}
+	_renderPasses.clear();
+}
+
+VkPipeline SharedResources::_CreateGraphicsPipeline(VkRenderPass renderPass)
+{
+	VkPipelineShaderStageCreateInfo vertShaderStageInfo = {};
+	vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
+	vertShaderStageInfo.module = _vertShaderModule;
+	vertShaderStageInfo.pName = "main";
+
+	VkPipelineShaderStageCreateInfo fragShaderStageInfo = {};
+	fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+	fragShaderStageInfo.module = _fragShaderModule;
+	fragShaderStageInfo.pName = "main";
+
+	VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
+
+	std::array<VkVertexInputBindingDescription, 2> bindingDescriptions = { Vertex::getBindingDescription(_vertexLayout), InstanceData::getBindingDescription() };
+	std::vector<VkVertexInputAttributeDescription> attributeDescriptions = Vertex::getAttributeDescriptions(_vertexLayout);
+	auto instanceAttributeDescriptions = InstanceData::getAttributeDescriptions();
+	attributeDescriptions.insert(attributeDescriptions.end(), instanceAttributeDescriptions.begin(), instanceAttributeDescriptions.end());
+
+	VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
+	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+	vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(bindingDescriptions.size());
+	vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
+	vertexInputInfo.pVertexBindingDescriptions = bindingDescriptions.data();
+	vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+
+	VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
+	inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+	// Viewport and scissor are set while recording so the pipeline survives swapchain resizes
+	VkPipelineViewportStateCreateInfo viewportState = {};
+	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewportState.viewportCount = 1;
+	viewportState.scissorCount = 1;
+
+	VkPipelineRasterizationStateCreateInfo rasterizer = {};
+	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterizer.depthClampEnable = VK_FALSE;
+	rasterizer.rasterizerDiscardEnable = VK_FALSE;
+	rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+	rasterizer.lineWidth = 1.0f;
+	rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
+	rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	rasterizer.depthBiasEnable = VK_FALSE;
+
+	VkPipelineMultisampleStateCreateInfo multisampling = {};
+	multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	multisampling.sampleShadingEnable = VK_TRUE; // enable sample shading in the pipeline
+	multisampling.minSampleShading = .2f; // min fraction for sample shading; closer to one is smoother
+	multisampling.rasterizationSamples = _renderer->GetMaxSampleCount();
+
+	VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
+	colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	colorBlendAttachment.blendEnable = VK_FALSE;
+
+	VkPipelineColorBlendStateCreateInfo colorBlending = {};
+	colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	colorBlending.logicOpEnable = VK_FALSE;
+	colorBlending.attachmentCount = 1;
+	colorBlending.pAttachments = &colorBlendAttachment;
+
+	VkDynamicState dynamicStates[] = {
+	VK_DYNAMIC_STATE_VIEWPORT,
+	VK_DYNAMIC_STATE_SCISSOR
+	};
+
+	VkPipelineDynamicStateCreateInfo dynamicState = {};
+	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicState.dynamicStateCount = 2;
+	dynamicState.pDynamicStates = dynamicStates;
+
+	VkPipelineDepthStencilStateCreateInfo pipelineDepthStencilInfo{};
+	pipelineDepthStencilInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	pipelineDepthStencilInfo.depthTestEnable = VK_TRUE;
+	pipelineDepthStencilInfo.depthWriteEnable = VK_TRUE;
+	pipelineDepthStencilInfo.depthCompareOp = VK_COMPARE_OP_LESS;
+	pipelineDepthStencilInfo.depthBoundsTestEnable = VK_FALSE;
+	pipelineDepthStencilInfo.minDepthBounds = 0.0f; // Optional
+	pipelineDepthStencilInfo.maxDepthBounds = 1.0f; // Optional
+	pipelineDepthStencilInfo.stencilTestEnable = VK_FALSE;
+	pipelineDepthStencilInfo.front = {}; // Optional
+	pipelineDepthStencilInfo.back = {}; // Optional
+
+	VkGraphicsPipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipelineInfo.stageCount = 2;
+	pipelineInfo.pStages = shaderStages;
+	pipelineInfo.pVertexInputState = &vertexInputInfo;
+	pipelineInfo.pInputAssemblyState = &inputAssembly;
+	pipelineInfo.pViewportState = &viewportState;
+	pipelineInfo.pRasterizationState = &rasterizer;
+	pipelineInfo.pMultisampleState = &multisampling;
+	pipelineInfo.pDepthStencilState = nullptr; // Optional
+	pipelineInfo.pColorBlendState = &colorBlending;
+	pipelineInfo.pDynamicState = &dynamicState;
+	pipelineInfo.layout = _pipelineLayout;
+	pipelineInfo.renderPass = renderPass;
+	pipelineInfo.subpass = 0;
+	pipelineInfo.pDepthStencilState = &pipelineDepthStencilInfo;
+
+	VkPipeline graphicsPipeline;
+	if (vkCreateGraphicsPipelines(_renderer->GetVulkanDevice(), _renderer->GetVulkanPipelineCache(), 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create graphics pipeline!");
+	}
+	return graphicsPipeline;
+}
+
+void SharedResources::_InitCullPipelineLayout()
+{
+	// Windows allocate their culling descriptor sets from this layout whether or not GPU culling is on
+	std::array<VkDescriptorSetLayoutBinding, 6> bindings = {};
+	for (uint32_t i = 0; i < bindings.size(); i++)
+	{
+		bindings[i].binding = i;
+		bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings = bindings.data();
+
+	ErrorCheck(vkCreateDescriptorSetLayout(_renderer->GetVulkanDevice(), &layoutInfo, nullptr, &_cullDescriptorSetLayout));
+
+	VkPushConstantRange pushConstantRange = {};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(GpuCullConstants);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &_cullDescriptorSetLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+	ErrorCheck(vkCreatePipelineLayout(_renderer->GetVulkanDevice(), &pipelineLayoutInfo, nullptr, &_cullPipelineLayout));
+}
+
+void SharedResources::_DeInitCullPipelineLayout()
+{
+	vkDestroyPipelineLayout(_renderer->GetVulkanDevice(), _cullPipelineLayout, nullptr);
+	vkDestroyDescriptorSetLayout(_renderer->GetVulkanDevice(), _cullDescriptorSetLayout, nullptr);
+}
+
+void SharedResources::_InitCullPipelines()
+{
+	_cullShaderModule = _CreateShaderModule(readFile("shaders/cull.spv"));
+
+	// Both passes come from the same shader, specialised on the pass
+	struct CullSpecialization
+	{
+		float lodPixelError;
+		uint32_t pass;
+		VkBool32 compactDraws;
+	} specialization = { LOD_PIXEL_ERROR, 0, _renderer->GetCmdDrawIndexedIndirectCount() != nullptr };
+
+	std::array<VkSpecializationMapEntry, 3> specializationEntries = {};
+	specializationEntries[0] = { 0, offsetof(CullSpecialization, lodPixelError), sizeof(float) };
+	specializationEntries[1] = { 1, offsetof(CullSpecialization, pass), sizeof(uint32_t) };
+	specializationEntries[2] = { 2, offsetof(CullSpecialization, compactDraws), sizeof(VkBool32) };
+
+	VkSpecializationInfo specializationInfo = {};
+	specializationInfo.mapEntryCount = static_cast<uint32_t>(specializationEntries.size());
+	specializationInfo.pMapEntries = specializationEntries.data();
+	specializationInfo.dataSize = sizeof(specialization);
+	specializationInfo.pData = &specialization;
+
+	for (uint32_t pass = 0; pass < _cullPipelines.size(); pass++)
+	{
+		specialization.pass = pass;
+
+		VkComputePipelineCreateInfo pipelineInfo = {};
+		pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		pipelineInfo.stage.module = _cullShaderModule;
+		pipelineInfo.stage.pName = "main";
+		pipelineInfo.stage.pSpecializationInfo = &specializationInfo;
+		pipelineInfo.layout = _cullPipelineLayout;
+
+		if (vkCreateComputePipelines(_renderer->GetVulkanDevice(), _renderer->GetVulkanPipelineCache(), 1, &pipelineInfo, nullptr, &_cullPipelines[pass]) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create culling pipeline!");
+		}
+	}
+}
+
+void SharedResources::_DeInitCullPipelines()
+{
+	for (auto &pipeline : _cullPipelines)
+	{
+		vkDestroyPipeline(_renderer->GetVulkanDevice(), pipeline, nullptr);
+	}
+	vkDestroyShaderModule(_renderer->GetVulkanDevice(), _cullShaderModule, nullptr);
+}
+
+void SharedResources::_InitCullBuffers()
+{
+	const std::vector<Mesh>& meshes = _scene.GetMeshes();
+	uint32_t instanceCount = _scene.GetInstanceCount();
+	_drawTemplateCount16 = 0;
+	_drawTemplateCount = 0;
+	if (instanceCount == 0 || _submeshDraws.empty())
+	{
+		return;
+	}
+
+	// Any instance of a mesh may pick any of its LODs, so every (mesh, LOD) group has room for all of them
+	std::vector<uint32_t> meshInstanceCounts(meshes.size(), 0);
+	for (InstanceHandle instance = 0; instance < instanceCount; instance++)
+	{
+		meshInstanceCounts[_scene.GetInstanceMesh(instance)]++;
+	}
+	std::vector<GpuMesh> gpuMeshes(meshes.size());
+	uint32_t visibleInstanceCapacity = 0;
+	for (MeshHandle mesh = 0; mesh < meshes.size(); mesh++)
+	{
+		const Mesh& range = meshes[mesh];
+		GpuMesh& gpuMesh = gpuMeshes[mesh];
+		gpuMesh.dequantization = mesh < _meshDequantizations.size() ? _meshDequantizations[mesh] : glm::mat4(1.0f);
+		gpuMesh.boundingSphere = glm::vec4((range.boundsMin + range.boundsMax) * 0.5f, glm::length(range.boundsMax - range.boundsMin) * 0.5f);
+		memcpy(gpuMesh.lodErrors, range.lodErrors, sizeof(gpuMesh.lodErrors));
+		// Meshes whose geometry hasn't arrived yet are skipped by the cull pass
+		bool drawable = range.indexCount > 0 && mesh + 1 < _meshFirstSubmeshDraw.size();
+		gpuMesh.lodCount = drawable ? range.lodCount : 0;
+		gpuMesh.firstGroup = mesh * MAX_MESH_LODS;
+		gpuMesh.firstOutputInstance = visibleInstanceCapacity;
+		gpuMesh.instanceCount = meshInstanceCounts[mesh];
+		visibleInstanceCapacity += gpuMesh.lodCount * gpuMesh.instanceCount;
+	}
+
+	// The 16 bit index draws come first, then the 32 bit ones
+	std::vector<GpuDrawTemplate> drawTemplates;
+	for (VkIndexType indexType : { VK_INDEX_TYPE_UINT16, VK_INDEX_TYPE_UINT32 })
+	{
+		for (MeshHandle mesh = 0; mesh < meshes.size(); mesh++)
+		{
+			const GpuMesh& gpuMesh = gpuMeshes[mesh];
+			if (gpuMesh.instanceCount == 0)
+			{
+				continue;
+			}
+			for (uint32_t lod = 0; lod < gpuMesh.lodCount; lod++)
+			{
+				uint32_t firstSubmeshDraw = _meshFirstSubmeshDraw[mesh] + lod * meshes[mesh].submeshCount;
+				for (uint32_t s = firstSubmeshDraw; s < firstSubmeshDraw + meshes[mesh].submeshCount; s++)
+				{
+					const SubmeshDraw& draw = _submeshDraws[s];
+					if (draw.indexType != indexType)
+					{
+						continue;
+					}
+					drawTemplates.push_back({ draw.indexCount, draw.firstIndex, draw.vertexOffset, gpuMesh.firstGroup + lod, gpuMesh.firstOutputInstance + lod * gpuMesh.instanceCount });
+				}
+			}
+		}
+		if (indexType == VK_INDEX_TYPE_UINT16)
+		{
+			_drawTemplateCount16 = static_cast<uint32_t>(drawTemplates.size());
+		}
+	}
+	_drawTemplateCount = static_cast<uint32_t>(drawTemplates.size());
+	if (_drawTemplateCount == 0)
+	{
+		return;
+	}
+
+	_visibleInstanceCapacity = visibleInstanceCapacity;
+	_cullGroupCount = static_cast<uint32_t>(meshes.size()) * MAX_MESH_LODS;
+
+	VkDeviceSize alignment = _renderer->GetVulkanPhysicalDeviceProperties().limits.minStorageBufferOffsetAlignment;
+	_gpuInstanceSegmentSize = (sizeof(GpuInstance) * instanceCount + alignment - 1) / alignment * alignment;
+
+	CreateBuffer(_gpuInstanceSegmentSize * _framesInFlight, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, _gpuInstanceBuffer, _gpuInstanceBufferMemory);
+	CreateBuffer(sizeof(GpuMesh) * gpuMeshes.size(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _gpuMeshBuffer, _gpuMeshBufferMemory);
+	CreateBuffer(sizeof(GpuDrawTemplate) * drawTemplates.size(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _drawTemplateBuffer, _drawTemplateBufferMemory);
+
+	_renderer->GetUploader()->UploadBuffer(_gpuMeshBuffer, gpuMeshes.data(), sizeof(GpuMesh) * gpuMeshes.size(), 0, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+	_assetUploadTicket = _renderer->GetUploader()->UploadBuffer(_drawTemplateBuffer, drawTemplates.data(), sizeof(GpuDrawTemplate) * drawTemplates.size(), 0, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+	_renderer->GetUploader()->Flush();
+}
+
+void SharedResources::_DeInitCullBuffers()
+{
+	std::array<std::pair<VkBuffer*, Allocation*>, 3> buffers = { {
+		{ &_gpuInstanceBuffer, &_gpuInstanceBufferMemory },
+		{ &_gpuMeshBuffer, &_gpuMeshBufferMemory },
+		{ &_drawTemplateBuffer, &_drawTemplateBufferMemory },
+	} };
+	for (auto &buffer : buffers)
+	{
+		if (*buffer.first == VK_NULL_HANDLE)
+		{
+			continue;
+		}
+		DestroyBufferDeferred(*buffer.first, *buffer.second);
+	}
+	_drawTemplateCount16 = 0;
+	_drawTemplateCount = 0;
+	_visibleInstanceCapacity = 0;
+	_cullGroupCount = 0;
+}
+
+void SharedResources::_RebuildCullBuffers()
+{
+	// Windows rebuild the buffers sized by these ones when the version changes
+	_DeInitCullBuffers();
+	if (_gpuCulling)
+	{
+		_InitCullBuffers();
+	}
+	_cullBufferVersion++;
+}
+
+Scene * SharedResources::GetScene()
+{
+	return &_scene;
+}
+
+void SharedResources::SetTextureBudget(VkDeviceSize budget)
+{
+	_textureStreamer->SetBudget(budget);
+}
+
+void SharedResources::SetVertexLayout(const VertexLayout & layout)
+{
+	// The pipelines and the packed vertex buffer both depend on the layout, the old ones are retired
+	_renderer->GetUploader()->Wait(_assetUploadTicket);
+	_vertexLayout = layout;
+	VkDevice device = _renderer->GetVulkanDevice();
+	for (auto &pass : _renderPasses)
+	{
+		VkPipeline pipeline = pass.graphicsPipeline;
+		_renderer->DestroyDeferred([device, pipeline]()
+		{
+			vkDestroyPipeline(device, pipeline, nullptr);
+		});
+		pass.graphicsPipeline = _CreateGraphicsPipeline(pass.renderPass);
+	}
+	_DeInitVertexBuffers();
+	_InitVertexBuffers();
+	// The GPU culling mesh data holds the dequantisation
+	_RebuildCullBuffers();
+	_renderer->GetUploader()->Flush();
+}
+
+void SharedResources::SetGpuCulling(bool enable)
+{
+	if (enable && !_renderer->GetEnabledFeatures().drawIndirectFirstInstance)
+	{
+		std::cout << "GPU culling needs drawIndirectFirstInstance, culling on the CPU" << std::endl;
+		enable = false;
+	}
+	// The pipelines are only built the first time culling moves to the GPU, and kept after
+	if (enable && _cullShaderModule == VK_NULL_HANDLE)
+	{
+		_InitCullPipelines();
+	}
+	_renderer->GetUploader()->Wait(_assetUploadTicket);
+	_gpuCulling = enable;
+	_RebuildCullBuffers();
+}
+
+bool SharedResources::GetGpuCulling() const
+{
+	return _gpuCulling;
+}
+
+const std::vector<MeshOptimizationStats>& SharedResources::GetMeshOptimizationStats() const
+{
+	return _meshOptimizationStats;
+}
+
+void SharedResources::_SyncScene()
+{
+	bool geometryChanged = _scene.GetGeometryVersion() != _sceneGeometryVersion;
+	bool layoutChanged = _scene.GetLayoutVersion() != _sceneLayoutVersion;
+	if (!geometryChanged && !layoutChanged)
+	{
+		return;
+	}
+
+	// Frames still in flight read the old vertex and index buffers, they are only retired here.
+	// Uploads into them can't be retired with a frame, so those are finished first
+	_renderer->GetUploader()->Wait(_assetUploadTicket);
+	if (geometryChanged)
+	{
+		_DeInitIndexBuffers();
+		_DeInitVertexBuffers();
+		_InitVertexBuffers();
+		_InitIndexBuffers();
+		_sceneGeometryVersion = _scene.GetGeometryVersion();
+	}
+	_RebuildCullBuffers();
+	_sceneLayoutVersion = _scene.GetLayoutVersion();
+}
+
+void SharedResources::_InitTextureImage()
+{
+	// A 1x1 white texture is bound until the real one has been decoded and uploaded
+	const uint32_t white = 0xffffffff;
+	CreateImage(1, 1, 1, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _placeholderImage, _placeholderImageMemory);
+	_assetUploadTicket = _renderer->GetUploader()->UploadImage(_placeholderImage, VK_FORMAT_R8G8B8A8_UNORM, &white, sizeof(white), 1, 1, 1);
+	_renderer->GetUploader()->Flush();
+	_placeholderImageView = CreateImageView(_placeholderImage, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+
+	_textureStreamer = new TextureStreamer(_renderer, DEFAULT_TEXTURE_BUDGET);
+
+	LoadTexture(TEXTURE_PATH);
+}
+
+void SharedResources::_DeInitTextureImage()
+{
+	delete _textureStreamer;
+	_textureStreamer = nullptr;
+	vkDestroyImageView(_renderer->GetVulkanDevice(), _placeholderImageView, nullptr);
+	vkDestroyImage(_renderer->GetVulkanDevice(), _placeholderImage, nullptr);
+	_renderer->GetMemoryAllocator()->Free(_placeholderImageMemory);
+}
+
+void SharedResources::_UpdateTextureStreaming(float maxPixels)
+{
+	// Assuming a texture covers each mesh about once, the largest instance on screen decides the mip needed
+	for (StreamedTextureHandle texture : _textures)
+	{
+		if (texture == UINT32_MAX)
+		{
+			continue;
+		}
+
+		uint32_t lastMip = _textureStreamer->GetMipLevels(texture) - 1;
+		uint32_t baseMip = lastMip;
+		if (maxPixels >= 1.0f)
+		{
+			float mip = std::floor(std::log2(_textureStreamer->GetWidth(texture) / maxPixels));
+			baseMip = static_cast<uint32_t>(glm::clamp(mip, 0.0f, static_cast<float>(lastMip)));
+		}
+		_textureStreamer->RequestMip(texture, baseMip);
+	}
+
+	FrameScheduler* frameScheduler = _renderer->GetFrameScheduler();
+	if (_textureStreamer->Update(frameScheduler->GetFrameValue(), frameScheduler->GetCompletedValue()))
+	{
+		_textureVersion++;
+	}
+}
+
+uint32_t SharedResources::LoadTexture(const std::string & path)
+{
+	uint32_t slot = static_cast<uint32_t>(_textures.size());
+	if (slot >= _bindlessTextureCapacity)
+	{
+		if (_renderer->SupportsDescriptorIndexing())
+		{
+			throw std::runtime_error("bindless texture array is full!");
+		}
+		if (slot == 1)
+		{
+			std::cout << "Descriptor indexing is not supported, every material is drawn with the first texture" << std::endl;
+		}
+	}
+	_textures.push_back(UINT32_MAX);
+
+	VkPhysicalDevice gpu = _renderer->GetVulkanPhysicalDevice();
+	_renderer->GetJobSystem()->Submit([this, gpu, path, slot](uint32_t /*worker*/)
+	{
+		try
+		{
+			auto texture = std::make_shared<TextureSource>(_DecodeTexture(gpu, path));
+			_PushDecodedAsset([this, texture, slot]() { _textures[slot] = _textureStreamer->Add(std::move(*texture)); });
+		}
+		catch (...)
+		{
+			_PushDecodedError(std::current_exception());
+		}
+	});
+
+	// The new slot holds the placeholder from the next frame on
+	_textureVersion++;
+	return slot;
+}
+
+MeshHandle SharedResources::LoadMesh(const std::string & path)
+{
+	// The mesh draws nothing until its geometry has been decoded on a worker thread
+	MeshHandle mesh = _scene.ReserveMesh();
+	JobSystem* jobSystem = _renderer->GetJobSystem();
+	jobSystem->Submit([this, mesh, path, jobSystem](uint32_t /*worker*/)
+	{
+		try
+		{
+			auto decoded = std::make_shared<DecodedMesh>(_DecodeMesh(path, jobSystem));
+			_PushDecodedAsset([this, mesh, decoded]()
+			{
+				_scene.SetMeshGeometry(mesh, decoded->vertices.data(), static_cast<uint32_t>(decoded->vertices.size()), decoded->indices.data(), static_cast<uint32_t>(decoded->indices.size()), decoded->submeshes.data(), static_cast<uint32_t>(decoded->submeshes.size()), decoded->lods, decoded->boundsMin, decoded->boundsMax);
+				if (_meshOptimizationStats.size() <= mesh)
+				{
+					_meshOptimizationStats.resize(mesh + 1);
+				}
+				_meshOptimizationStats[mesh] = decoded->optimizationStats;
+			});
+		}
+		catch (...)
+		{
+			_PushDecodedError(std::current_exception());
+		}
+	});
+	return mesh;
+}
+
+SharedResources::DecodedMesh SharedResources::_DecodeMesh(const std::string & path, JobSystem * jobSystem)
+{
+	DecodedMesh decoded;
+
+	// The binary cache is written the first time a model is parsed and mapped straight in afterwards
+	std::string cachePath = MeshCacheFile::GetCachePath(path);
+	MeshCacheFile cache;
+	if (cache.Open(cachePath, path))
+	{
+		const MeshCacheHeader& header = cache.GetHeader();
+		decoded.vertices.assign(cache.GetVertices(), cache.GetVertices() + header.vertexCount);
+		decoded.indices.assign(cache.GetIndices(), cache.GetIndices() + header.indexCount);
+		decoded.submeshes.assign(cache.GetSubmeshes(), cache.GetSubmeshes() + header.submeshCount);
+		decoded.lods = header.lods;
+		decoded.boundsMin = header.boundsMin;
+		decoded.boundsMax = header.boundsMax;
+		decoded.optimizationStats = header.optimizationStats;
+		return decoded;
+	}
+
+	tinyobj::attrib_t attrib;
+	std::vector<tinyobj::shape_t> shapes;
+	std::vector<tinyobj::material_t> materials;
+	std::string warn, err;
+
+	if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, path.c_str())) {
+		throw std::runtime_error(warn + err);
+	}
+
+	BuildObjMesh(attrib, shapes, jobSystem, decoded.vertices, decoded.indices);
+	decoded.optimizationStats = OptimizeMesh(decoded.vertices, decoded.indices);
+	std::cout << path << ": ACMR " << decoded.optimizationStats.before.acmr << " -> " << decoded.optimizationStats.after.acmr
+		<< ", ATVR " << decoded.optimizationStats.before.atvr << " -> " << decoded.optimizationStats.after.atvr << std::endl;
+	decoded.submeshes = SplitSubmeshes(decoded.vertices, decoded.indices);
+	decoded.lods = BuildMeshLods(decoded.vertices, decoded.indices, decoded.submeshes, jobSystem);
+	MeshCacheFile::Write(cachePath, path, decoded.vertices, decoded.indices, decoded.submeshes, decoded.lods, decoded.optimizationStats);
+
+	decoded.boundsMin = decoded.vertices.empty() ? glm::vec3(0.0f) : decoded.vertices[0].pos;
+	decoded.boundsMax = decoded.boundsMin;
+	for (const auto& vertex : decoded.vertices)
+	{
+		decoded.boundsMin = glm::min(decoded.boundsMin, vertex.pos);
+		decoded.boundsMax = glm::max(decoded.boundsMax, vertex.pos);
+	}
+	return decoded;
+}
+
+void SharedResources::_PushDecodedAsset(std::function<void()> finish)
+{
+	std::lock_guard<std::mutex> lock(_decodedAssetsMutex);
+	_decodedAssets.push_back(std::move(finish));
+}
+
+void SharedResources::_PushDecodedError(std::exception_ptr error)
+{
+	// Rethrown on the render thread, a throw on a worker would terminate the process
+	_PushDecodedAsset([error]() { std::rethrow_exception(error); });
+}
+
+void SharedResources::_ProcessDecodedAssets()
+{
+	std::vector<std::function<void()>> decodedAssets;
+	{
+		std::lock_guard<std::mutex> lock(_decodedAssetsMutex);
+		decodedAssets.swap(_decodedAssets);
+	}
+	for (auto &finish : decodedAssets)
+	{
+		finish();
+	}
+}
+
+TextureSource SharedResources::_DecodeTexture(VkPhysicalDevice gpu, const std::string & path)
+{
+	TextureSource source;
+
+	// Precomputed, block compressed mip chains are preferred, the JPEG with mips built on the CPU is the fallback
+	std::string basePath = path.substr(0, path.find_last_of('.'));
+	const char* candidates[] = { ".bc7.ktx2", ".bc3.ktx2", ".bc1.ktx2", ".ktx2" };
+	for (auto candidate : candidates)
+	{
+		if (!LoadKtx2(basePath + candidate, source))
+		{
+			continue;
+		}
+
+		VkFormatProperties formatProperties;
+		vkGetPhysicalDeviceFormatProperties(gpu, source.format, &formatProperties);
+		VkFormatFeatureFlags requiredFeatures = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+		if ((formatProperties.optimalTilingFeatures & requiredFeatures) == requiredFeatures)
+		{
+			return source;
+		}
+	}
+
+	int texWidth, texHeight, texChannels;
+	stbi_uc* pixels = stbi_load(path.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+
+	if (!pixels) {
+		throw std::runtime_error("failed to load texture image!");
+	}
+
+	// Streaming uploads any sub-chain straight from the CPU copy, so the mips are built here rather than blitted
+	BuildMipChainRGBA8(pixels, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), source);
+	stbi_image_free(pixels);
+	return source;
+}
+
+void SharedResources::_InitTextureSampler()
+{
+	VkSamplerCreateInfo samplerInfo = {};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_LINEAR;
+	samplerInfo.minFilter = VK_FILTER_LINEAR;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	samplerInfo.anisotropyEnable = VK_TRUE;
+	samplerInfo.maxAnisotropy = 16;
+	samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+	samplerInfo.unnormalizedCoordinates = VK_FALSE;
+	samplerInfo.compareEnable = VK_FALSE;
+	samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+	samplerInfo.mipLodBias = 0.0f;
+	samplerInfo.minLod = 0.0f;
+	samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+	ErrorCheck(vkCreateSampler(_renderer->GetVulkanDevice(), &samplerInfo, nullptr, &_textureSampler));
+}
+
+void SharedResources::_DeInitTextureSampler()
+{
+	vkDestroySampler(_renderer->GetVulkanDevice(), _textureSampler, nullptr);
+}
+
+void SharedResources::_InitVertexBuffers()
+{
+	const std::vector<Vertex>& vertices = _scene.GetVertices();
+	const std::vector<Mesh>& meshes = _scene.GetMeshes();
+	_meshDequantizations.assign(meshes.size(), glm::mat4(1.0f));
+	if (vertices.empty())
+	{
+		return;
+	}
+
+	// Each mesh is quantised against its own bounds, the instance transforms undo it
+	uint32_t stride = _vertexLayout.GetStride();
+	std::vector<char> packed(size_t(stride) * vertices.size());
+	bool inRange = true;
+	for (MeshHandle mesh = 0; mesh < meshes.size(); mesh++)
+	{
+		if (meshes[mesh].indexCount == 0)
+		{
+			continue;
+		}
+		const Mesh& range = meshes[mesh];
+		inRange &= _vertexLayout.Pack(vertices.data() + range.vertexOffset, range.vertexCount, range.boundsMin, range.boundsMax, packed.data() + size_t(stride) * range.vertexOffset);
+		_meshDequantizations[mesh] = _vertexLayout.GetDequantization(range.boundsMin, range.boundsMax);
+	}
+	if (!inRange)
+	{
+		std::cout << "Texture coordinates outside [0, 1] were clamped by the vertex layout" << std::endl;
+	}
+
+	VkDeviceSize bufferSize = packed.size();
+	CreateBuffer(bufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _vertexBuffer, _vertexBufferMemory);
+
+	_assetUploadTicket = _renderer->GetUploader()->UploadBuffer(_vertexBuffer, packed.data(), bufferSize, 0, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+}
+
+void SharedResources::_DeInitVertexBuffers()
+{
+	DestroyBufferDeferred(_vertexBuffer, _vertexBufferMemory);
+}
+
+void SharedResources::_InitIndexBuffers()
+{
+	const std::vector<uint32_t>& indices = _scene.GetIndices();
+	const std::vector<Mesh>& meshes = _scene.GetMeshes();
+	_submeshDraws.clear();
+	_meshFirstSubmeshDraw.assign(meshes.size() + 1, 0);
+	if (indices.empty())
+	{
+		return;
+	}
+
+	// Submeshes are small enough for 16 bit indices, those at the start of the buffer. A submesh that isn't, from a
+	// caller with a larger split limit, keeps 32 bit indices which follow at _indexBuffer32Offset
+	const std::vector<Submesh>& submeshes = _scene.GetSubmeshes();
+	std::vector<uint16_t> indices16;
+	std::vector<uint32_t> indices32;
+	for (MeshHandle mesh = 0; mesh < meshes.size(); mesh++)
+	{
+		const Mesh& range = meshes[mesh];
+		for (uint32_t s = range.firstSubmesh; s < range.firstSubmesh + range.submeshCount * range.lodCount; s++)
+		{
+			const Submesh& submesh = submeshes[s];
+			const uint32_t* submeshIndices = indices.data() + range.firstIndex + submesh.firstIndex;
+			SubmeshDraw draw;
+			draw.indexCount = submesh.indexCount;
+			draw.vertexOffset = range.vertexOffset + static_cast<int32_t>(submesh.baseVertex);
+			if (submesh.vertexCount <= MAX_SUBMESH_VERTICES)
+			{
+				draw.firstIndex = static_cast<uint32_t>(indices16.size());
+				draw.indexType = VK_INDEX_TYPE_UINT16;
+				for (uint32_t i = 0; i < submesh.indexCount; i++)
+				{
+					indices16.push_back(static_cast<uint16_t>(submeshIndices[i]));
+				}
+			}
+			else
+			{
+				draw.firstIndex = static_cast<uint32_t>(indices32.size());
+				draw.indexType = VK_INDEX_TYPE_UINT32;
+				indices32.insert(indices32.end(), submeshIndices, submeshIndices + submesh.indexCount);
+			}
+			_submeshDraws.push_back(draw);
+		}
+		_meshFirstSubmeshDraw[mesh + 1] = static_cast<uint32_t>(_submeshDraws.size());
+	}
+
+	_indexBuffer32Offset = (sizeof(uint16_t) * indices16.size() + sizeof(uint32_t) - 1) / sizeof(uint32_t) * sizeof(uint32_t);
+	std::vector<char> packed(_indexBuffer32Offset + sizeof(uint32_t) * indices32.size());
+	memcpy(packed.data(), indices16.data(), sizeof(uint16_t) * indices16.size());
+	memcpy(packed.data() + _indexBuffer32Offset, indices32.data(), sizeof(uint32_t) * indices32.size());
+
+	VkDeviceSize bufferSize = packed.size();
+	CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _indexBuffer, _indexBufferMemory);
+
+	_assetUploadTicket = _renderer->GetUploader()->UploadBuffer(_indexBuffer, packed.data(), bufferSize, 0, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT);
+	_renderer->GetUploader()->Flush();
+}
+
+void SharedResources::_DeInitIndexBuffers()
+{
+	DestroyBufferDeferred(_indexBuffer, _indexBufferMemory);
+}
+
+
+std::vector<char> SharedResources::readFile(const std::string & filename)
+{
+	std::ifstream file(filename, std::ios::ate | std::ios::binary);
+
+	if (!file.is_open()) {
+		throw std::runtime_error("failed to open file!");
+	}
+
+	size_t fileSize = (size_t)file.tellg();
+	std::vector<char> buffer(fileSize);
+	file.seekg(0);
+	file.read(buffer.data(), fileSize);
+	file.close();
+	return buffer;
+}
+
+VkShaderModule SharedResources::_CreateShaderModule(const std::vector<char>& code)
+{
+	VkShaderModuleCreateInfo createInfo = {};
+	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	createInfo.codeSize = code.size();
+	createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+	VkShaderModule shaderModule;
+	if (vkCreateShaderModule(_renderer->GetVulkanDevice(), &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create shader module!");
+	}
+	return shaderModule;
+}
+
+void SharedResources::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer & buffer, Allocation & bufferMemory)
+{
+	VkBufferCreateInfo bufferInfo = {};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = size;
+	bufferInfo.usage = usage;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	if (vkCreateBuffer(_renderer->GetVulkanDevice(), &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create buffer!");
+	}
+
+	VkMemoryRequirements memRequirements;
+	vkGetBufferMemoryRequirements(_renderer->GetVulkanDevice(), buffer, &memRequirements);
+
+	bufferMemory = _renderer->GetMemoryAllocator()->Allocate(memRequirements, properties, true);
+
+	ErrorCheck(vkBindBufferMemory(_renderer->GetVulkanDevice(), buffer, bufferMemory.memory, bufferMemory.offset));
+}
+
+void SharedResources::DestroyBufferDeferred(VkBuffer & buffer, Allocation & bufferMemory)
+{
+	VkDevice device = _renderer->GetVulkanDevice();
+	MemoryAllocator* allocator = _renderer->GetMemoryAllocator();
+	VkBuffer oldBuffer = buffer;
+	Allocation oldMemory = bufferMemory;
+	_renderer->DestroyDeferred([device, allocator, oldBuffer, oldMemory]() mutable
+	{
+		vkDestroyBuffer(device, oldBuffer, nullptr);
+		allocator->Free(oldMemory);
+	});
+	buffer = VK_NULL_HANDLE;
+	bufferMemory = Allocation();
+}
+
+void SharedResources::DestroyImageDeferred(VkImage & image, VkImageView & imageView, Allocation & imageMemory)
+{
+	VkDevice device = _renderer->GetVulkanDevice();
+	MemoryAllocator* allocator = _renderer->GetMemoryAllocator();
+	VkImage oldImage = image;
+	VkImageView oldImageView = imageView;
+	Allocation oldMemory = imageMemory;
+	_renderer->DestroyDeferred([device, allocator, oldImage, oldImageView, oldMemory]() mutable
+	{
+		vkDestroyImageView(device, oldImageView, nullptr);
+		vkDestroyImage(device, oldImage, nullptr);
+		allocator->Free(oldMemory);
+	});
+	image = VK_NULL_HANDLE;
+	imageView = VK_NULL_HANDLE;
+	imageMemory = Allocation();
+}
+
+void SharedResources::CreateImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkSampleCountFlagBits numSamples, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage & image, Allocation & imageMemory)
+{
+	VkImageCreateInfo imageInfo = {};
+	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.extent.width = width;
+	imageInfo.extent.height = height;
+	imageInfo.extent.depth = 1;
+	imageInfo.mipLevels = mipLevels;
+	imageInfo.arrayLayers = 1;
+	imageInfo.format = format;
+	imageInfo.tiling = tiling;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	imageInfo.usage = usage;
+	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageInfo.samples = numSamples;
+	imageInfo.flags = 0; // Optional
+	ErrorCheck(vkCreateImage(_renderer->GetVulkanDevice(), &imageInfo, nullptr, &image));
+
+	VkMemoryRequirements memRequirements;
+	vkGetImageMemoryRequirements(_renderer->GetVulkanDevice(), image, &memRequirements);
+
+	imageMemory = _renderer->GetMemoryAllocator()->Allocate(memRequirements, properties, tiling == VK_IMAGE_TILING_LINEAR);
+
+	ErrorCheck(vkBindImageMemory(_renderer->GetVulkanDevice(), image, imageMemory.memory, imageMemory.offset));
+
+}
+
+VkCommandBuffer SharedResources::_BeginSingleTimeCommands()
+{
+	VkCommandBufferAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandPool = _commandPool;
+	allocInfo.commandBufferCount = 1;
+
+	VkCommandBuffer commandBuffer;
+	vkAllocateCommandBuffers(_renderer->GetVulkanDevice(), &allocInfo, &commandBuffer);
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+	return commandBuffer;
+}
+
+void SharedResources::_EndSingleTimeCommands(VkCommandBuffer commandBuffer)
+{
+	vkEndCommandBuffer(commandBuffer);
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffer;
+
+	// Wait on a fence for this submission only, vkQueueWaitIdle would also drain frames in flight
+	VkFenceCreateInfo fenceInfo = {};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	VkFence fence;
+	ErrorCheck(vkCreateFence(_renderer->GetVulkanDevice(), &fenceInfo, nullptr, &fence));
+
+	ErrorCheck(vkQueueSubmit(_renderer->GetVulkanQueue(), 1, &submitInfo, fence));
+	ErrorCheck(vkWaitForFences(_renderer->GetVulkanDevice(), 1, &fence, VK_TRUE, UINT64_MAX));
+	vkDestroyFence(_renderer->GetVulkanDevice(), fence, nullptr);
+
+	vkFreeCommandBuffers(_renderer->GetVulkanDevice(), _commandPool, 1, &commandBuffer);
+}
+
+void SharedResources::TransitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels)
+{
+	VkCommandBuffer commandBuffer = _BeginSingleTimeCommands();
+
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.oldLayout = oldLayout;
+	barrier.newLayout = newLayout;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = image;
+	if (newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+
+		if (_HasStencilComponent(format)) {
+			barrier.subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
+		}
+	}
+	else {
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	}
+	barrier.subresourceRange.baseMipLevel = 0;
+	barrier.subresourceRange.levelCount = mipLevels;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+
+	VkPipelineStageFlags sourceStage;
+	VkPipelineStageFlags destinationStage;
+
+	if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+		sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+	}
+	else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+		sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	}
+	else if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+		sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		destinationStage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+	}
+	else if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL) {
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+		sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		destinationStage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	}
+	else {
+		throw std::invalid_argument("unsupported layout transition!");
+	}
+
+	vkCmdPipelineBarrier(
+		commandBuffer,
+		sourceStage, destinationStage,
+		0,
+		0, nullptr,
+		0, nullptr,
+		1, &barrier
+	);
+
+	_EndSingleTimeCommands(commandBuffer);
+}
+
+VkImageView SharedResources::CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels)
+{
+	VkImageViewCreateInfo viewInfo = {};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.image = image;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.format = format;
+	/*viewInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+	viewInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+	viewInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+	viewInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;*/
+	viewInfo.subresourceRange.aspectMask = aspectFlags;
+	viewInfo.subresourceRange.baseMipLevel = 0;
+	viewInfo.subresourceRange.levelCount = mipLevels;
+	viewInfo.subresourceRange.baseArrayLayer = 0;
+	viewInfo.subresourceRange.layerCount = 1;
+
+	VkImageView imageView;
+	ErrorCheck(vkCreateImageView(_renderer->GetVulkanDevice(), &viewInfo, nullptr, &imageView));
+
+	return imageView;
+}
+
+bool SharedResources::_HasStencilComponent(VkFormat format)
+{
+	return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT;
+}
+
+VkPipelineLayout SharedResources::GetPipelineLayout() const
+{
+	return _pipelineLayout;
+}
+
+VkDescriptorSetLayout SharedResources::GetDescriptorSetLayout() const
+{
+	return _descriptorSetLayout;
+}
+
+VkFormat SharedResources::GetDepthStencilFormat() const
+{
+	return _depthStencilFormat;
+}
+
+VkDescriptorSet SharedResources::GetBindlessDescriptorSet() const
+{
+	return _bindlessDescriptorSets[_frameIndex];
+}
+
+uint32_t SharedResources::GetBindlessTextureCapacity() const
+{
+	return _bindlessTextureCapacity;
+}
+
+VkBuffer SharedResources::GetVertexBuffer() const
+{
+	return _vertexBuffer;
+}
+
+VkBuffer SharedResources::GetIndexBuffer() const
+{
+	return _indexBuffer;
+}
+
+VkDeviceSize SharedResources::GetIndexBuffer32Offset() const
+{
+	return _indexBuffer32Offset;
+}
+
+const std::vector<SharedResources::SubmeshDraw>& SharedResources::GetSubmeshDraws() const
+{
+	return _submeshDraws;
+}
+
+const std::vector<uint32_t>& SharedResources::GetMeshFirstSubmeshDraw() const
+{
+	return _meshFirstSubmeshDraw;
+}
+
+const std::vector<glm::mat4>& SharedResources::GetMeshDequantizations() const
+{
+	return _meshDequantizations;
+}
+
+VkPipelineLayout SharedResources::GetCullPipelineLayout() const
+{
+	return _cullPipelineLayout;
+}
+
+VkDescriptorSetLayout SharedResources::GetCullDescriptorSetLayout() const
+{
+	return _cullDescriptorSetLayout;
+}
+
+VkPipeline SharedResources::GetCullPipeline(uint32_t pass) const
+{
+	return _cullPipelines[pass];
+}
+
+uint64_t SharedResources::GetCullBufferVersion() const
+{
+	return _cullBufferVersion;
+}
+
+VkBuffer SharedResources::GetGpuInstanceBuffer() const
+{
+	return _gpuInstanceBuffer;
+}
+
+VkDeviceSize SharedResources::GetGpuInstanceSegmentSize() const
+{
+	return _gpuInstanceSegmentSize;
+}
+
+VkBuffer SharedResources::GetGpuMeshBuffer() const
+{
+	return _gpuMeshBuffer;
+}
+
+VkBuffer SharedResources::GetDrawTemplateBuffer() const
+{
+	return _drawTemplateBuffer;
+}
+
+uint32_t SharedResources::GetDrawTemplateCount16() const
+{
+	return _drawTemplateCount16;
+}
+
+uint32_t SharedResources::GetDrawTemplateCount() const
+{
+	return _drawTemplateCount;
+}
+
+uint32_t SharedResources::GetVisibleInstanceCapacity() const
+{
+	return _visibleInstanceCapacity;
+}
+
+uint32_t SharedResources::GetCullGroupCount() const
+{
+	return _cullGroupCount;
+}
@@ -0,0 +1,291 @@
+#pragma once
+
+#include "Renderer.h"
+#include <array>
+#include <string>
+#include <functional>
+#include <mutex>
+#include <exception>
+#include "Vertex.h"
+#include "MeshOptimize.h"
+#include "Culling.h"
+#include "Scene.h"
+#include "TextureStreamer.h"
+#include <stb_image.h>
+#include <tiny_obj_loader.h>
+
+// Largest projected simplification error, in pixels, a mesh LOD is allowed to show
+const float LOD_PIXEL_ERROR = 1.0f;
+// Device local bytes texture streaming may keep resident, the most detailed requests give way first
+const VkDeviceSize DEFAULT_TEXTURE_BUDGET = 256 * 1024 * 1024;
+// Size of the bindless texture array, lowered to what the device allows for update after bind sampled images
+const uint32_t MAX_BINDLESS_TEXTURES = 4096;
+
+// Everything the windows of a Renderer draw with that doesn't depend on a surface or a camera: the scene and its
+// geometry, the textures, the pipelines, the GPU culling inputs and the command pools of each frame in flight.
+// Windows only add their swapchain, attachments, framebuffers and the per frame buffers their camera decides.
+// Owned by the Renderer, not thread safe, call from the render thread.
+class SharedResources
+{
+public:
+	SharedResources(Renderer* renderer);
+	~SharedResources();
+
+	MeshHandle			 LoadMesh(const std::string& path);
+	// Decodes on the job system and streams like every texture, returns the slot of the bindless texture array it is
+	// sampled from. Instances pick it with Scene::SetInstanceMaterial, slot 0 is the default texture
+	uint32_t			 LoadTexture(const std::string& path);
+	Scene			*	 GetScene();
+	void				 SetTextureBudget(VkDeviceSize budget);
+	// Rebuilds the graphics pipelines and the packed vertex buffer, the old ones are retired with the frames using them
+	void				 SetVertexLayout(const VertexLayout& layout);
+	// Culls, picks LODs and builds the draws in a compute pass, on by default where the device supports it
+	void				 SetGpuCulling(bool enable);
+	bool				 GetGpuCulling() const;
+	// Vertex cache statistics of each loaded mesh before and after optimisation, indexed by MeshHandle
+	const std::vector<MeshOptimizationStats>& GetMeshOptimizationStats() const;
+
+	// Called by Renderer::DrawFrame once the frame's slot is free. maxTexturePixels is the largest on-screen size of
+	// any instance in any window, it picks the texture mip to stream
+	void				 BeginFrame(float maxTexturePixels);
+	// Blocks until the geometry and culling data the frame draws with have arrived
+	void				 WaitForUploads();
+	// Called by Renderer::SetFramesInFlight with the device idle
+	void				 SetFramesInFlight(uint32_t framesInFlight);
+
+	// Command buffers from the pools of the frame being recorded, reset by BeginFrame. The worker pools may only be
+	// used by that worker, secondaries are recorded in parallel
+	VkCommandBuffer		 GetPrimaryCommandBuffer();
+	VkCommandBuffer		 GetSecondaryCommandBuffer(uint32_t worker);
+
+	// Created on first use, one per color format. Presentable passes leave the image ready to present, the others
+	// ready to be copied from
+	VkRenderPass		 GetRenderPass(VkFormat colorFormat, bool presentable);
+	VkPipeline			 GetGraphicsPipeline(VkRenderPass renderPass) const;
+	// Set 0 is each window's uniform buffer, set 1 the bindless texture array
+	VkPipelineLayout	 GetPipelineLayout() const;
+	VkDescriptorSetLayout GetDescriptorSetLayout() const;
+	VkFormat			 GetDepthStencilFormat() const;
+
+	// Texture array of the frame being recorded, every slot holds its streamed texture once it is resident and the
+	// placeholder until then
+	VkDescriptorSet		 GetBindlessDescriptorSet() const;
+	// Slots of the texture array, 1 without descriptor indexing. Materials are clamped to it
+	uint32_t			 GetBindlessTextureCapacity() const;
+
+	// One vkCmdDrawIndexed of a mesh, firstIndex counts indexType sized elements
+	struct SubmeshDraw
+	{
+		uint32_t firstIndex = 0;
+		uint32_t indexCount = 0;
+		int32_t vertexOffset = 0;
+		VkIndexType indexType = VK_INDEX_TYPE_UINT16;
+	};
+
+	VkBuffer			 GetVertexBuffer() const;
+	// 16 bit indices start at 0, 32 bit ones at GetIndexBuffer32Offset()
+	VkBuffer			 GetIndexBuffer() const;
+	VkDeviceSize		 GetIndexBuffer32Offset() const;
+	// Submesh draws of mesh m are GetMeshFirstSubmeshDraw()[m] .. [m + 1], LOD major like the scene's submeshes
+	const std::vector<SubmeshDraw>& GetSubmeshDraws() const;
+	const std::vector<uint32_t>& GetMeshFirstSubmeshDraw() const;
+	// Per mesh, maps quantised positions back to model space
+	const std::vector<glm::mat4>& GetMeshDequantizations() const;
+
+	// GPU culling, see Shaders/cull.comp. Each window adds the visible instance, draw command and counter buffers
+	// sized by the counts below, and rebuilds them whenever the version changes
+	VkPipelineLayout	 GetCullPipelineLayout() const;
+	VkDescriptorSetLayout GetCullDescriptorSetLayout() const;
+	// Cull pass, then draw pass
+	VkPipeline			 GetCullPipeline(uint32_t pass) const;
+	uint64_t			 GetCullBufferVersion() const;
+	// Every instance in handle order, one segment per frame in flight written by BeginFrame
+	VkBuffer			 GetGpuInstanceBuffer() const;
+	VkDeviceSize		 GetGpuInstanceSegmentSize() const;
+	VkBuffer			 GetGpuMeshBuffer() const;
+	VkBuffer			 GetDrawTemplateBuffer() const;
+	// The first GetDrawTemplateCount16() templates draw with 16 bit indices
+	uint32_t			 GetDrawTemplateCount16() const;
+	uint32_t			 GetDrawTemplateCount() const;
+	uint32_t			 GetVisibleInstanceCapacity() const;
+	// (mesh, LOD) groups the counter buffer holds an instance count for
+	uint32_t			 GetCullGroupCount() const;
+
+	void				 CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, Allocation& bufferMemory);
+	void				 CreateImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkSampleCountFlagBits numSamples, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, Allocation& imageMemory);
+	VkImageView			 CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels);
+	// Records, submits and waits for the barrier on its own
+	void				 TransitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels);
+	// Hand the objects to Renderer::DestroyDeferred and reset the handles
+	void				 DestroyBufferDeferred(VkBuffer& buffer, Allocation& bufferMemory);
+	void				 DestroyImageDeferred(VkImage& image, VkImageView& imageView, Allocation& imageMemory);
+
+private:
+	void _InitDepthStencilFormat();
+
+	void _InitDescriptorSetLayout();
+	void _DeInitDescriptorSetLayout();
+
+	void _InitBindlessDescriptorSets();
+	void _DeInitBindlessDescriptorSets();
+	// Rewrites the frame's set if a texture view changed since it was last written, the frame must not be in flight
+	void _UpdateBindlessDescriptorSet(uint32_t frame);
+
+	void _InitShaderModules();
+	void _DeInitShaderModules();
+
+	VkPipeline _CreateGraphicsPipeline(VkRenderPass renderPass);
+	void _DeInitRenderPasses();
+
+	void _InitCommandPool();
+	void _DeInitCommandPool();
+
+	void _InitFrameCommandBuffers();
+	void _DeInitFrameCommandBuffers();
+
+	void _InitTextureImage();
+	void _DeInitTextureImage();
+
+	void _InitTextureSampler();
+	void _DeInitTextureSampler();
+
+	void _InitVertexBuffers();
+	void _DeInitVertexBuffers();
+
+	void _InitIndexBuffers();
+	void _DeInitIndexBuffers();
+
+	void _SyncScene();
+
+	void _InitCullPipelineLayout();
+	void _DeInitCullPipelineLayout();
+	// Needs shaders/cull.spv, only created once GPU culling is enabled
+	void _InitCullPipelines();
+	void _DeInitCullPipelines();
+
+	void _InitCullBuffers();
+	void _DeInitCullBuffers();
+	void _RebuildCullBuffers();
+
+	// Assets are decoded on the job system, the results are handed back to the render thread which creates
+	// the GPU resources and queues the uploads
+	struct DecodedMesh
+	{
+		std::vector<Vertex> vertices;
+		std::vector<uint32_t> indices;
+		std::vector<Submesh> submeshes;
+		MeshLods lods;
+		glm::vec3 boundsMin = glm::vec3(0.0f);
+		glm::vec3 boundsMax = glm::vec3(0.0f);
+		MeshOptimizationStats optimizationStats;
+	};
+	static DecodedMesh _DecodeMesh(const std::string& path, JobSystem* jobSystem);
+	static TextureSource _DecodeTexture(VkPhysicalDevice gpu, const std::string& path);
+	void _PushDecodedAsset(std::function<void()> finish);
+	void _PushDecodedError(std::exception_ptr error);
+	void _ProcessDecodedAssets();
+	// Requests the texture mips that match the on-screen size and advances the streamer
+	void _UpdateTextureStreaming(float maxPixels);
+
+	VkCommandBuffer _BeginSingleTimeCommands();
+	void _EndSingleTimeCommands(VkCommandBuffer commandBuffer);
+	bool _HasStencilComponent(VkFormat format);
+
+	static std::vector<char> readFile(const std::string& filename);
+
+	VkShaderModule _CreateShaderModule(const std::vector<char>& code);
+
+	Renderer* _renderer;
+
+	VkFormat _depthStencilFormat = VK_FORMAT_UNDEFINED;
+
+	VkShaderModule _vertShaderModule = VK_NULL_HANDLE;
+	VkShaderModule _fragShaderModule = VK_NULL_HANDLE;
+	VkDescriptorSetLayout _descriptorSetLayout = VK_NULL_HANDLE;
+	VkPipelineLayout _pipelineLayout = VK_NULL_HANDLE;
+
+	// With descriptor indexing the array is partially bound and update after bind, for the larger limits that come
+	// with it. Without it the array holds one texture. Either way there is a set per frame in flight, rewritten
+	// lazily once the frame is free again
+	uint32_t _bindlessTextureCapacity = 1;
+	VkDescriptorSetLayout _bindlessDescriptorSetLayout = VK_NULL_HANDLE;
+	VkDescriptorPool _bindlessDescriptorPool = VK_NULL_HANDLE;
+	std::vector<VkDescriptorSet> _bindlessDescriptorSets;
+	std::vector<uint64_t> _bindlessDescriptorSetTextureVersions;
+
+	// Windows of the same color format share a render pass, and with it the graphics pipeline
+	struct RenderPassPipeline
+	{
+		VkFormat colorFormat = VK_FORMAT_UNDEFINED;
+		bool presentable = false;
+		VkRenderPass renderPass = VK_NULL_HANDLE;
+		VkPipeline graphicsPipeline = VK_NULL_HANDLE;
+	};
+	std::vector<RenderPassPipeline> _renderPasses;
+
+	VkCommandPool _commandPool = VK_NULL_HANDLE;
+
+	// A whole frame is recycled with one reset per pool once its slot is free again. Every window records its
+	// primary from the same pools, one after the other
+	struct FrameCommandBuffers
+	{
+		VkCommandPool primaryPool = VK_NULL_HANDLE;
+		std::vector<VkCommandBuffer> primaries;
+		uint32_t primariesUsed = 0;
+		std::vector<VkCommandPool> workerPools;
+		std::vector<std::vector<VkCommandBuffer>> workerSecondaries;
+		std::vector<uint32_t> workerSecondariesUsed;
+	};
+	std::vector<FrameCommandBuffers> _frameCommandBuffers;
+	uint32_t _framesInFlight = 0;
+	uint32_t _frameIndex = 0;
+
+	Scene _scene;
+	uint64_t _sceneGeometryVersion = 0;
+	uint64_t _sceneLayoutVersion = 0;
+
+	VertexLayout _vertexLayout;
+	std::vector<MeshOptimizationStats> _meshOptimizationStats;
+	std::vector<glm::mat4> _meshDequantizations;
+	VkBuffer _vertexBuffer = VK_NULL_HANDLE;
+	Allocation _vertexBufferMemory;
+	VkBuffer _indexBuffer = VK_NULL_HANDLE;
+	Allocation _indexBufferMemory;
+	VkDeviceSize _indexBuffer32Offset = 0;
+	std::vector<SubmeshDraw> _submeshDraws;
+	std::vector<uint32_t> _meshFirstSubmeshDraw;
+
+	// The mesh and draw template buffers only change with the scene, the instance buffer has a segment per frame
+	bool _gpuCulling = false;
+	VkShaderModule _cullShaderModule = VK_NULL_HANDLE;
+	VkDescriptorSetLayout _cullDescriptorSetLayout = VK_NULL_HANDLE;
+	VkPipelineLayout _cullPipelineLayout = VK_NULL_HANDLE;
+	std::array<VkPipeline, 2> _cullPipelines{};
+	uint64_t _cullBufferVersion = 0;
+	VkBuffer _gpuInstanceBuffer = VK_NULL_HANDLE;
+	Allocation _gpuInstanceBufferMemory;
+	VkDeviceSize _gpuInstanceSegmentSize = 0;
+	VkBuffer _gpuMeshBuffer = VK_NULL_HANDLE;
+	Allocation _gpuMeshBufferMemory;
+	VkBuffer _drawTemplateBuffer = VK_NULL_HANDLE;
+	Allocation _drawTemplateBufferMemory;
+	uint32_t _drawTemplateCount16 = 0;
+	uint32_t _drawTemplateCount = 0;
+	uint32_t _visibleInstanceCapacity = 0;
+	uint32_t _cullGroupCount = 0;
+
+	VkImage _placeholderImage = VK_NULL_HANDLE;
+	Allocation _placeholderImageMemory;
+	VkImageView _placeholderImageView = VK_NULL_HANDLE;
+	TextureStreamer* _textureStreamer = nullptr;
+	// One per bindless slot, UINT32_MAX until the texture has been decoded
+	std::vector<StreamedTextureHandle> _textures;
+	VkSampler _textureSampler = VK_NULL_HANDLE;
+	uint64_t _assetUploadTicket = 0;
+	uint64_t _textureVersion = 0;
+
+	std::mutex _decodedAssetsMutex;
+	std::vector<std::function<void()>> _decodedAssets;
+
+	const std::string TEXTURE_PATH = "textures/chalet.jpg";
+};
@@ -0,0 +1,179 @@
+#include "TextureFile.h"
+#include <string.h>
+#include <algorithm>
+#include <cmath>
+
+static const unsigned char KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+struct Ktx2Header
+{
+	unsigned char identifier[12];
+	uint32_t vkFormat;
+	uint32_t typeSize;
+	uint32_t pixelWidth;
+	uint32_t pixelHeight;
+	uint32_t pixelDepth;
+	uint32_t layerCount;
+	uint32_t faceCount;
+	uint32_t levelCount;
+	uint32_t supercompressionScheme;
+	uint32_t dfdByteOffset;
+	uint32_t dfdByteLength;
+	uint32_t kvdByteOffset;
+	uint32_t kvdByteLength;
+	uint64_t sgdByteOffset;
+	uint64_t sgdByteLength;
+};
+
+struct Ktx2LevelIndex
+{
+	uint64_t byteOffset;
+	uint64_t byteLength;
+	uint64_t uncompressedByteLength;
+};
+
+uint32_t TextureSource::GetMipLevels() const
+{
+	return static_cast<uint32_t>(levels.size());
+}
+
+void TextureSource::GetChainRange(uint32_t baseMip, VkDeviceSize & offset, VkDeviceSize & size) const
+{
+	VkDeviceSize begin = levels[baseMip].offset;
+	VkDeviceSize end = levels[baseMip].offset + levels[baseMip].size;
+	for (uint32_t i = baseMip; i < levels.size(); i++)
+	{
+		begin = std::min(begin, levels[i].offset);
+		end = std::max(end, levels[i].offset + levels[i].size);
+	}
+	offset = begin;
+	size = end - begin;
+}
+
+std::vector<VkBufferImageCopy> TextureSource::GetCopyRegions(uint32_t baseMip) const
+{
+	VkDeviceSize chainOffset, chainSize;
+	GetChainRange(baseMip, chainOffset, chainSize);
+
+	std::vector<VkBufferImageCopy> regions(levels.size() - baseMip);
+	for (uint32_t i = 0; i < regions.size(); i++)
+	{
+		uint32_t level = baseMip + i;
+		regions[i].bufferOffset = levels[level].offset - chainOffset;
+		regions[i].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		regions[i].imageSubresource.mipLevel = i;
+		regions[i].imageSubresource.baseArrayLayer = 0;
+		regions[i].imageSubresource.layerCount = 1;
+		regions[i].imageOffset = { 0, 0, 0 };
+		regions[i].imageExtent = { std::max(width >> level, 1u), std::max(height >> level, 1u), 1 };
+	}
+	return regions;
+}
+
+bool LoadKtx2(const std::string & path, TextureSource & source)
+{
+	std::ifstream file(path, std::ios::ate | std::ios::binary);
+	if (!file.is_open())
+	{
+		return false;
+	}
+	std::vector<char> fileData(static_cast<size_t>(file.tellg()));
+	file.seekg(0);
+	file.read(fileData.data(), fileData.size());
+	file.close();
+
+	if (fileData.size() < sizeof(Ktx2Header))
+	{
+		return false;
+	}
+	Ktx2Header header;
+	memcpy(&header, fileData.data(), sizeof(header));
+	if (memcmp(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0 ||
+		header.vkFormat == VK_FORMAT_UNDEFINED ||
+		header.pixelDepth > 1 || header.layerCount > 1 || header.faceCount != 1 ||
+		header.supercompressionScheme != 0)
+	{
+		std::cout << "Unsupported KTX2 file " << path << std::endl;
+		return false;
+	}
+
+	// A level count of 0 means only the base level is stored
+	uint32_t levelCount = std::max(header.levelCount, 1u);
+	if (fileData.size() < sizeof(Ktx2Header) + levelCount * sizeof(Ktx2LevelIndex))
+	{
+		return false;
+	}
+
+	// Only the level data is kept, rebased to the first level in the file which keeps every level's alignment
+	std::vector<Ktx2LevelIndex> levelIndices(levelCount);
+	memcpy(levelIndices.data(), fileData.data() + sizeof(Ktx2Header), levelCount * sizeof(Ktx2LevelIndex));
+	uint64_t dataBegin = UINT64_MAX;
+	uint64_t dataEnd = 0;
+	for (const auto& levelIndex : levelIndices)
+	{
+		if (levelIndex.byteOffset + levelIndex.byteLength > fileData.size())
+		{
+			return false;
+		}
+		dataBegin = std::min(dataBegin, levelIndex.byteOffset);
+		dataEnd = std::max(dataEnd, levelIndex.byteOffset + levelIndex.byteLength);
+	}
+
+	source.format = static_cast<VkFormat>(header.vkFormat);
+	source.width = header.pixelWidth;
+	source.height = std::max(header.pixelHeight, 1u);
+	source.levels.resize(levelCount);
+	for (uint32_t i = 0; i < levelCount; i++)
+	{
+		source.levels[i].offset = levelIndices[i].byteOffset - dataBegin;
+		source.levels[i].size = levelIndices[i].byteLength;
+	}
+	source.data.assign(fileData.begin() + static_cast<size_t>(dataBegin), fileData.begin() + static_cast<size_t>(dataEnd));
+	return true;
+}
+
+void BuildMipChainRGBA8(const unsigned char * pixels, uint32_t width, uint32_t height, TextureSource & source)
+{
+	uint32_t levelCount = static_cast<uint32_t>(std::floor(std::log2(std::max(width, height)))) + 1;
+
+	source.format = VK_FORMAT_R8G8B8A8_UNORM;
+	source.width = width;
+	source.height = height;
+	source.levels.resize(levelCount);
+
+	VkDeviceSize offset = 0;
+	for (uint32_t i = levelCount; i-- > 0;)
+	{
+		source.levels[i].offset = offset;
+		source.levels[i].size = VkDeviceSize(std::max(width >> i, 1u)) * std::max(height >> i, 1u) * 4;
+		offset += source.levels[i].size;
+	}
+	source.data.resize(static_cast<size_t>(offset));
+	memcpy(source.data.data() + source.levels[0].offset, pixels, static_cast<size_t>(source.levels[0].size));
+
+	for (uint32_t i = 1; i < levelCount; i++)
+	{
+		const unsigned char* src = reinterpret_cast<const unsigned char*>(source.data.data() + source.levels[i - 1].offset);
+		unsigned char* dst = reinterpret_cast<unsigned char*>(source.data.data() + source.levels[i].offset);
+		uint32_t srcWidth = std::max(width >> (i - 1), 1u);
+		uint32_t srcHeight = std::max(height >> (i - 1), 1u);
+		uint32_t dstWidth = std::max(width >> i, 1u);
+		uint32_t dstHeight = std::max(height >> i, 1u);
+		for (uint32_t y = 0; y < dstHeight; y++)
+		{
+			uint32_t y0 = std::min(y * 2, srcHeight - 1);
+			uint32_t y1 = std::min(y * 2 + 1, srcHeight - 1);
+			for (uint32_t x = 0; x < dstWidth; x++)
+			{
+				uint32_t x0 = std::min(x * 2, srcWidth - 1);
+				uint32_t x1 = std::min(x * 2 + 1, srcWidth - 1);
+				for (uint32_t c = 0; c < 4; c++)
+				{
+					uint32_t sum = src[(y0 * srcWidth + x0) * 4 + c] + src[(y0 * srcWidth + x1) * 4 + c] +
+						src[(y1 * srcWidth + x0) * 4 + c] + src[(y1 * srcWidth + x1) * 4 + c];
+					dst[(y * dstWidth + x) * 4 + c] = static_cast<unsigned char>((sum + 2) / 4);
+				}
+			}
+		}
+	}
+}
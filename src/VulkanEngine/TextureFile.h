@@ -0,0 +1,36 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "Shared.h"
+
+struct TextureLevel
+{
+	VkDeviceSize offset = 0;
+	VkDeviceSize size = 0;
+};
+
+// CPU copy of a 2D texture with its full mip chain.
+// Levels are stored smallest first like in KTX2, so any chain of levels base .. last is one contiguous range.
+struct TextureSource
+{
+	VkFormat format = VK_FORMAT_UNDEFINED;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	std::vector<TextureLevel> levels;
+	std::vector<char> data;
+
+	uint32_t GetMipLevels() const;
+	// Byte range of levels baseMip .. GetMipLevels() - 1 within data
+	void GetChainRange(uint32_t baseMip, VkDeviceSize& offset, VkDeviceSize& size) const;
+	// One copy region per level of the chain starting at baseMip, for a staging buffer holding that chain's range at offset 0.
+	// Level baseMip becomes mip 0 of the destination image
+	std::vector<VkBufferImageCopy> GetCopyRegions(uint32_t baseMip) const;
+};
+
+// Reads a KTX2 file holding a single 2D image with a precomputed mip chain, typically block compressed.
+// Supercompressed files, arrays, cube maps and 3D textures are rejected.
+bool LoadKtx2(const std::string& path, TextureSource& source);
+
+// Builds the full mip chain of an RGBA8 image on the CPU with a 2x2 box filter
+void BuildMipChainRGBA8(const unsigned char* pixels, uint32_t width, uint32_t height, TextureSource& source);
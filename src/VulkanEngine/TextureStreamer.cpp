@@ -0,0 +1,230 @@
+#include "TextureStreamer.h"
+#include "Renderer.h"
+#include "Uploader.h"
+#include <algorithm>
+
+TextureStreamer::TextureStreamer(Renderer * renderer, VkDeviceSize budget)
+{
+	_renderer = renderer;
+	_budget = budget;
+}
+
+TextureStreamer::~TextureStreamer()
+{
+	for (auto &texture : _textures)
+	{
+		_DestroyChain(texture.resident);
+		_DestroyChain(texture.pending);
+	}
+	for (auto &retired : _retiredChains)
+	{
+		_DestroyChain(retired.chain);
+	}
+}
+
+StreamedTextureHandle TextureStreamer::Add(TextureSource && source)
+{
+	Texture texture;
+	texture.source = std::move(source);
+
+	uint32_t baseMip = 0;
+	while (baseMip + 1 < texture.source.GetMipLevels() && std::max(texture.source.width >> baseMip, texture.source.height >> baseMip) > INITIAL_MIP_SIZE)
+	{
+		baseMip++;
+	}
+	texture.requestedBaseMip = baseMip;
+	texture.targetBaseMip = baseMip;
+
+	_textures.push_back(std::move(texture));
+	_StartUpload(_textures.back(), baseMip);
+	_renderer->GetUploader()->Flush();
+
+	return static_cast<StreamedTextureHandle>(_textures.size() - 1);
+}
+
+void TextureStreamer::RequestMip(StreamedTextureHandle texture, uint32_t baseMip)
+{
+	_textures[texture].requestedBaseMip = std::min(baseMip, _textures[texture].source.GetMipLevels() - 1);
+}
+
+bool TextureStreamer::Update(uint64_t frameValue, uint64_t completedValue)
+{
+	while (!_retiredChains.empty() && _retiredChains.front().retireValue <= completedValue)
+	{
+		_DestroyChain(_retiredChains.front().chain);
+		_retiredChains.pop_front();
+	}
+
+	bool viewsChanged = false;
+	for (auto &texture : _textures)
+	{
+		if (texture.pending.image == VK_NULL_HANDLE || !_renderer->GetUploader()->IsComplete(texture.pending.ticket))
+		{
+			continue;
+		}
+		if (texture.resident.image != VK_NULL_HANDLE)
+		{
+			RetiredChain retired;
+			retired.chain = texture.resident;
+			retired.retireValue = frameValue;
+			_retiredChains.push_back(retired);
+		}
+		texture.resident = texture.pending;
+		texture.pending = Chain();
+		viewsChanged = true;
+	}
+
+	// Fit the requests into the budget by giving up detail on whichever texture currently asks for the most
+	VkDeviceSize targetBytes = 0;
+	for (auto &texture : _textures)
+	{
+		texture.targetBaseMip = texture.requestedBaseMip;
+		targetBytes += _GetChainBytes(texture, texture.targetBaseMip);
+	}
+	while (targetBytes > _budget)
+	{
+		Texture* largest = nullptr;
+		VkDeviceSize largestBytes = 0;
+		for (auto &texture : _textures)
+		{
+			VkDeviceSize bytes = _GetChainBytes(texture, texture.targetBaseMip);
+			if (texture.targetBaseMip + 1 < texture.source.GetMipLevels() && bytes > largestBytes)
+			{
+				largest = &texture;
+				largestBytes = bytes;
+			}
+		}
+		if (largest == nullptr)
+		{
+			break;
+		}
+		largest->targetBaseMip++;
+		targetBytes -= largestBytes - _GetChainBytes(*largest, largest->targetBaseMip);
+	}
+
+	// One chain change in flight per texture. Dropping detail waits for a two level difference unless the
+	// budget is exceeded, so a camera hovering around a mip boundary doesn't reupload every frame
+	bool uploaded = false;
+	bool overBudget = _residentBytes > _budget;
+	for (auto &texture : _textures)
+	{
+		if (texture.pending.image != VK_NULL_HANDLE || texture.resident.image == VK_NULL_HANDLE)
+		{
+			continue;
+		}
+		uint32_t residentBaseMip = texture.resident.baseMip;
+		if (texture.targetBaseMip < residentBaseMip ||
+			texture.targetBaseMip >= residentBaseMip + 2 ||
+			(texture.targetBaseMip > residentBaseMip && overBudget))
+		{
+			_StartUpload(texture, texture.targetBaseMip);
+			uploaded = true;
+		}
+	}
+	if (uploaded)
+	{
+		_renderer->GetUploader()->Flush();
+	}
+
+	return viewsChanged;
+}
+
+void TextureStreamer::SetBudget(VkDeviceSize budget)
+{
+	_budget = budget;
+}
+
+VkDeviceSize TextureStreamer::GetBudget() const
+{
+	return _budget;
+}
+
+VkDeviceSize TextureStreamer::GetResidentBytes() const
+{
+	return _residentBytes;
+}
+
+VkImageView TextureStreamer::GetView(StreamedTextureHandle texture) const
+{
+	return _textures[texture].resident.view;
+}
+
+uint32_t TextureStreamer::GetResidentBaseMip(StreamedTextureHandle texture) const
+{
+	return _textures[texture].resident.baseMip;
+}
+
+uint32_t TextureStreamer::GetMipLevels(StreamedTextureHandle texture) const
+{
+	return _textures[texture].source.GetMipLevels();
+}
+
+uint32_t TextureStreamer::GetWidth(StreamedTextureHandle texture) const
+{
+	return _textures[texture].source.width;
+}
+
+void TextureStreamer::_StartUpload(Texture & texture, uint32_t baseMip)
+{
+	const TextureSource& source = texture.source;
+	Chain& chain = texture.pending;
+	chain.baseMip = baseMip;
+
+	VkImageCreateInfo imageInfo = {};
+	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.extent.width = std::max(source.width >> baseMip, 1u);
+	imageInfo.extent.height = std::max(source.height >> baseMip, 1u);
+	imageInfo.extent.depth = 1;
+	imageInfo.mipLevels = source.GetMipLevels() - baseMip;
+	imageInfo.arrayLayers = 1;
+	imageInfo.format = source.format;
+	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	ErrorCheck(vkCreateImage(_renderer->GetVulkanDevice(), &imageInfo, nullptr, &chain.image));
+
+	VkMemoryRequirements memRequirements;
+	vkGetImageMemoryRequirements(_renderer->GetVulkanDevice(), chain.image, &memRequirements);
+	chain.memory = _renderer->GetMemoryAllocator()->Allocate(memRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, false);
+	ErrorCheck(vkBindImageMemory(_renderer->GetVulkanDevice(), chain.image, chain.memory.memory, chain.memory.offset));
+	_residentBytes += chain.memory.size;
+
+	VkImageViewCreateInfo viewInfo = {};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.image = chain.image;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.format = source.format;
+	viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	viewInfo.subresourceRange.baseMipLevel = 0;
+	viewInfo.subresourceRange.levelCount = imageInfo.mipLevels;
+	viewInfo.subresourceRange.baseArrayLayer = 0;
+	viewInfo.subresourceRange.layerCount = 1;
+	ErrorCheck(vkCreateImageView(_renderer->GetVulkanDevice(), &viewInfo, nullptr, &chain.view));
+
+	VkDeviceSize offset, size;
+	source.GetChainRange(baseMip, offset, size);
+	chain.ticket = _renderer->GetUploader()->UploadImageMips(chain.image, source.data.data() + offset, size, source.GetCopyRegions(baseMip));
+}
+
+void TextureStreamer::_DestroyChain(Chain & chain)
+{
+	if (chain.image == VK_NULL_HANDLE)
+	{
+		return;
+	}
+	_residentBytes -= chain.memory.size;
+	vkDestroyImageView(_renderer->GetVulkanDevice(), chain.view, nullptr);
+	vkDestroyImage(_renderer->GetVulkanDevice(), chain.image, nullptr);
+	_renderer->GetMemoryAllocator()->Free(chain.memory);
+	chain = Chain();
+}
+
+VkDeviceSize TextureStreamer::_GetChainBytes(const Texture & texture, uint32_t baseMip) const
+{
+	VkDeviceSize offset, size;
+	texture.source.GetChainRange(baseMip, offset, size);
+	return size;
+}
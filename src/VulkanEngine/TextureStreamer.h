@@ -0,0 +1,83 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+#include "Shared.h"
+#include "MemoryAllocator.h"
+#include "TextureFile.h"
+
+class Renderer;
+
+typedef uint32_t StreamedTextureHandle;
+
+// Keeps a CPU copy of every texture's full mip chain and decides per texture how much of it lives on the GPU.
+// A texture's image only holds its resident chain, base mip .. last mip, so lowering residency actually gives
+// memory back and the sampler needs no LOD clamp: a coarser chain is simply a smaller image behind the same UVs.
+// Changing residency builds a new image with the new chain and swaps it in once the upload has finished,
+// the old image is kept until no frame in flight can still sample it.
+// Not thread safe, call from the render thread.
+class TextureStreamer
+{
+public:
+	TextureStreamer(Renderer* renderer, VkDeviceSize budget);
+	// The GPU must be done with all textures
+	~TextureStreamer();
+
+	// Starts with the mips no larger than INITIAL_MIP_SIZE resident
+	StreamedTextureHandle Add(TextureSource&& source);
+
+	// Most detailed mip the texture is needed at this frame, residency follows within the budget
+	void RequestMip(StreamedTextureHandle texture, uint32_t baseMip);
+	// Call once per frame with the frame scheduler's value of the frame being recorded and the last completed value,
+	// a replaced image is destroyed once the frame that replaced it has completed. Returns true if any view changed
+	bool Update(uint64_t frameValue, uint64_t completedValue);
+
+	void SetBudget(VkDeviceSize budget);
+	VkDeviceSize GetBudget() const;
+	// Bytes of all texture images, including uploads still in flight and images waiting to be retired
+	VkDeviceSize GetResidentBytes() const;
+
+	// VK_NULL_HANDLE until the first chain of the texture has been uploaded
+	VkImageView GetView(StreamedTextureHandle texture) const;
+	uint32_t GetResidentBaseMip(StreamedTextureHandle texture) const;
+	uint32_t GetMipLevels(StreamedTextureHandle texture) const;
+	uint32_t GetWidth(StreamedTextureHandle texture) const;
+
+	static const uint32_t INITIAL_MIP_SIZE = 128;
+
+private:
+	struct Chain
+	{
+		VkImage image = VK_NULL_HANDLE;
+		Allocation memory;
+		VkImageView view = VK_NULL_HANDLE;
+		uint32_t baseMip = UINT32_MAX;
+		uint64_t ticket = 0;
+	};
+
+	struct Texture
+	{
+		TextureSource source;
+		Chain resident;
+		Chain pending;
+		uint32_t requestedBaseMip = 0;
+		uint32_t targetBaseMip = 0;
+	};
+
+	struct RetiredChain
+	{
+		Chain chain;
+		uint64_t retireValue = 0;
+	};
+
+	void _StartUpload(Texture& texture, uint32_t baseMip);
+	void _DestroyChain(Chain& chain);
+	VkDeviceSize _GetChainBytes(const Texture& texture, uint32_t baseMip) const;
+
+	Renderer* _renderer = nullptr;
+	VkDeviceSize _budget = 0;
+	VkDeviceSize _residentBytes = 0;
+
+	std::vector<Texture> _textures;
+	std::deque<RetiredChain> _retiredChains;
+};
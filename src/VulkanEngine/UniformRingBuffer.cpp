@@ -0,0 +1,64 @@
+#include "UniformRingBuffer.h"
+#include "Renderer.h"
+#include <algorithm>
+#include <stdexcept>
+
+UniformRingBuffer::UniformRingBuffer(Renderer * renderer, VkDeviceSize bytesPerFrame, uint32_t frameCount)
+{
+	_renderer = renderer;
+	_alignment = std::max(renderer->GetVulkanPhysicalDeviceProperties().limits.minUniformBufferOffsetAlignment, VkDeviceSize(1));
+	_frameSize = (bytesPerFrame + _alignment - 1) & ~(_alignment - 1);
+	_frameCount = frameCount;
+
+	VkBufferCreateInfo bufferInfo = {};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = _frameSize * _frameCount;
+	bufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	if (vkCreateBuffer(_renderer->GetVulkanDevice(), &bufferInfo, nullptr, &_buffer) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create uniform ring buffer!");
+	}
+
+	VkMemoryRequirements memRequirements;
+	vkGetBufferMemoryRequirements(_renderer->GetVulkanDevice(), _buffer, &memRequirements);
+	_memory = _renderer->GetMemoryAllocator()->Allocate(memRequirements, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, true);
+	ErrorCheck(vkBindBufferMemory(_renderer->GetVulkanDevice(), _buffer, _memory.memory, _memory.offset));
+}
+
+UniformRingBuffer::~UniformRingBuffer()
+{
+	vkDestroyBuffer(_renderer->GetVulkanDevice(), _buffer, nullptr);
+	_renderer->GetMemoryAllocator()->Free(_memory);
+}
+
+void UniformRingBuffer::BeginFrame(uint32_t frameIndex)
+{
+	assert(frameIndex < _frameCount);
+	_frameBegin = _frameSize * frameIndex;
+	_head = _frameBegin;
+}
+
+void * UniformRingBuffer::Allocate(VkDeviceSize size, uint32_t & dynamicOffset)
+{
+	VkDeviceSize offset = _head;
+	VkDeviceSize end = offset + size;
+	if (end > _frameBegin + _frameSize)
+	{
+		throw std::runtime_error("uniform ring buffer frame segment exhausted!");
+	}
+	_head = (end + _alignment - 1) & ~(_alignment - 1);
+
+	dynamicOffset = static_cast<uint32_t>(offset);
+	return static_cast<char*>(_memory.mapped) + offset;
+}
+
+VkBuffer UniformRingBuffer::GetBuffer() const
+{
+	return _buffer;
+}
+
+uint32_t UniformRingBuffer::GetFrameOffset(uint32_t frameIndex) const
+{
+	return static_cast<uint32_t>(_frameSize * frameIndex);
+}
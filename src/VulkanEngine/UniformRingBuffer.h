@@ -0,0 +1,35 @@
+#pragma once
+
+#include "Shared.h"
+#include "MemoryAllocator.h"
+
+class Renderer;
+
+// One persistently mapped, host coherent buffer split into a segment per frame.
+// Allocations within a frame are a pointer bump aligned to minUniformBufferOffsetAlignment and are bound
+// as VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC with the returned offset.
+class UniformRingBuffer
+{
+public:
+	UniformRingBuffer(Renderer* renderer, VkDeviceSize bytesPerFrame, uint32_t frameCount);
+	~UniformRingBuffer();
+
+	// The caller must have waited for the GPU to finish the frame that last used this segment
+	void BeginFrame(uint32_t frameIndex);
+	void* Allocate(VkDeviceSize size, uint32_t& dynamicOffset);
+
+	VkBuffer GetBuffer() const;
+	uint32_t GetFrameOffset(uint32_t frameIndex) const;
+
+private:
+	Renderer* _renderer = nullptr;
+	VkBuffer _buffer = VK_NULL_HANDLE;
+	Allocation _memory;
+
+	VkDeviceSize _alignment = 1;
+	VkDeviceSize _frameSize = 0;
+	uint32_t _frameCount = 0;
+
+	VkDeviceSize _frameBegin = 0;
+	VkDeviceSize _head = 0;
+};
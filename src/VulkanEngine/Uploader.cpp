@@ -0,0 +1,459 @@
+#include "Uploader.h"
+#include "Renderer.h"
+#include <stdexcept>
+#include <string.h>
+
+Uploader::Uploader(Renderer * renderer)
+{
+	_renderer = renderer;
+	_device = renderer->GetVulkanDevice();
+	_transferFamilyIndex = renderer->GetVulkanTransferQueueFamilyIndex();
+	_graphicsFamilyIndex = renderer->GetVulkanGraphicsQueueFamilyIndex();
+	_InitCommandPools();
+}
+
+Uploader::~Uploader()
+{
+	WaitIdle();
+	_DeInitCommandPools();
+}
+
+uint64_t Uploader::UploadBuffer(VkBuffer dstBuffer, const void * data, VkDeviceSize size, VkDeviceSize dstOffset, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+{
+	Batch& batch = _GetRecordingBatch();
+	StagingBuffer staging = _CreateStagingBuffer(data, size);
+	batch.stagingBuffers.push_back(staging);
+
+	VkBufferCopy copyRegion = {};
+	copyRegion.dstOffset = dstOffset;
+	copyRegion.size = size;
+	vkCmdCopyBuffer(batch.transferCommandBuffer, staging.buffer, dstBuffer, 1, &copyRegion);
+
+	VkBufferMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = dstAccess;
+	barrier.srcQueueFamilyIndex = _transferFamilyIndex;
+	barrier.dstQueueFamilyIndex = _graphicsFamilyIndex;
+	barrier.buffer = dstBuffer;
+	barrier.offset = dstOffset;
+	barrier.size = size;
+
+	if (_transferFamilyIndex != _graphicsFamilyIndex)
+	{
+		// Release half of the ownership transfer, the destination access is ignored on this queue
+		VkBufferMemoryBarrier release = barrier;
+		release.dstAccessMask = 0;
+		vkCmdPipelineBarrier(batch.transferCommandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+			0, nullptr,
+			1, &release,
+			0, nullptr);
+		barrier.srcAccessMask = 0;
+	}
+	else
+	{
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	}
+
+	vkCmdPipelineBarrier(batch.graphicsCommandBuffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage, 0,
+		0, nullptr,
+		1, &barrier,
+		0, nullptr);
+
+	return batch.ticket;
+}
+
+uint64_t Uploader::UploadImage(VkImage dstImage, VkFormat format, const void * data, VkDeviceSize size, uint32_t width, uint32_t height, uint32_t mipLevels)
+{
+	if (mipLevels > 1)
+	{
+		VkFormatProperties formatProperties;
+		vkGetPhysicalDeviceFormatProperties(_renderer->GetVulkanPhysicalDevice(), format, &formatProperties);
+
+		if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT)) {
+			throw std::runtime_error("texture image format does not support linear blitting!");
+		}
+	}
+
+	Batch& batch = _GetRecordingBatch();
+	StagingBuffer staging = _CreateStagingBuffer(data, size);
+	batch.stagingBuffers.push_back(staging);
+
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = dstImage;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseMipLevel = 0;
+	barrier.subresourceRange.levelCount = mipLevels;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+
+	vkCmdPipelineBarrier(batch.transferCommandBuffer,
+		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+		0, nullptr,
+		0, nullptr,
+		1, &barrier);
+
+	VkBufferImageCopy region = {};
+	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	region.imageSubresource.mipLevel = 0;
+	region.imageSubresource.baseArrayLayer = 0;
+	region.imageSubresource.layerCount = 1;
+	region.imageOffset = { 0, 0, 0 };
+	region.imageExtent = { width, height, 1 };
+
+	vkCmdCopyBufferToImage(batch.transferCommandBuffer, staging.buffer, dstImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+	if (_transferFamilyIndex != _graphicsFamilyIndex)
+	{
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcQueueFamilyIndex = _transferFamilyIndex;
+		barrier.dstQueueFamilyIndex = _graphicsFamilyIndex;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = 0;
+
+		vkCmdPipelineBarrier(batch.transferCommandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+			0, nullptr,
+			0, nullptr,
+			1, &barrier);
+
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+
+		vkCmdPipelineBarrier(batch.graphicsCommandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+			0, nullptr,
+			0, nullptr,
+			1, &barrier);
+	}
+
+	// Blits need a graphics queue, so the mip chain is built on the acquiring side
+	_GenerateMipMaps(batch.graphicsCommandBuffer, dstImage, format, static_cast<int32_t>(width), static_cast<int32_t>(height), mipLevels);
+
+	return batch.ticket;
+}
+
+uint64_t Uploader::UploadImageMips(VkImage dstImage, const void * data, VkDeviceSize size, const std::vector<VkBufferImageCopy>& regions)
+{
+	Batch& batch = _GetRecordingBatch();
+	StagingBuffer staging = _CreateStagingBuffer(data, size);
+	batch.stagingBuffers.push_back(staging);
+
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = dstImage;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseMipLevel = 0;
+	barrier.subresourceRange.levelCount = static_cast<uint32_t>(regions.size());
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+
+	vkCmdPipelineBarrier(batch.transferCommandBuffer,
+		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+		0, nullptr,
+		0, nullptr,
+		1, &barrier);
+
+	vkCmdCopyBufferToImage(batch.transferCommandBuffer, staging.buffer, dstImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(regions.size()), regions.data());
+
+	// The layout transition to shader read is part of the ownership transfer when the families differ
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	if (_transferFamilyIndex != _graphicsFamilyIndex)
+	{
+		barrier.srcQueueFamilyIndex = _transferFamilyIndex;
+		barrier.dstQueueFamilyIndex = _graphicsFamilyIndex;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = 0;
+
+		vkCmdPipelineBarrier(batch.transferCommandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+			0, nullptr,
+			0, nullptr,
+			1, &barrier);
+
+		barrier.srcAccessMask = 0;
+	}
+	else
+	{
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	}
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	vkCmdPipelineBarrier(batch.graphicsCommandBuffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+		0, nullptr,
+		0, nullptr,
+		1, &barrier);
+
+	return batch.ticket;
+}
+
+uint64_t Uploader::Flush()
+{
+	if (_batches.empty() || _batches.back().state != BatchState::Recording)
+	{
+		return _nextTicket - 1;
+	}
+
+	Batch& batch = _batches.back();
+	ErrorCheck(vkEndCommandBuffer(batch.transferCommandBuffer));
+	ErrorCheck(vkEndCommandBuffer(batch.graphicsCommandBuffer));
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &batch.transferCommandBuffer;
+
+	ErrorCheck(vkQueueSubmit(_renderer->GetVulkanTransferQueue(), 1, &submitInfo, batch.transferFence));
+	batch.state = BatchState::Transferring;
+
+	return batch.ticket;
+}
+
+void Uploader::Update()
+{
+	// The acquire side is submitted once the copies are done, so the graphics queue never waits on the transfer queue
+	for (auto &batch : _batches)
+	{
+		if (batch.state != BatchState::Transferring)
+		{
+			continue;
+		}
+		if (vkGetFenceStatus(_device, batch.transferFence) != VK_SUCCESS)
+		{
+			break;
+		}
+		_SubmitAcquire(batch);
+	}
+
+	while (!_batches.empty() && _batches.front().state == BatchState::Acquiring && vkGetFenceStatus(_device, _batches.front().graphicsFence) == VK_SUCCESS)
+	{
+		_RetireBatch(_batches.front());
+		_batches.pop_front();
+	}
+}
+
+bool Uploader::IsComplete(uint64_t ticket) const
+{
+	return ticket <= _completedTicket;
+}
+
+void Uploader::Wait(uint64_t ticket)
+{
+	if (!_batches.empty() && _batches.back().state == BatchState::Recording && _batches.back().ticket <= ticket)
+	{
+		Flush();
+	}
+
+	while (!IsComplete(ticket) && !_batches.empty())
+	{
+		Batch& batch = _batches.front();
+		if (batch.state == BatchState::Transferring)
+		{
+			ErrorCheck(vkWaitForFences(_device, 1, &batch.transferFence, VK_TRUE, UINT64_MAX));
+			_SubmitAcquire(batch);
+		}
+		ErrorCheck(vkWaitForFences(_device, 1, &batch.graphicsFence, VK_TRUE, UINT64_MAX));
+		_RetireBatch(batch);
+		_batches.pop_front();
+	}
+}
+
+void Uploader::WaitIdle()
+{
+	Wait(Flush());
+}
+
+Uploader::Batch & Uploader::_GetRecordingBatch()
+{
+	if (!_batches.empty() && _batches.back().state == BatchState::Recording)
+	{
+		return _batches.back();
+	}
+
+	_batches.emplace_back();
+	Batch& batch = _batches.back();
+	batch.ticket = _nextTicket++;
+
+	VkCommandBufferAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandBufferCount = 1;
+	allocInfo.commandPool = _transferCommandPool;
+	ErrorCheck(vkAllocateCommandBuffers(_device, &allocInfo, &batch.transferCommandBuffer));
+	allocInfo.commandPool = _graphicsCommandPool;
+	ErrorCheck(vkAllocateCommandBuffers(_device, &allocInfo, &batch.graphicsCommandBuffer));
+
+	VkFenceCreateInfo fenceInfo = {};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	ErrorCheck(vkCreateFence(_device, &fenceInfo, nullptr, &batch.transferFence));
+	ErrorCheck(vkCreateFence(_device, &fenceInfo, nullptr, &batch.graphicsFence));
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	ErrorCheck(vkBeginCommandBuffer(batch.transferCommandBuffer, &beginInfo));
+	ErrorCheck(vkBeginCommandBuffer(batch.graphicsCommandBuffer, &beginInfo));
+
+	return batch;
+}
+
+Uploader::StagingBuffer Uploader::_CreateStagingBuffer(const void * data, VkDeviceSize size)
+{
+	StagingBuffer staging;
+
+	VkBufferCreateInfo bufferInfo = {};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = size;
+	bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	if (vkCreateBuffer(_device, &bufferInfo, nullptr, &staging.buffer) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create staging buffer!");
+	}
+
+	VkMemoryRequirements memRequirements;
+	vkGetBufferMemoryRequirements(_device, staging.buffer, &memRequirements);
+	staging.memory = _renderer->GetMemoryAllocator()->Allocate(memRequirements, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, true);
+	ErrorCheck(vkBindBufferMemory(_device, staging.buffer, staging.memory.memory, staging.memory.offset));
+
+	memcpy(staging.memory.mapped, data, static_cast<size_t>(size));
+	return staging;
+}
+
+void Uploader::_SubmitAcquire(Batch & batch)
+{
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &batch.graphicsCommandBuffer;
+
+	ErrorCheck(vkQueueSubmit(_renderer->GetVulkanQueue(), 1, &submitInfo, batch.graphicsFence));
+	batch.state = BatchState::Acquiring;
+}
+
+void Uploader::_RetireBatch(Batch & batch)
+{
+	for (auto &staging : batch.stagingBuffers)
+	{
+		vkDestroyBuffer(_device, staging.buffer, nullptr);
+		_renderer->GetMemoryAllocator()->Free(staging.memory);
+	}
+	vkFreeCommandBuffers(_device, _transferCommandPool, 1, &batch.transferCommandBuffer);
+	vkFreeCommandBuffers(_device, _graphicsCommandPool, 1, &batch.graphicsCommandBuffer);
+	vkDestroyFence(_device, batch.transferFence, nullptr);
+	vkDestroyFence(_device, batch.graphicsFence, nullptr);
+	_completedTicket = batch.ticket;
+}
+
+void Uploader::_GenerateMipMaps(VkCommandBuffer commandBuffer, VkImage image, VkFormat format, int32_t width, int32_t height, uint32_t mipLevels)
+{
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.image = image;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+	barrier.subresourceRange.levelCount = 1;
+
+	int32_t mipWidth = width;
+	int32_t mipHeight = height;
+
+	for (uint32_t i = 1; i < mipLevels; i++) {
+		barrier.subresourceRange.baseMipLevel = i - 1;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+		vkCmdPipelineBarrier(commandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+			0, nullptr,
+			0, nullptr,
+			1, &barrier);
+
+		VkImageBlit blit = {};
+		blit.srcOffsets[0] = { 0, 0, 0 };
+		blit.srcOffsets[1] = { mipWidth, mipHeight, 1 };
+		blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		blit.srcSubresource.mipLevel = i - 1;
+		blit.srcSubresource.baseArrayLayer = 0;
+		blit.srcSubresource.layerCount = 1;
+		blit.dstOffsets[0] = { 0, 0, 0 };
+		blit.dstOffsets[1] = { mipWidth > 1 ? mipWidth / 2 : 1, mipHeight > 1 ? mipHeight / 2 : 1, 1 };
+		blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		blit.dstSubresource.mipLevel = i;
+		blit.dstSubresource.baseArrayLayer = 0;
+		blit.dstSubresource.layerCount = 1;
+
+		vkCmdBlitImage(commandBuffer,
+			image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			1, &blit,
+			VK_FILTER_LINEAR);
+
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+		vkCmdPipelineBarrier(commandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+			0, nullptr,
+			0, nullptr,
+			1, &barrier);
+
+		if (mipWidth > 1) mipWidth /= 2;
+		if (mipHeight > 1) mipHeight /= 2;
+	}
+
+	barrier.subresourceRange.baseMipLevel = mipLevels - 1;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+		0, nullptr,
+		0, nullptr,
+		1, &barrier);
+}
+
+void Uploader::_InitCommandPools()
+{
+	VkCommandPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+	poolInfo.queueFamilyIndex = _transferFamilyIndex;
+	ErrorCheck(vkCreateCommandPool(_device, &poolInfo, nullptr, &_transferCommandPool));
+
+	poolInfo.queueFamilyIndex = _graphicsFamilyIndex;
+	ErrorCheck(vkCreateCommandPool(_device, &poolInfo, nullptr, &_graphicsCommandPool));
+}
+
+void Uploader::_DeInitCommandPools()
+{
+	vkDestroyCommandPool(_device, _transferCommandPool, nullptr);
+	vkDestroyCommandPool(_device, _graphicsCommandPool, nullptr);
+}
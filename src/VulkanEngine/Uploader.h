@@ -0,0 +1,82 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+#include "Shared.h"
+#include "MemoryAllocator.h"
+
+class Renderer;
+
+// Batches buffer and image uploads into one transfer queue submission.
+// Copies run on the transfer queue family, ownership is released to the graphics family and acquired by a
+// second command buffer on the graphics queue, which also generates mip maps. Each batch is identified by a
+// ticket, the resources of a batch may only be used once IsComplete(ticket) returns true.
+// Not thread safe, call from the render thread.
+class Uploader
+{
+public:
+	Uploader(Renderer* renderer);
+	~Uploader();
+
+	// dstStage and dstAccess describe the first use of the buffer on the graphics queue
+	uint64_t UploadBuffer(VkBuffer dstBuffer, const void* data, VkDeviceSize size, VkDeviceSize dstOffset, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+	// Fills mip 0 and generates the rest, the image ends up in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+	uint64_t UploadImage(VkImage dstImage, VkFormat format, const void* data, VkDeviceSize size, uint32_t width, uint32_t height, uint32_t mipLevels);
+	// Fills every mip level from data with one copy, one region per level, for precomputed (e.g. block compressed) chains.
+	// The image ends up in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+	uint64_t UploadImageMips(VkImage dstImage, const void* data, VkDeviceSize size, const std::vector<VkBufferImageCopy>& regions);
+
+	// Submits the batch being recorded, returns its ticket
+	uint64_t Flush();
+	// Advances submitted batches without blocking, call once per frame
+	void Update();
+	bool IsComplete(uint64_t ticket) const;
+	void Wait(uint64_t ticket);
+	void WaitIdle();
+
+private:
+	enum class BatchState
+	{
+		Recording,
+		Transferring,
+		Acquiring,
+	};
+
+	struct StagingBuffer
+	{
+		VkBuffer buffer = VK_NULL_HANDLE;
+		Allocation memory;
+	};
+
+	struct Batch
+	{
+		uint64_t ticket = 0;
+		BatchState state = BatchState::Recording;
+		VkCommandBuffer transferCommandBuffer = VK_NULL_HANDLE;
+		VkCommandBuffer graphicsCommandBuffer = VK_NULL_HANDLE;
+		VkFence transferFence = VK_NULL_HANDLE;
+		VkFence graphicsFence = VK_NULL_HANDLE;
+		std::vector<StagingBuffer> stagingBuffers;
+	};
+
+	Batch& _GetRecordingBatch();
+	StagingBuffer _CreateStagingBuffer(const void* data, VkDeviceSize size);
+	void _SubmitAcquire(Batch& batch);
+	void _RetireBatch(Batch& batch);
+	void _GenerateMipMaps(VkCommandBuffer commandBuffer, VkImage image, VkFormat format, int32_t width, int32_t height, uint32_t mipLevels);
+
+	void _InitCommandPools();
+	void _DeInitCommandPools();
+
+	Renderer* _renderer = nullptr;
+	VkDevice _device = VK_NULL_HANDLE;
+	uint32_t _transferFamilyIndex = 0;
+	uint32_t _graphicsFamilyIndex = 0;
+
+	VkCommandPool _transferCommandPool = VK_NULL_HANDLE;
+	VkCommandPool _graphicsCommandPool = VK_NULL_HANDLE;
+
+	std::deque<Batch> _batches;
+	uint64_t _nextTicket = 1;
+	uint64_t _completedTicket = 0;
+};
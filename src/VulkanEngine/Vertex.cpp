@@ -1,37 +1,242 @@
 #include "Vertex.h"
+#include <string.h>
+#include <cmath>
 
-VkVertexInputBindingDescription Vertex::getBindingDescription()
+static uint32_t GetPositionSize(VertexPositionFormat format)
+{
+	// Three 16 bit components aren't a required vertex format, the fourth one is padding
+	return format == VertexPositionFormat::Float32 ? 3 * sizeof(float) : 4 * sizeof(int16_t);
+}
+
+static uint32_t GetNormalSize(VertexNormalFormat format)
+{
+	switch (format)
+	{
+	case VertexNormalFormat::Float32:
+		return 3 * sizeof(float);
+	case VertexNormalFormat::Octahedral16:
+		return 2 * sizeof(int16_t);
+	default:
+		return 0;
+	}
+}
+
+static uint32_t GetTexCoordSize(VertexTexCoordFormat format)
+{
+	switch (format)
+	{
+	case VertexTexCoordFormat::Float32:
+		return 2 * sizeof(float);
+	case VertexTexCoordFormat::Unorm16:
+		return 2 * sizeof(uint16_t);
+	default:
+		return 0;
+	}
+}
+
+static glm::vec3 GetQuantizationExtent(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+	// A flat axis keeps a scale of 1 so the quantisation never divides by zero
+	glm::vec3 extent = (boundsMax - boundsMin) * 0.5f;
+	for (int i = 0; i < 3; i++)
+	{
+		extent[i] = extent[i] > 0.0f ? extent[i] : 1.0f;
+	}
+	return extent;
+}
+
+static int16_t QuantizeSnorm16(float value)
+{
+	return static_cast<int16_t>(std::round(glm::clamp(value, -1.0f, 1.0f) * 32767.0f));
+}
+
+static uint16_t QuantizeUnorm16(float value)
+{
+	return static_cast<uint16_t>(std::round(glm::clamp(value, 0.0f, 1.0f) * 65535.0f));
+}
+
+static glm::vec2 EncodeOctahedral(const glm::vec3& normal)
+{
+	float l1 = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+	if (l1 == 0.0f)
+	{
+		return glm::vec2(0.0f);
+	}
+	glm::vec3 n = normal / l1;
+	if (n.z >= 0.0f)
+	{
+		return glm::vec2(n.x, n.y);
+	}
+	// The lower hemisphere is folded over the diagonals
+	return glm::vec2((1.0f - std::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f), (1.0f - std::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f));
+}
+
+uint32_t VertexLayout::GetStride() const
+{
+	return GetPositionSize(position) + GetNormalSize(normal) + GetTexCoordSize(texCoord);
+}
+
+glm::mat4 VertexLayout::GetDequantization(const glm::vec3 & boundsMin, const glm::vec3 & boundsMax) const
+{
+	if (position == VertexPositionFormat::Float32)
+	{
+		return glm::mat4(1.0f);
+	}
+	glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+	return glm::scale(glm::translate(glm::mat4(1.0f), center), GetQuantizationExtent(boundsMin, boundsMax));
+}
+
+bool VertexLayout::Pack(const Vertex * vertices, size_t count, const glm::vec3 & boundsMin, const glm::vec3 & boundsMax, void * dst) const
+{
+	glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+	glm::vec3 extent = GetQuantizationExtent(boundsMin, boundsMax);
+	uint32_t stride = GetStride();
+	bool inRange = true;
+
+	char* out = static_cast<char*>(dst);
+	for (size_t i = 0; i < count; i++, out += stride)
+	{
+		const Vertex& vertex = vertices[i];
+		char* attribute = out;
+		if (position == VertexPositionFormat::Float32)
+		{
+			memcpy(attribute, &vertex.pos, 3 * sizeof(float));
+		}
+		else
+		{
+			glm::vec3 relative = (vertex.pos - center) / extent;
+			int16_t quantized[4] = { QuantizeSnorm16(relative.x), QuantizeSnorm16(relative.y), QuantizeSnorm16(relative.z), 0 };
+			memcpy(attribute, quantized, sizeof(quantized));
+		}
+		attribute += GetPositionSize(position);
+
+		if (normal == VertexNormalFormat::Float32)
+		{
+			memcpy(attribute, &vertex.normal, 3 * sizeof(float));
+		}
+		else if (normal == VertexNormalFormat::Octahedral16)
+		{
+			glm::vec2 encoded = EncodeOctahedral(vertex.normal);
+			int16_t quantized[2] = { QuantizeSnorm16(encoded.x), QuantizeSnorm16(encoded.y) };
+			memcpy(attribute, quantized, sizeof(quantized));
+		}
+		attribute += GetNormalSize(normal);
+
+		if (texCoord == VertexTexCoordFormat::Float32)
+		{
+			memcpy(attribute, &vertex.texCoord, 2 * sizeof(float));
+		}
+		else if (texCoord == VertexTexCoordFormat::Unorm16)
+		{
+			inRange = inRange && vertex.texCoord.x >= 0.0f && vertex.texCoord.x <= 1.0f && vertex.texCoord.y >= 0.0f && vertex.texCoord.y <= 1.0f;
+			uint16_t quantized[2] = { QuantizeUnorm16(vertex.texCoord.x), QuantizeUnorm16(vertex.texCoord.y) };
+			memcpy(attribute, quantized, sizeof(quantized));
+		}
+	}
+	return inRange;
+}
+
+VkVertexInputBindingDescription Vertex::getBindingDescription(const VertexLayout& layout)
 {
 	VkVertexInputBindingDescription bindingDescription = {};
 	bindingDescription.binding = 0;
-	bindingDescription.stride = sizeof(Vertex);
+	bindingDescription.stride = layout.GetStride();
 	bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
 
 	return bindingDescription;
 }
 
-std::array<VkVertexInputAttributeDescription, 3> Vertex::getAttributeDescriptions()
+std::vector<VkVertexInputAttributeDescription> Vertex::getAttributeDescriptions(const VertexLayout& layout)
 {
-	std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions = {};
-	attributeDescriptions[0].binding = 0;
-	attributeDescriptions[0].location = 0;
-	attributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-	attributeDescriptions[0].offset = offsetof(Vertex, pos);
+	std::vector<VkVertexInputAttributeDescription> attributeDescriptions;
+	uint32_t offset = 0;
+
+	VkVertexInputAttributeDescription position = {};
+	position.binding = 0;
+	position.location = 0;
+	position.format = layout.position == VertexPositionFormat::Float32 ? VK_FORMAT_R32G32B32_SFLOAT : VK_FORMAT_R16G16B16A16_SNORM;
+	position.offset = offset;
+	attributeDescriptions.push_back(position);
+	offset += GetPositionSize(layout.position);
 
-	attributeDescriptions[1].binding = 0;
-	attributeDescriptions[1].location = 1;
-	attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-	attributeDescriptions[1].offset = offsetof(Vertex, color);
+	if (layout.normal != VertexNormalFormat::None)
+	{
+		VkVertexInputAttributeDescription normal = {};
+		normal.binding = 0;
+		normal.location = 1;
+		normal.format = layout.normal == VertexNormalFormat::Float32 ? VK_FORMAT_R32G32B32_SFLOAT : VK_FORMAT_R16G16_SNORM;
+		normal.offset = offset;
+		attributeDescriptions.push_back(normal);
+		offset += GetNormalSize(layout.normal);
+	}
 
-	attributeDescriptions[2].binding = 0;
-	attributeDescriptions[2].location = 2;
-	attributeDescriptions[2].format = VK_FORMAT_R32G32_SFLOAT;
-	attributeDescriptions[2].offset = offsetof(Vertex, texCoord);
+	if (layout.texCoord != VertexTexCoordFormat::None)
+	{
+		VkVertexInputAttributeDescription texCoord = {};
+		texCoord.binding = 0;
+		texCoord.location = 2;
+		texCoord.format = layout.texCoord == VertexTexCoordFormat::Float32 ? VK_FORMAT_R32G32_SFLOAT : VK_FORMAT_R16G16_UNORM;
+		texCoord.offset = offset;
+		attributeDescriptions.push_back(texCoord);
+	}
 
 	return attributeDescriptions;
 }
 
 bool Vertex::operator==(const Vertex & other) const
 {
-	return pos == other.pos && color == other.color && texCoord == other.texCoord;
+	return pos == other.pos && normal == other.normal && texCoord == other.texCoord;
+}
+
+uint64_t HashVertex(const Vertex & vertex)
+{
+	static_assert(sizeof(Vertex) % sizeof(uint32_t) == 0, "Vertex is hashed in 32 bit words");
+	uint32_t words[sizeof(Vertex) / sizeof(uint32_t)];
+	memcpy(words, &vertex, sizeof(Vertex));
+
+	uint64_t hash = 0x9e3779b97f4a7c15ull;
+	for (uint32_t word : words)
+	{
+		// Every member is a float, -0.0 compares equal to 0.0 and has to hash the same
+		if (word == 0x80000000u)
+		{
+			word = 0;
+		}
+		hash = (hash ^ word) * 0xff51afd7ed558ccdull;
+		hash ^= hash >> 32;
+	}
+	hash ^= hash >> 33;
+	hash *= 0xc4ceb9fe1a85ec53ull;
+	hash ^= hash >> 33;
+	return hash;
+}
+
+VkVertexInputBindingDescription InstanceData::getBindingDescription()
+{
+	VkVertexInputBindingDescription bindingDescription = {};
+	bindingDescription.binding = 1;
+	bindingDescription.stride = sizeof(InstanceData);
+	bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+	return bindingDescription;
+}
+
+std::array<VkVertexInputAttributeDescription, 5> InstanceData::getAttributeDescriptions()
+{
+	// A mat4 attribute takes one location per column
+	std::array<VkVertexInputAttributeDescription, 5> attributeDescriptions = {};
+	for (uint32_t i = 0; i < 4; i++)
+	{
+		attributeDescriptions[i].binding = 1;
+		attributeDescriptions[i].location = 3 + i;
+		attributeDescriptions[i].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+		attributeDescriptions[i].offset = offsetof(InstanceData, model) + sizeof(glm::vec4) * i;
+	}
+
+	attributeDescriptions[4].binding = 1;
+	attributeDescriptions[4].location = 7;
+	attributeDescriptions[4].format = VK_FORMAT_R32_UINT;
+	attributeDescriptions[4].offset = offsetof(InstanceData, material);
+
+	return attributeDescriptions;
 }
@@ -7,18 +7,70 @@
 #include <glm/gtx/hash.hpp>
 #include <vulkan/vulkan.h>
 #include <array>
+#include <vector>
+
+struct Vertex;
+
+enum class VertexPositionFormat
+{
+	Float32,
+	// Relative to the mesh bounds, VertexLayout::GetDequantization maps it back
+	Snorm16,
+};
+
+enum class VertexNormalFormat
+{
+	None,
+	Float32,
+	// Octahedral encoding in two 16 bit snorm components
+	Octahedral16,
+};
+
+enum class VertexTexCoordFormat
+{
+	None,
+	Float32,
+	// Only for texture coordinates in [0, 1], anything outside is clamped. Opt in for meshes that don't tile
+	Unorm16,
+};
+
+// Format of the vertex buffer the shaders read. Attributes are packed in location order, position,
+// normal, texture coordinate, and attributes set to None take no space.
+struct VertexLayout
+{
+	VertexPositionFormat position = VertexPositionFormat::Snorm16;
+	VertexNormalFormat normal = VertexNormalFormat::None;
+	VertexTexCoordFormat texCoord = VertexTexCoordFormat::Float32;
+
+	uint32_t GetStride() const;
+	// Applied in front of the instance transform to undo position quantisation
+	glm::mat4 GetDequantization(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const;
+	// Writes count vertices of one mesh, GetStride() bytes each. Returns false if a value had to be clamped
+	bool Pack(const Vertex* vertices, size_t count, const glm::vec3& boundsMin, const glm::vec3& boundsMax, void* dst) const;
+};
 
 struct Vertex {
 	glm::vec3 pos;
-	glm::vec3 color;
+	glm::vec3 normal;
 	glm::vec2 texCoord;
-	static VkVertexInputBindingDescription getBindingDescription();
-	static std::array<VkVertexInputAttributeDescription, 3> getAttributeDescriptions();
+	static VkVertexInputBindingDescription getBindingDescription(const VertexLayout& layout);
+	static std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions(const VertexLayout& layout);
 	bool operator==(const Vertex& other) const;
 };
 
-struct UniformBufferObject {
+// 64 bit multiply-xorshift hash over the raw bytes of the vertex
+uint64_t HashVertex(const Vertex& vertex);
+
+// Also the layout of the visible instances cull.comp writes (std430)
+struct InstanceData {
 	glm::mat4 model;
+	uint32_t material;
+	uint32_t padding[3];
+	static VkVertexInputBindingDescription getBindingDescription();
+	static std::array<VkVertexInputAttributeDescription, 5> getAttributeDescriptions();
+};
+
+struct UniformBufferObject {
 	glm::mat4 view;
 	glm::mat4 proj;
 };
@@ -26,9 +78,7 @@ struct UniformBufferObject {
 namespace std {
 	template<> struct hash<Vertex> {
 		size_t operator()(Vertex const& vertex) const {
-			return ((hash<glm::vec3>()(vertex.pos) ^
-				(hash<glm::vec3>()(vertex.color) << 1)) >> 1) ^
-				(hash<glm::vec2>()(vertex.texCoord) << 1);
+			return static_cast<size_t>(HashVertex(vertex));
 		}
 	};
 }
\ No newline at end of file
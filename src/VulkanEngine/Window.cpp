@@ -1,57 +1,67 @@
 #include "Window.h"
+#include "UniformRingBuffer.h"
+#include "JobSystem.h"
+#include "FrameScheduler.h"
+#include <algorithm>
 
 Window::Window(Renderer* renderer, uint32_t size_x, uint32_t size_y, std::string name)
 {
 	_renderer = renderer;
+	_resources = renderer->GetSharedResources();
+	_framesInFlight = renderer->GetFramesInFlight();
 	_surface_size_x = size_x;
 	_surface_size_y = size_y;
 	_window_name = name;
-	_InitOSWindow();
-	_InitSurface();
-	_InitSwapchain();
-	_InitSwapchainImages();
-	_InitRenderPass();
-	_InitDescriptorSetLayout();
-	_InitGraphicsPipeline();
-	_InitCommandPool();
+	_headless = renderer->IsHeadless();
+	if (_headless)
+	{
+		_InitHeadlessTarget();
+	}
+	else
+	{
+		_InitOSWindow();
+		_InitSurface();
+		_InitSwapchain();
+		_InitSwapchainImages();
+	}
+	// Windows with the same surface format share the render pass and the pipeline
+	_renderPass = _resources->GetRenderPass(_surfaceFormat.format, !_headless);
 	_InitColorResources();
 	_InitDepthStencilImage();
 	_InitFramebuffers();
-	_InitTextureImage();
-	_InitTextureImageView();
-	_InitTextureSampler();
-	_LoadModel();
-	_InitVertexBuffers();
-	_InitIndexBuffers();
 	_InitUniformBuffers();
+	_InitInstanceBuffers();
 	_InitDescriptorPool();
 	_InitDescriptorSets();
-	_InitCommandBuffers();
+	_InitCullDescriptorSets();
+	_InitTimestampQueries();
 	_InitSyncObjects();
 }
 
 Window::~Window()
 {
+	// Torn down by the Renderer with the device idle, nothing is deferred any more
 	_DeInitSyncObjects();
-	_DeInitCommandBuffers();
+	_DeInitTimestampQueries();
+	_DeInitCullBuffers();
+	_DeInitCullDescriptorSets();
 	_DeInitDescriptorPool();
+	_DeInitInstanceBuffers();
 	_DeInitUniformBuffers();
-	_DeInitIndexBuffers();
-	_DeInitVertexBuffers();
-	_DeInitTextureSampler();
-	_DeInitTextureImageView();
-	_DeInitTextureImage();
 	_DeInitFramebuffers();
 	_DeInitDepthStencilImage();
 	_DeInitColorResources();
-	_DeInitCommandPool();
-	_DeInitGraphicsPipeline();
-	_DeInitDescriptorSetLayout();
-	_DeInitRenderPass();
-	_DeInitSwapchainImages();
-	_DeInitSwapchain();
-	_DeInitSurface();
-	_DeInitOSWindow();
+	if (_headless)
+	{
+		_DeInitHeadlessTarget();
+	}
+	else
+	{
+		_DeInitSwapchainImages();
+		_DeInitSwapchain();
+		_DeInitSurface();
+		_DeInitOSWindow();
+	}
 }
 
 void Window::Close()
@@ -61,67 +71,144 @@ void Window::Close()
 
 bool Window::Update()
 {
-	_UpdateOSWindow();
+	if (!_headless)
+	{
+		_UpdateOSWindow();
+	}
 	return _windowShouldRun;
 }
 
-void Window::DrawFrame()
+float Window::_GetMaxTexturePixels() const
 {
-	vkWaitForFences(_renderer->GetVulkanDevice(), 1, &_inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
-	vkResetFences(_renderer->GetVulkanDevice(), 1, &_inFlightFences[currentFrame]);
-
-	uint32_t imageIndex;
-	VkResult result = vkAcquireNextImageKHR(_renderer->GetVulkanDevice(), _swapchain, UINT64_MAX, _imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+	// Called before the frame is culled, so this is the size in the last frame the window drew
+	float maxPixels = 0.0f;
+	if (_resources->GetGpuCulling())
+	{
+		// Written by the cull pass of the last frame in this slot, which BeginFrame has waited for
+		if (_cullCounterBuffer != VK_NULL_HANDLE)
+		{
+			uint32_t frame = _renderer->GetFrameScheduler()->GetFrameIndex();
+			GpuCullCounters counters;
+			memcpy(&counters, static_cast<const char*>(_cullCounterBufferMemory.mapped) + _cullCounterSegmentSize * frame, sizeof(counters));
+			memcpy(&maxPixels, &counters.maxPixels, sizeof(maxPixels));
+		}
+		return maxPixels;
+	}
 
-	if (result == VK_ERROR_OUT_OF_DATE_KHR) {
-		_ReInitSwapChain();
-		return;
+	// Assuming the texture covers each mesh about once, the largest instance on screen decides the mip needed.
+	// Instances added since the last cull are left for the next frame
+	const Scene& scene = *_resources->GetScene();
+	const std::vector<Mesh>& meshes = scene.GetMeshes();
+	InstanceHandle instanceCount = static_cast<InstanceHandle>(std::min<size_t>(scene.GetInstanceCount(), _instanceSpheres.count));
+	for (InstanceHandle instance = 0; instance < instanceCount; instance++)
+	{
+		const Mesh& mesh = meshes[scene.GetInstanceMesh(instance)];
+		if (mesh.indexCount == 0)
+		{
+			continue;
+		}
+		maxPixels = std::max(maxPixels, glm::length(mesh.boundsMax - mesh.boundsMin) * _GetPixelsPerUnit(instance));
 	}
-	else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
-		throw std::runtime_error("failed to acquire swap chain image!");
+	return maxPixels;
+}
+
+bool Window::_AcquireImage()
+{
+	currentFrame = _renderer->GetFrameScheduler()->GetFrameIndex();
+	_acquireStart = std::chrono::high_resolution_clock::now();
+	_ReadTimestampQueries();
+	if (_headless)
+	{
+		// Headless targets are indexed by frame in flight, so the scheduler's BeginFrame also guards the image
+		_imageIndex = static_cast<uint32_t>(currentFrame);
 	}
+	else
+	{
+		VkResult result = vkAcquireNextImageKHR(_renderer->GetVulkanDevice(), _swapchain, UINT64_MAX, _imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &_imageIndex);
 
-	_UpdateUniformBuffers(imageIndex);
-	VkSubmitInfo submitInfo = {};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		// Nothing waits on the semaphore, the window draws again next frame
+		if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+			_ReInitSwapChain();
+			return false;
+		}
+		else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+			throw std::runtime_error("failed to acquire swap chain image!");
+		}
+	}
+	_frameTimings.acquireMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - _acquireStart).count();
+	return true;
+}
 
-	VkSemaphore waitSemaphores[] = { _imageAvailableSemaphores[currentFrame] };
-	VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-	submitInfo.waitSemaphoreCount = 1;
-	submitInfo.pWaitSemaphores = waitSemaphores;
-	submitInfo.pWaitDstStageMask = waitStages;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &_commandBuffers[imageIndex];
-	VkSemaphore signalSemaphores[] = { _renderFinishedSemaphores[currentFrame] };
-	submitInfo.signalSemaphoreCount = 1;
-	submitInfo.pSignalSemaphores = signalSemaphores;
-	ErrorCheck(vkQueueSubmit(_renderer->GetVulkanQueue(), 1, &submitInfo, _inFlightFences[currentFrame]));
+VkCommandBuffer Window::_RecordFrame()
+{
+	_SyncBuffers();
+	if (!_resources->GetGpuCulling())
+	{
+		_CullInstances();
+		_UpdateLods();
+	}
+	else
+	{
+		_frameTimings.cullMs = 0.0;
+	}
 
-	VkPresentInfoKHR presentInfo = {};
-	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+	auto updateUniformBuffersStart = std::chrono::high_resolution_clock::now();
+	uint32_t uniformOffset = _UpdateUniformBuffers();
+	_UpdateInstanceBuffers();
+	auto recordStart = std::chrono::high_resolution_clock::now();
+	_frameTimings.updateUniformBuffersMs = std::chrono::duration<double, std::milli>(recordStart - updateUniformBuffersStart).count();
 
-	presentInfo.waitSemaphoreCount = 1;
-	presentInfo.pWaitSemaphores = signalSemaphores;
+	VkCommandBuffer commandBuffer = _RecordCommandBuffer(_imageIndex, uniformOffset);
+	_frameTimestampsWritten[currentFrame] = _timestampQueryPool != VK_NULL_HANDLE;
+	_frameTimings.recordMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - recordStart).count();
+	return commandBuffer;
+}
 
-	VkSwapchainKHR swapChains[] = { _swapchain };
-	presentInfo.swapchainCount = 1;
-	presentInfo.pSwapchains = swapChains;
-	presentInfo.pImageIndices = &imageIndex;
+void Window::_EndFrame(VkResult presentResult, std::chrono::high_resolution_clock::time_point presentEnd)
+{
+	if (_headless)
+	{
+		_frameTimings.acquireToPresentMs = 0.0;
+		return;
+	}
 
-	result = vkQueuePresentKHR(_renderer->GetVulkanQueue(), &presentInfo);
+	_frameTimings.acquireToPresentMs = std::chrono::duration<double, std::milli>(presentEnd - _acquireStart).count();
+	if (_renderer->GetWaitForPresent() != nullptr)
+	{
+		PendingPresent pending;
+		pending.presentId = _presentId;
+		pending.acquireStart = _acquireStart;
+		pending.inputSample = _inputSampleTime;
+		_pendingPresents.push_back(pending);
+	}
 
-	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || framebufferResized) {
+	if (presentResult == VK_ERROR_OUT_OF_DATE_KHR || presentResult == VK_SUBOPTIMAL_KHR || framebufferResized) {
 		framebufferResized = false;
 		_ReInitSwapChain();
 	}
-	else if (result != VK_SUCCESS) {
+	else if (presentResult != VK_SUCCESS) {
 		throw std::runtime_error("failed to present swap chain image!");
 	}
+}
 
-	//vkQueueWaitIdle(_renderer->GetVulkanQueue());
-
-	currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
-
+void Window::_SyncBuffers()
+{
+	// Frames still in flight read the old buffers, they are retired with them
+	if (_resources->GetScene()->GetInstanceCount() > _instanceCapacity)
+	{
+		_DeInitInstanceBuffers();
+		_InitInstanceBuffers();
+	}
+	if (_resources->GetCullBufferVersion() != _sharedCullBufferVersion)
+	{
+		_DeInitCullBuffers();
+		if (_resources->GetDrawTemplateCount() > 0)
+		{
+			_InitCullBuffers();
+		}
+		_sharedCullBufferVersion = _resources->GetCullBufferVersion();
+		_cullBufferVersion++;
+	}
 }
 
 void Window::_InitSurface()
@@ -138,12 +225,7 @@ void Window::_InitSurface()
 		std::exit(-1);
 	}
 
-
-	vkGetPhysicalDeviceSurfaceCapabilitiesKHR(_renderer->GetVulkanPhysicalDevice(), _surface, &_surfaceCapabilites);
-	if (_surfaceCapabilites.currentExtent.width < UINT32_MAX) {
-		_surface_size_x = _surfaceCapabilites.currentExtent.width;
-		_surface_size_y = _surfaceCapabilites.currentExtent.height;
-	}
+	_UpdateSurfaceCapabilities();
 
 	{
 		uint32_t formatCount = 0;
@@ -173,23 +255,69 @@ void Window::_DeInitSurface()
 	vkDestroySurfaceKHR( _renderer->GetVulkanInstance(), _surface, nullptr );
 }
 
-void Window::_InitSwapchain()
+void Window::_UpdateSurfaceCapabilities()
 {
-	if (_swapchainImageCount < _surfaceCapabilites.minImageCount + 1) _swapchainImageCount = _surfaceCapabilites.minImageCount + 1;
-	if (_surfaceCapabilites.maxImageCount > 0) {
-		if (_swapchainImageCount > _surfaceCapabilites.maxImageCount) _swapchainImageCount = _surfaceCapabilites.maxImageCount;
+	vkGetPhysicalDeviceSurfaceCapabilitiesKHR(_renderer->GetVulkanPhysicalDevice(), _surface, &_surfaceCapabilites);
+	if (_surfaceCapabilites.currentExtent.width < UINT32_MAX) {
+		_surface_size_x = _surfaceCapabilites.currentExtent.width;
+		_surface_size_y = _surfaceCapabilites.currentExtent.height;
 	}
+}
 
-	VkPresentModeKHR present_mode = VK_PRESENT_MODE_FIFO_KHR;
+void Window::_InitSwapchain()
+{
+	std::vector<VkPresentModeKHR> present_mode_list;
 	{
 		uint32_t present_mode_count = 0;
 		ErrorCheck(vkGetPhysicalDeviceSurfacePresentModesKHR(_renderer->GetVulkanPhysicalDevice(), _surface, &present_mode_count, nullptr));
-		std::vector<VkPresentModeKHR> present_mode_list(present_mode_count);
+		present_mode_list.resize(present_mode_count);
 		ErrorCheck(vkGetPhysicalDeviceSurfacePresentModesKHR(_renderer->GetVulkanPhysicalDevice(), _surface, &present_mode_count, present_mode_list.data()));
-		for (auto m : present_mode_list) {
-			if (m == VK_PRESENT_MODE_MAILBOX_KHR) present_mode = m;
+	}
+	auto supportsPresentMode = [&](VkPresentModeKHR mode)
+	{
+		return std::find(present_mode_list.begin(), present_mode_list.end(), mode) != present_mode_list.end();
+	};
+
+	// FIFO is the one mode every surface has. One image beyond the minimum lets the CPU work on the next
+	// frame while the others are queued or on screen
+	VkPresentModeKHR present_mode = VK_PRESENT_MODE_FIFO_KHR;
+	_swapchainImageCount = _surfaceCapabilites.minImageCount + 1;
+	switch (_presentPolicy)
+	{
+	case PresentPolicy::LowLatency:
+		// Mailbox shows the newest finished frame at the next vblank, without it every extra FIFO image is a
+		// frame of queueing
+		if (supportsPresentMode(VK_PRESENT_MODE_MAILBOX_KHR))
+		{
+			present_mode = VK_PRESENT_MODE_MAILBOX_KHR;
+		}
+		else
+		{
+			_swapchainImageCount = std::max(_surfaceCapabilites.minImageCount, 2u);
+		}
+		break;
+	case PresentPolicy::Vsync:
+		break;
+	case PresentPolicy::Uncapped:
+		if (supportsPresentMode(VK_PRESENT_MODE_IMMEDIATE_KHR))
+		{
+			present_mode = VK_PRESENT_MODE_IMMEDIATE_KHR;
 		}
+		else if (supportsPresentMode(VK_PRESENT_MODE_MAILBOX_KHR))
+		{
+			present_mode = VK_PRESENT_MODE_MAILBOX_KHR;
+		}
+		else
+		{
+			std::cout << "No uncapped present mode, presenting with FIFO" << std::endl;
+		}
+		break;
+	}
+	if (_surfaceCapabilites.maxImageCount > 0 && _swapchainImageCount > _surfaceCapabilites.maxImageCount)
+	{
+		_swapchainImageCount = _surfaceCapabilites.maxImageCount;
 	}
+	_presentMode = present_mode;
 
 	VkCompositeAlphaFlagBitsKHR surfaceComposite =
 		(_surfaceCapabilites.supportedCompositeAlpha & VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR)
@@ -217,9 +345,23 @@ void Window::_InitSwapchain()
 	swapchainCreateInfo.compositeAlpha = surfaceComposite;
 	swapchainCreateInfo.presentMode = present_mode;
 	swapchainCreateInfo.clipped = VK_TRUE;
-	swapchainCreateInfo.oldSwapchain = VK_NULL_HANDLE;
+	// Handing over the old swapchain lets the driver reuse its resources and keep presenting while we rebuild
+	swapchainCreateInfo.oldSwapchain = _swapchain;
 
+	VkSwapchainKHR oldSwapchain = _swapchain;
 	ErrorCheck(vkCreateSwapchainKHR(_renderer->GetVulkanDevice(), &swapchainCreateInfo, nullptr, &_swapchain));
+	if (oldSwapchain != VK_NULL_HANDLE)
+	{
+		// Frames in flight may still render to its images
+		VkDevice device = _renderer->GetVulkanDevice();
+		_renderer->DestroyDeferred([device, oldSwapchain]()
+		{
+			vkDestroySwapchainKHR(device, oldSwapchain, nullptr);
+		});
+	}
+	// Present ids only mean something to the swapchain they were presented to
+	_swapchainFirstPresentId = _presentId + 1;
+	_pendingPresents.clear();
 
 	ErrorCheck(vkGetSwapchainImagesKHR(_renderer->GetVulkanDevice(), _swapchain, &_swapchainImageCount, nullptr));
 }
@@ -227,6 +369,50 @@ void Window::_InitSwapchain()
 void Window::_DeInitSwapchain()
 {
 	vkDestroySwapchainKHR(_renderer->GetVulkanDevice(), _swapchain, nullptr);
+	_swapchain = VK_NULL_HANDLE;
+	_pendingPresents.clear();
+}
+
+void Window::_WaitForPresents()
+{
+	_frameTimings.presentWaitMs = 0.0;
+	_frameTimings.acquireToDisplayMs = -1.0;
+	_frameTimings.inputToDisplayMs = -1.0;
+	PFN_vkWaitForPresentKHR waitForPresent = _renderer->GetWaitForPresent();
+	if (_headless || waitForPresent == nullptr || _swapchain == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	auto waitStart = std::chrono::high_resolution_clock::now();
+	if (_presentPolicy == PresentPolicy::LowLatency && _presentId >= _swapchainFirstPresentId + LOW_LATENCY_QUEUED_PRESENTS)
+	{
+		// Timeouts and an out of date swapchain are left to the next acquire
+		VkResult result = waitForPresent(_renderer->GetVulkanDevice(), _swapchain, _presentId - LOW_LATENCY_QUEUED_PRESENTS, PRESENT_WAIT_TIMEOUT_NS);
+		if (result != VK_SUCCESS && result != VK_TIMEOUT && result != VK_SUBOPTIMAL_KHR && result != VK_ERROR_OUT_OF_DATE_KHR)
+		{
+			ErrorCheck(result);
+		}
+	}
+	_frameTimings.presentWaitMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - waitStart).count();
+
+	// Presents complete in order. Ones nobody waited on are only seen here, so their latency is rounded up to
+	// the start of the next frame
+	while (!_pendingPresents.empty())
+	{
+		VkResult result = waitForPresent(_renderer->GetVulkanDevice(), _swapchain, _pendingPresents.front().presentId, 0);
+		if (result == VK_TIMEOUT)
+		{
+			break;
+		}
+		if (result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR)
+		{
+			auto displayed = std::chrono::high_resolution_clock::now();
+			_frameTimings.acquireToDisplayMs = std::chrono::duration<double, std::milli>(displayed - _pendingPresents.front().acquireStart).count();
+			_frameTimings.inputToDisplayMs = std::chrono::duration<double, std::milli>(displayed - _pendingPresents.front().inputSample).count();
+		}
+		_pendingPresents.pop_front();
+	}
 }
 
 void Window::_InitSwapchainImages()
@@ -237,16 +423,50 @@ void Window::_InitSwapchainImages()
 
 	for (uint32_t i = 0; i < _swapchainImageCount; i++)
 	{
-		_swapchainImageViews[i] = _CreateImageView(_swapchainImages[i], _surfaceFormat.format, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+		_swapchainImageViews[i] = _resources->CreateImageView(_swapchainImages[i], _surfaceFormat.format, VK_IMAGE_ASPECT_COLOR_BIT, 1);
 
 	}
 }
 
 void Window::_DeInitSwapchainImages()
 {
-	for (auto view : _swapchainImageViews)
+	VkDevice device = _renderer->GetVulkanDevice();
+	std::vector<VkImageView> views;
+	views.swap(_swapchainImageViews);
+	_renderer->DestroyDeferred([device, views]()
 	{
-		vkDestroyImageView(_renderer->GetVulkanDevice(), view, nullptr);
+		for (auto view : views)
+		{
+			vkDestroyImageView(device, view, nullptr);
+		}
+	});
+}
+
+void Window::_InitHeadlessTarget()
+{
+	// Engine owned color images stand in for the swapchain, one per frame in flight
+	_surfaceFormat.format = VK_FORMAT_R8G8B8A8_UNORM;
+	_surfaceFormat.colorSpace = VK_COLORSPACE_SRGB_NONLINEAR_KHR;
+	_swapchainImageCount = _framesInFlight;
+
+	_swapchainImages.resize(_swapchainImageCount);
+	_swapchainImageViews.resize(_swapchainImageCount);
+	_headlessImagesMemory.resize(_swapchainImageCount);
+
+	for (uint32_t i = 0; i < _swapchainImageCount; i++)
+	{
+		_resources->CreateImage(_surface_size_x, _surface_size_y, 1, VK_SAMPLE_COUNT_1_BIT, _surfaceFormat.format, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _swapchainImages[i], _headlessImagesMemory[i]);
+		_swapchainImageViews[i] = _resources->CreateImageView(_swapchainImages[i], _surfaceFormat.format, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+	}
+}
+
+void Window::_DeInitHeadlessTarget()
+{
+	for (uint32_t i = 0; i < _swapchainImageCount; i++)
+	{
+		vkDestroyImageView(_renderer->GetVulkanDevice(), _swapchainImageViews[i], nullptr);
+		vkDestroyImage(_renderer->GetVulkanDevice(), _swapchainImages[i], nullptr);
+		_renderer->GetMemoryAllocator()->Free(_headlessImagesMemory[i]);
 	}
 }
 
@@ -254,48 +474,20 @@ void Window::_InitColorResources()
 {
 	VkFormat colorFormat = _surfaceFormat.format;
 
-	_CreateImage(_surface_size_x, _surface_size_y, 1, _renderer->GetMaxSampleCount(), colorFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _colorImage, _colorImageMemory);
-	_colorImageView = _CreateImageView(_colorImage, colorFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+	_resources->CreateImage(_surface_size_x, _surface_size_y, 1, _renderer->GetMaxSampleCount(), colorFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _colorImage, _colorImageMemory);
+	_colorImageView = _resources->CreateImageView(_colorImage, colorFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1);
 
-	_TransitionImageLayout(_colorImage, colorFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, 1);
+	_resources->TransitionImageLayout(_colorImage, colorFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, 1);
 }
 
 void Window::_DeInitColorResources()
 {
-	vkDestroyImageView(_renderer->GetVulkanDevice(), _colorImageView, nullptr);
-	vkDestroyImage(_renderer->GetVulkanDevice(), _colorImage, nullptr);
-	vkFreeMemory(_renderer->GetVulkanDevice(), _colorImageMemory, nullptr);
+	_resources->DestroyImageDeferred(_colorImage, _colorImageView, _colorImageMemory);
 }
 
 void Window::_InitDepthStencilImage()
 {
-	{
-		std::vector<VkFormat> try_formats{
-			VK_FORMAT_D32_SFLOAT_S8_UINT,
-			VK_FORMAT_D24_UNORM_S8_UINT,
-			VK_FORMAT_D16_UNORM_S8_UINT,
-			VK_FORMAT_D32_SFLOAT,
-			VK_FORMAT_D16_UNORM
-		};
-		for (auto f : try_formats) {
-			VkFormatProperties format_properties{};
-			vkGetPhysicalDeviceFormatProperties(_renderer->GetVulkanPhysicalDevice(), f, &format_properties);
-			if (format_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) {
-				_depthStencilFormat = f;
-				break;
-			}
-		}
-		if (_depthStencilFormat == VK_FORMAT_UNDEFINED) {
-			assert(0 && "Depth stencil format not selected.");
-			std::exit(-1);
-		}
-		if ((_depthStencilFormat == VK_FORMAT_D32_SFLOAT_S8_UINT) ||
-			(_depthStencilFormat == VK_FORMAT_D24_UNORM_S8_UINT) ||
-			(_depthStencilFormat == VK_FORMAT_D16_UNORM_S8_UINT) ||
-			(_depthStencilFormat == VK_FORMAT_S8_UINT)) {
-			_stencilAvailable = true;
-		}
-	}
+	_depthStencilFormat = _resources->GetDepthStencilFormat();
 	/*VkImageCreateInfo imageCreateInfo{};
 	imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
 	imageCreateInfo.flags = 0;
@@ -315,7 +507,7 @@ void Window::_InitDepthStencilImage()
 	imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 	vkCreateImage(_renderer->GetVulkanDevice(), &imageCreateInfo, nullptr, &_depthStencilImage);*/
 
-	_CreateImage(_surface_size_x, _surface_size_y, 1, _renderer->GetMaxSampleCount(), _depthStencilFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _depthStencilImage, _depthStencilImageMemory);
+	_resources->CreateImage(_surface_size_x, _surface_size_y, 1, _renderer->GetMaxSampleCount(), _depthStencilFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _depthStencilImage, _depthStencilImageMemory);
 
 	/*VkMemoryRequirements imageMemoryRequirements{};
 	vkGetImageMemoryRequirements(_renderer->GetVulkanDevice(), _depthStencilImage, &imageMemoryRequirements);
@@ -348,121 +540,13 @@ void Window::_InitDepthStencilImage()
 
 	vkCreateImageView(_renderer->GetVulkanDevice(), &imageViewCreateInfo, nullptr, &_depthStencilImageView);*/
 
-	_depthStencilImageView = _CreateImageView(_depthStencilImage, _depthStencilFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 1);
-	_TransitionImageLayout(_depthStencilImage, _depthStencilFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, 1);
+	_depthStencilImageView = _resources->CreateImageView(_depthStencilImage, _depthStencilFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 1);
+	_resources->TransitionImageLayout(_depthStencilImage, _depthStencilFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, 1);
 }
 
 void Window::_DeInitDepthStencilImage()
 {
-	vkDestroyImageView(_renderer->GetVulkanDevice(), _depthStencilImageView, nullptr);
-	vkFreeMemory(_renderer->GetVulkanDevice(), _depthStencilImageMemory, nullptr);
-	vkDestroyImage(_renderer->GetVulkanDevice(), _depthStencilImage, nullptr);
-}
-
-void Window::_InitRenderPass()
-{
-
-	std::array<VkAttachmentDescription, 3> attachments{};
-	attachments[0].flags = 0;
-	attachments[0].format = _surfaceFormat.format;
-	attachments[0].samples = _renderer->GetMaxSampleCount();
-	attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-	attachments[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	attachments[0].finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-	{
-		std::vector<VkFormat> try_formats{
-			VK_FORMAT_D32_SFLOAT_S8_UINT,
-			VK_FORMAT_D24_UNORM_S8_UINT,
-			VK_FORMAT_D16_UNORM_S8_UINT,
-			VK_FORMAT_D32_SFLOAT,
-			VK_FORMAT_D16_UNORM
-		};
-		for (auto f : try_formats) {
-			VkFormatProperties format_properties{};
-			vkGetPhysicalDeviceFormatProperties(_renderer->GetVulkanPhysicalDevice(), f, &format_properties);
-			if (format_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) {
-				_depthStencilFormat = f;
-				break;
-			}
-		}
-		if (_depthStencilFormat == VK_FORMAT_UNDEFINED) {
-			assert(0 && "Depth stencil format not selected.");
-			std::exit(-1);
-		}
-		if ((_depthStencilFormat == VK_FORMAT_D32_SFLOAT_S8_UINT) ||
-			(_depthStencilFormat == VK_FORMAT_D24_UNORM_S8_UINT) ||
-			(_depthStencilFormat == VK_FORMAT_D16_UNORM_S8_UINT) ||
-			(_depthStencilFormat == VK_FORMAT_S8_UINT)) {
-			_stencilAvailable = true;
-		}
-	}
-
-	attachments[1].flags = 0;
-	attachments[1].format = _depthStencilFormat;
-	attachments[1].samples = _renderer->GetMaxSampleCount();
-	attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	attachments[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-	attachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	attachments[1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-	VkAttachmentReference subPass0DepthStencilAttachment{};
-	subPass0DepthStencilAttachment.attachment = 1;
-	subPass0DepthStencilAttachment.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-	std::array<VkAttachmentReference, 1> subPass0ColorAttachments{};
-	subPass0ColorAttachments[0].attachment = 0;
-	subPass0ColorAttachments[0].layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-	VkAttachmentDescription colorAttachmentResolve = {};
-	colorAttachmentResolve.format = _surfaceFormat.format;
-	colorAttachmentResolve.samples = VK_SAMPLE_COUNT_1_BIT;
-	colorAttachmentResolve.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-	colorAttachmentResolve.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-	colorAttachmentResolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-	colorAttachmentResolve.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	colorAttachmentResolve.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	colorAttachmentResolve.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-
-	attachments[2] = colorAttachmentResolve;
-
-	VkAttachmentReference colorAttachmentResolveRef = {};
-	colorAttachmentResolveRef.attachment = 2;
-	colorAttachmentResolveRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-	std::array<VkSubpassDescription, 1> subPasses{};
-	subPasses[0].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-	subPasses[0].colorAttachmentCount = subPass0ColorAttachments.size();
-	subPasses[0].pColorAttachments = subPass0ColorAttachments.data();	
-	subPasses[0].pDepthStencilAttachment = &subPass0DepthStencilAttachment;
-	subPasses[0].pResolveAttachments = &colorAttachmentResolveRef;
-
-	VkSubpassDependency dependency = {};
-	dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-	dependency.dstSubpass = 0;
-	dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependency.srcAccessMask = 0;
-	dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-
-	VkRenderPassCreateInfo renderPassCreateInfo{};
-	renderPassCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-	renderPassCreateInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
-	renderPassCreateInfo.pAttachments = attachments.data();
-	renderPassCreateInfo.subpassCount = subPasses.size();
-	renderPassCreateInfo.pSubpasses = subPasses.data();
-	renderPassCreateInfo.dependencyCount = 1;
-	renderPassCreateInfo.pDependencies = &dependency;
-
-	ErrorCheck(vkCreateRenderPass(_renderer->GetVulkanDevice(), &renderPassCreateInfo, nullptr, &_renderPass));
-}
-
-void Window::_DeInitRenderPass()
-{
-	vkDestroyRenderPass(_renderer->GetVulkanDevice(), _renderPass, nullptr);
+	_resources->DestroyImageDeferred(_depthStencilImage, _depthStencilImageView, _depthStencilImageMemory);
 }
 
 void Window::_InitFramebuffers()
@@ -490,435 +574,348 @@ void Window::_InitFramebuffers()
 
 void Window::_DeInitFramebuffers()
 {
-	for (auto f : _framebuffers) {
-		vkDestroyFramebuffer(_renderer->GetVulkanDevice(), f, nullptr);
-	}
+	VkDevice device = _renderer->GetVulkanDevice();
+	std::vector<VkFramebuffer> framebuffers;
+	framebuffers.swap(_framebuffers);
+	_renderer->DestroyDeferred([device, framebuffers]()
+	{
+		for (auto f : framebuffers) {
+			vkDestroyFramebuffer(device, f, nullptr);
+		}
+	});
 }
 
-void Window::_InitDescriptorSetLayout()
+void Window::_GetViewProjection(glm::mat4 & view, glm::mat4 & proj) const
 {
-	VkDescriptorSetLayoutBinding uboLayoutBinding = {};
-	uboLayoutBinding.binding = 0;
-	uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	uboLayoutBinding.descriptorCount = 1;
-	uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-	uboLayoutBinding.pImmutableSamplers = nullptr; // Optional
+	view = glm::lookAt(_cameraEye, _cameraTarget, glm::vec3(0.0f, 0.0f, 1.0f));
 
-	VkDescriptorSetLayoutBinding samplerLayoutBinding = {};
-	samplerLayoutBinding.binding = 1;
-	samplerLayoutBinding.descriptorCount = 1;
-	samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	samplerLayoutBinding.pImmutableSamplers = nullptr;
-	samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	proj = glm::perspective(glm::radians(CAMERA_FOV_Y_DEGREES), _surface_size_x / (float)_surface_size_y, CAMERA_NEAR_PLANE, _cameraFarPlane);
 
-	std::array<VkDescriptorSetLayoutBinding, 2> bindings = { uboLayoutBinding, samplerLayoutBinding };
-
-	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
-	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-	layoutInfo.bindingCount = static_cast<uint32_t> (bindings.size());
-	layoutInfo.pBindings = bindings.data();
-
-	ErrorCheck(vkCreateDescriptorSetLayout(_renderer->GetVulkanDevice(), &layoutInfo, nullptr, &_descriptorSetLayout));
-
-	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
-	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	pipelineLayoutInfo.setLayoutCount = 1;
-	pipelineLayoutInfo.pSetLayouts = &_descriptorSetLayout;
+	proj[1][1] *= -1;
 }
 
-void Window::_DeInitDescriptorSetLayout()
+void Window::_CullInstances()
 {
-	vkDestroyDescriptorSetLayout(_renderer->GetVulkanDevice(), _descriptorSetLayout, nullptr);
-}
-
-void Window::_InitGraphicsPipeline()
-{
-	auto vertShaderCode = readFile("shaders/vert.spv");
-	auto fragShaderCode = readFile("shaders/frag.spv");
-
-	_vertShaderModule = _CreateShaderModule(vertShaderCode);
-	_fragShaderModule = _CreateShaderModule(fragShaderCode);
-
-	VkPipelineShaderStageCreateInfo vertShaderStageInfo = {};
-	vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-	vertShaderStageInfo.module = _vertShaderModule;
-	vertShaderStageInfo.pName = "main";
-
-	VkPipelineShaderStageCreateInfo fragShaderStageInfo = {};
-	fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-	fragShaderStageInfo.module = _fragShaderModule;
-	fragShaderStageInfo.pName = "main";
-
-	VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
-
-	auto bindingDescription = Vertex::getBindingDescription();
-	auto attributeDescriptions = Vertex::getAttributeDescriptions();
-
-	VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
-	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	vertexInputInfo.vertexBindingDescriptionCount = 1;
-	vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
-	vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-	vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
-
-	VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
-	inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-	inputAssembly.primitiveRestartEnable = VK_FALSE;
-
-	viewport.x = 0.0f;
-	viewport.y = 0.0f;
-	viewport.width = (float)_surface_size_x;
-	viewport.height = (float)_surface_size_y;
-	viewport.minDepth = 0.0f;
-	viewport.maxDepth = 1.0f;
-
+	auto cullStart = std::chrono::high_resolution_clock::now();
+	Scene& scene = *_resources->GetScene();
 
-	VkRect2D scissor = {};
-	scissor.offset = { 0, 0 };
-	scissor.extent = { _surface_size_x, _surface_size_y};
-
-	VkPipelineViewportStateCreateInfo viewportState = {};
-	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-	viewportState.viewportCount = 1;
-	viewportState.pViewports = &viewport;
-	viewportState.scissorCount = 1;
-	viewportState.pScissors = &scissor;
-
-	VkPipelineRasterizationStateCreateInfo rasterizer = {};
-	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-	rasterizer.depthClampEnable = VK_FALSE;
-	rasterizer.rasterizerDiscardEnable = VK_FALSE;
-	rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-	rasterizer.lineWidth = 1.0f;
-	rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-	rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-	rasterizer.depthBiasEnable = VK_FALSE;
-
-	VkPipelineMultisampleStateCreateInfo multisampling = {};
-	multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-	multisampling.sampleShadingEnable = VK_TRUE; // enable sample shading in the pipeline
-	multisampling.minSampleShading = .2f; // min fraction for sample shading; closer to one is smoother
-	multisampling.rasterizationSamples = _renderer->GetMaxSampleCount();
-
-	VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
-	colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-	colorBlendAttachment.blendEnable = VK_FALSE;
-
-	VkPipelineColorBlendStateCreateInfo colorBlending = {};
-	colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-	colorBlending.logicOpEnable = VK_FALSE;
-	colorBlending.attachmentCount = 1;
-	colorBlending.pAttachments = &colorBlendAttachment;
-
-	VkDynamicState dynamicStates[] = {
-	VK_DYNAMIC_STATE_VIEWPORT,
-	VK_DYNAMIC_STATE_LINE_WIDTH,
-	VK_DYNAMIC_STATE_SCISSOR
-	};
-
-	VkPipelineDynamicStateCreateInfo dynamicState = {};
-	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-	dynamicState.dynamicStateCount = 3;
-	dynamicState.pDynamicStates = dynamicStates;
-
-
-	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
-	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	pipelineLayoutInfo.setLayoutCount = 1; 
-	pipelineLayoutInfo.pSetLayouts = &_descriptorSetLayout;
-	pipelineLayoutInfo.pushConstantRangeCount = 0; // Optional
-	pipelineLayoutInfo.pPushConstantRanges = nullptr; // Optional
-
-	if (vkCreatePipelineLayout(_renderer->GetVulkanDevice(), &pipelineLayoutInfo, nullptr, &_pipelineLayout) != VK_SUCCESS) {
-		throw std::runtime_error("failed to create pipeline layout!");
-	}
+	// World space bounding spheres of every instance, computed in parallel blocks that are a multiple of the SIMD width
+	const std::vector<Mesh>& meshes = scene.GetMeshes();
+	uint32_t instanceCount = scene.GetInstanceCount();
+	_instanceSpheres.Resize(instanceCount);
+	uint32_t blockCount = (instanceCount + CULLING_BLOCK_SIZE - 1) / CULLING_BLOCK_SIZE;
+	_renderer->GetJobSystem()->ParallelFor(blockCount, [&](uint32_t block, uint32_t /*worker*/)
+	{
+		uint32_t end = std::min((block + 1) * CULLING_BLOCK_SIZE, instanceCount);
+		for (InstanceHandle instance = block * CULLING_BLOCK_SIZE; instance < end; instance++)
+		{
+			const Mesh& mesh = meshes[scene.GetInstanceMesh(instance)];
+			const glm::mat4& transform = scene.GetInstanceTransform(instance);
+			glm::vec3 center = glm::vec3(transform * glm::vec4((mesh.boundsMin + mesh.boundsMax) * 0.5f, 1.0f));
+			float scale = std::max(glm::length(glm::vec3(transform[0])), std::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+			_instanceSpheres.Set(instance, center, glm::length(mesh.boundsMax - mesh.boundsMin) * 0.5f * scale);
+		}
+	});
 
-	VkPipelineDepthStencilStateCreateInfo pipelineDepthStencilInfo{};
-	pipelineDepthStencilInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-	pipelineDepthStencilInfo.depthTestEnable = VK_TRUE;
-	pipelineDepthStencilInfo.depthWriteEnable = VK_TRUE;
-	pipelineDepthStencilInfo.depthCompareOp = VK_COMPARE_OP_LESS;
-	pipelineDepthStencilInfo.depthBoundsTestEnable = VK_FALSE;
-	pipelineDepthStencilInfo.minDepthBounds = 0.0f; // Optional
-	pipelineDepthStencilInfo.maxDepthBounds = 1.0f; // Optional
-	pipelineDepthStencilInfo.stencilTestEnable = VK_FALSE;
-	pipelineDepthStencilInfo.front = {}; // Optional
-	pipelineDepthStencilInfo.back = {}; // Optional
-
-	VkGraphicsPipelineCreateInfo pipelineInfo = {};
-	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-	pipelineInfo.stageCount = 2;
-	pipelineInfo.pStages = shaderStages;
-	pipelineInfo.pVertexInputState = &vertexInputInfo;
-	pipelineInfo.pInputAssemblyState = &inputAssembly;
-	pipelineInfo.pViewportState = &viewportState;
-	pipelineInfo.pRasterizationState = &rasterizer;
-	pipelineInfo.pMultisampleState = &multisampling;
-	pipelineInfo.pDepthStencilState = nullptr; // Optional
-	pipelineInfo.pColorBlendState = &colorBlending;
-	pipelineInfo.pDynamicState = nullptr; // Optional
-	pipelineInfo.layout = _pipelineLayout;
-	pipelineInfo.renderPass = _renderPass;
-	pipelineInfo.subpass = 0;
-	pipelineInfo.pDepthStencilState = &pipelineDepthStencilInfo;
-
-	if (vkCreateGraphicsPipelines(_renderer->GetVulkanDevice(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &_graphicsPipeline) != VK_SUCCESS) {
-		throw std::runtime_error("failed to create graphics pipeline!");
-	}
-}
+	glm::mat4 view, proj;
+	_GetViewProjection(view, proj);
+	_instanceVisibility.resize(instanceCount);
+	CullSpheres(ExtractFrustum(proj * view), _instanceSpheres, _instanceVisibility.data());
+	scene.SetInstanceVisibility(_instanceVisibility);
 
-void Window::_DeInitGraphicsPipeline()
-{
-	vkDestroyPipeline(_renderer->GetVulkanDevice(), _graphicsPipeline, nullptr);
-	vkDestroyPipelineLayout(_renderer->GetVulkanDevice(), _pipelineLayout, nullptr);
-	vkDestroyShaderModule(_renderer->GetVulkanDevice(), _fragShaderModule, nullptr);
-	vkDestroyShaderModule(_renderer->GetVulkanDevice(), _vertShaderModule, nullptr);
+	_frameTimings.cullMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - cullStart).count();
 }
 
-void Window::_InitCommandPool()
+float Window::_GetPixelsPerUnit(InstanceHandle instance) const
 {
-	VkCommandPoolCreateInfo poolInfo = {};
-	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-	poolInfo.queueFamilyIndex = _renderer->GetVulkanGraphicsQueueFamilyIndex();
-
-	ErrorCheck(vkCreateCommandPool(_renderer->GetVulkanDevice(), &poolInfo, nullptr, &_commandPool));
-
+	const Scene& scene = *_resources->GetScene();
+	const Mesh& mesh = scene.GetMeshes()[scene.GetInstanceMesh(instance)];
+	float meshRadius = glm::length(mesh.boundsMax - mesh.boundsMin) * 0.5f;
+	glm::vec3 center(_instanceSpheres.centerX[instance], _instanceSpheres.centerY[instance], _instanceSpheres.centerZ[instance]);
+	float radius = _instanceSpheres.radius[instance];
+	float scale = meshRadius > 0.0f ? radius / meshRadius : 1.0f;
+	float distance = std::max(glm::length(center - _cameraEye) - radius, CAMERA_NEAR_PLANE);
+	float tanHalfFov = std::tan(glm::radians(CAMERA_FOV_Y_DEGREES) * 0.5f);
+	return scale / (distance * tanHalfFov) * _surface_size_y * 0.5f;
 }
 
-void Window::_DeInitCommandPool()
+void Window::_UpdateLods()
 {
-	vkDestroyCommandPool(_renderer->GetVulkanDevice(), _commandPool, nullptr);
+	// The coarsest LOD whose error stays under LOD_PIXEL_ERROR at the near side of the bounding sphere
+	Scene& scene = *_resources->GetScene();
+	const std::vector<Mesh>& meshes = scene.GetMeshes();
+	for (InstanceHandle instance = 0; instance < scene.GetInstanceCount(); instance++)
+	{
+		const Mesh& mesh = meshes[scene.GetInstanceMesh(instance)];
+		if (mesh.lodCount <= 1 || !_instanceVisibility[instance])
+		{
+			continue;
+		}
+		float pixelsPerUnit = _GetPixelsPerUnit(instance);
+		uint32_t lod = 0;
+		while (lod + 1 < mesh.lodCount && mesh.lodErrors[lod + 1] * pixelsPerUnit <= LOD_PIXEL_ERROR)
+		{
+			lod++;
+		}
+		scene.SetInstanceLod(instance, lod);
+	}
 }
 
-void Window::_InitTextureImage()
+void Window::_SetFramesInFlight(uint32_t framesInFlight)
 {
-	int texWidth, texHeight, texChannels;
-	stbi_uc* pixels = stbi_load(TEXTURE_PATH.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-	mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(texWidth, texHeight)))) + 1;
-	VkDeviceSize imageSize = texWidth * texHeight * 4;
-
-	if (!pixels) {
-		throw std::runtime_error("failed to load texture image!");
+	// Called by the Renderer with the device idle. The GPU culling buffers follow on the next frame, the shared
+	// instance buffer they are sized with is rebuilt too
+	_DeInitSyncObjects();
+	_DeInitTimestampQueries();
+	_DeInitCullBuffers();
+	_DeInitCullDescriptorSets();
+	_DeInitDescriptorPool();
+	_DeInitInstanceBuffers();
+	_DeInitUniformBuffers();
+	if (_headless)
+	{
+		_DeInitFramebuffers();
+		_DeInitHeadlessTarget();
 	}
 
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	_CreateBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
-	void* data;
-	vkMapMemory(_renderer->GetVulkanDevice(), stagingBufferMemory, 0, imageSize, 0, &data);
-	memcpy(data, pixels, static_cast<size_t>(imageSize));
-	vkUnmapMemory(_renderer->GetVulkanDevice(), stagingBufferMemory);
-	stbi_image_free(pixels);
-
-	_CreateImage(texWidth, texHeight, mipLevels, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _textureImage, _textureImageMemory);
-	_TransitionImageLayout(_textureImage, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels);
-	_CopyBufferToImage(stagingBuffer, _textureImage, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight));
-	//_TransitionImageLayout(_textureImage, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, mipLevels);
-	_GenerateMipMaps(_textureImage, VK_FORMAT_R8G8B8A8_UNORM , texWidth, texHeight, mipLevels);
+	_framesInFlight = framesInFlight;
 
-	vkDestroyBuffer(_renderer->GetVulkanDevice(), stagingBuffer, nullptr);
-	vkFreeMemory(_renderer->GetVulkanDevice(), stagingBufferMemory, nullptr);
-	
-}
-
-void Window::_DeInitTextureImage()
-{
-	vkDestroyImage(_renderer->GetVulkanDevice(), _textureImage, nullptr);
-	vkFreeMemory(_renderer->GetVulkanDevice(), _textureImageMemory, nullptr);
+	if (_headless)
+	{
+		_InitHeadlessTarget();
+		_InitFramebuffers();
+	}
+	_InitUniformBuffers();
+	_InitInstanceBuffers();
+	_InitDescriptorPool();
+	_InitDescriptorSets();
+	_InitCullDescriptorSets();
+	_InitTimestampQueries();
+	_InitSyncObjects();
+	currentFrame = _renderer->GetFrameScheduler()->GetFrameIndex();
 }
 
-void Window::_InitTextureImageView()
+void Window::SetPresentPolicy(PresentPolicy policy)
 {
-	_textureImageView = _CreateImageView(_textureImage, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT, mipLevels);
+	_presentPolicy = policy;
+	if (!_headless)
+	{
+		_ReInitSwapChain();
+	}
 }
 
-void Window::_DeInitTextureImageView()
+PresentPolicy Window::GetPresentPolicy() const
 {
-	vkDestroyImageView(_renderer->GetVulkanDevice(), _textureImageView, nullptr);
+	return _presentPolicy;
 }
 
-void Window::_InitTextureSampler()
+void Window::_InitInstanceBuffers()
 {
-	VkSamplerCreateInfo samplerInfo = {};
-	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-	samplerInfo.magFilter = VK_FILTER_LINEAR;
-	samplerInfo.minFilter = VK_FILTER_LINEAR;
-	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-	samplerInfo.anisotropyEnable = VK_TRUE;
-	samplerInfo.maxAnisotropy = 16;
-	samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
-	samplerInfo.unnormalizedCoordinates = VK_FALSE;
-	samplerInfo.compareEnable = VK_FALSE;
-	samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
-	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-	samplerInfo.mipLodBias = 0.0f;
-	samplerInfo.minLod = 0.0f;
-	samplerInfo.maxLod = static_cast<float>(mipLevels);
+	// Grow in powers of two so adding instances one by one doesn't reallocate every frame
+	_instanceCapacity = 64;
+	while (_instanceCapacity < _resources->GetScene()->GetInstanceCount())
+	{
+		_instanceCapacity *= 2;
+	}
 
-	ErrorCheck(vkCreateSampler(_renderer->GetVulkanDevice(), &samplerInfo, nullptr, &_textureSampler));
+	// One segment per frame in flight, the command buffers of each frame bind their own segment
+	VkDeviceSize bufferSize = sizeof(InstanceData) * _instanceCapacity * _framesInFlight;
+	_resources->CreateBuffer(bufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, _instanceBuffer, _instanceBufferMemory);
 }
 
-void Window::_DeInitTextureSampler()
+void Window::_DeInitInstanceBuffers()
 {
-	vkDestroySampler(_renderer->GetVulkanDevice(), _textureSampler, nullptr);
+	_resources->DestroyBufferDeferred(_instanceBuffer, _instanceBufferMemory);
 }
 
-void Window::_LoadModel()
+void Window::_UpdateInstanceBuffers()
 {
-	tinyobj::attrib_t attrib;
-	std::vector<tinyobj::shape_t> shapes;
-	std::vector<tinyobj::material_t> materials;
-	std::string warn, err;
-
-	if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, MODEL_PATH.c_str())) {
-		throw std::runtime_error(warn + err);
+	// With GPU culling the shared resources write the instances once for every window
+	if (_resources->GetGpuCulling())
+	{
+		return;
 	}
+	InstanceData* instances = reinterpret_cast<InstanceData*>(static_cast<char*>(_instanceBufferMemory.mapped) + sizeof(InstanceData) * _instanceCapacity * currentFrame);
+	_resources->GetScene()->WriteInstanceData(instances, _resources->GetBindlessTextureCapacity(), _resources->GetMeshDequantizations());
+}
 
-	std::unordered_map<Vertex, uint32_t> uniqueVertices = {};
+void Window::_InitCullBuffers()
+{
+	// The outputs of the passes depend on the camera, the inputs are shared
+	VkDeviceSize alignment = _renderer->GetVulkanPhysicalDeviceProperties().limits.minStorageBufferOffsetAlignment;
+	auto alignSegment = [alignment](VkDeviceSize size) { return (size + alignment - 1) / alignment * alignment; };
+	_visibleInstanceSegmentSize = alignSegment(sizeof(InstanceData) * _resources->GetVisibleInstanceCapacity());
+	_drawCommandSegmentSize = alignSegment(sizeof(VkDrawIndexedIndirectCommand) * _resources->GetDrawTemplateCount());
+	_cullCounterSegmentSize = alignSegment(sizeof(GpuCullCounters) + sizeof(uint32_t) * _resources->GetCullGroupCount());
 
-	for (const auto& shape : shapes) {
-		for (const auto& index : shape.mesh.indices) {
-			Vertex vertex = {};
+	_resources->CreateBuffer(_visibleInstanceSegmentSize * _framesInFlight, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _visibleInstanceBuffer, _visibleInstanceBufferMemory);
+	_resources->CreateBuffer(_drawCommandSegmentSize * _framesInFlight, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _drawCommandBuffer, _drawCommandBufferMemory);
+	// Host visible so texture streaming can read back maxPixels
+	_resources->CreateBuffer(_cullCounterSegmentSize * _framesInFlight, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, _cullCounterBuffer, _cullCounterBufferMemory);
+	memset(_cullCounterBufferMemory.mapped, 0, _cullCounterSegmentSize * _framesInFlight);
+}
 
-			vertex.pos = {
-				attrib.vertices[3 * index.vertex_index + 0],
-				attrib.vertices[3 * index.vertex_index + 1],
-				attrib.vertices[3 * index.vertex_index + 2]
-			};
+void Window::_InitCullDescriptorSets()
+{
+	VkDescriptorPoolSize poolSize = {};
+	poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSize.descriptorCount = 6 * _framesInFlight;
 
-			vertex.texCoord = {
-				attrib.texcoords[2 * index.texcoord_index + 0],
-				1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
-			};
+	VkDescriptorPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.poolSizeCount = 1;
+	poolInfo.pPoolSizes = &poolSize;
+	poolInfo.maxSets = _framesInFlight;
 
-			vertex.color = { 1.0f, 1.0f, 1.0f };
+	ErrorCheck(vkCreateDescriptorPool(_renderer->GetVulkanDevice(), &poolInfo, nullptr, &_cullDescriptorPool));
 
-			if (uniqueVertices.count(vertex) == 0) {
-				uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
-				vertices.push_back(vertex);
-			}
+	_cullDescriptorSets.resize(_framesInFlight);
+	std::vector<VkDescriptorSetLayout> layouts(_framesInFlight, _resources->GetCullDescriptorSetLayout());
 
-			indices.push_back(uniqueVertices[vertex]);
+	VkDescriptorSetAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = _cullDescriptorPool;
+	allocInfo.descriptorSetCount = _framesInFlight;
+	allocInfo.pSetLayouts = layouts.data();
 
-		}
-	}
+	ErrorCheck(vkAllocateDescriptorSets(_renderer->GetVulkanDevice(), &allocInfo, _cullDescriptorSets.data()));
+	_cullDescriptorSetVersions.assign(_framesInFlight, UINT64_MAX);
 }
 
-void Window::_InitVertexBuffers()
+void Window::_DeInitCullDescriptorSets()
 {
-	VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
-
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-
-	_CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
-	
-	void* data;
-	vkMapMemory(_renderer->GetVulkanDevice(), stagingBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, vertices.data(), (size_t)bufferSize);
-	vkUnmapMemory(_renderer->GetVulkanDevice(), stagingBufferMemory);
-
-	_CreateBuffer(bufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, _vertexBuffer, _vertexBufferMemory);
-
-	_CopyBuffer(stagingBuffer, _vertexBuffer, bufferSize);
+	vkDestroyDescriptorPool(_renderer->GetVulkanDevice(), _cullDescriptorPool, nullptr);
+	_cullDescriptorPool = VK_NULL_HANDLE;
+	_cullDescriptorSets.clear();
+}
 
-	vkDestroyBuffer(_renderer->GetVulkanDevice(), stagingBuffer, nullptr);
-	vkFreeMemory(_renderer->GetVulkanDevice(), stagingBufferMemory, nullptr);
+void Window::_UpdateCullDescriptorSet(uint32_t frame)
+{
+	if (_cullDescriptorSetVersions[frame] == _cullBufferVersion)
+	{
+		return;
+	}
+	_cullDescriptorSetVersions[frame] = _cullBufferVersion;
+
+	VkDeviceSize instanceSegmentSize = _resources->GetGpuInstanceSegmentSize();
+	std::array<VkDescriptorBufferInfo, 6> bufferInfos = {};
+	bufferInfos[0] = { _resources->GetGpuInstanceBuffer(), instanceSegmentSize * frame, instanceSegmentSize };
+	bufferInfos[1] = { _resources->GetGpuMeshBuffer(), 0, VK_WHOLE_SIZE };
+	bufferInfos[2] = { _resources->GetDrawTemplateBuffer(), 0, VK_WHOLE_SIZE };
+	bufferInfos[3] = { _visibleInstanceBuffer, _visibleInstanceSegmentSize * frame, _visibleInstanceSegmentSize };
+	bufferInfos[4] = { _drawCommandBuffer, _drawCommandSegmentSize * frame, _drawCommandSegmentSize };
+	bufferInfos[5] = { _cullCounterBuffer, _cullCounterSegmentSize * frame, _cullCounterSegmentSize };
+
+	std::array<VkWriteDescriptorSet, 6> descriptorWrites = {};
+	for (uint32_t i = 0; i < descriptorWrites.size(); i++)
+	{
+		descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrites[i].dstSet = _cullDescriptorSets[frame];
+		descriptorWrites[i].dstBinding = i;
+		descriptorWrites[i].dstArrayElement = 0;
+		descriptorWrites[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptorWrites[i].descriptorCount = 1;
+		descriptorWrites[i].pBufferInfo = &bufferInfos[i];
+	}
+	vkUpdateDescriptorSets(_renderer->GetVulkanDevice(), static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
 }
 
-void Window::_DeInitVertexBuffers()
+void Window::_DeInitCullBuffers()
 {
-	vkDestroyBuffer(_renderer->GetVulkanDevice(), _vertexBuffer, nullptr);
-	vkFreeMemory(_renderer->GetVulkanDevice(), _vertexBufferMemory, nullptr);
+	std::array<std::pair<VkBuffer*, Allocation*>, 3> buffers = { {
+		{ &_visibleInstanceBuffer, &_visibleInstanceBufferMemory },
+		{ &_drawCommandBuffer, &_drawCommandBufferMemory },
+		{ &_cullCounterBuffer, &_cullCounterBufferMemory },
+	} };
+	for (auto &buffer : buffers)
+	{
+		if (*buffer.first == VK_NULL_HANDLE)
+		{
+			continue;
+		}
+		_resources->DestroyBufferDeferred(*buffer.first, *buffer.second);
+	}
 }
 
-void Window::_InitIndexBuffers()
+void Window::_RecordGpuCulling(VkCommandBuffer commandBuffer)
 {
-	VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
+	VkDeviceSize counterOffset = _cullCounterSegmentSize * currentFrame;
+	vkCmdFillBuffer(commandBuffer, _cullCounterBuffer, counterOffset, _cullCounterSegmentSize, 0);
 
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	_CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	GpuCullConstants constants = {};
+	glm::mat4 view, proj;
+	_GetViewProjection(view, proj);
+	Frustum frustum = ExtractFrustum(proj * view);
+	for (int i = 0; i < 6; i++)
+	{
+		constants.planes[i] = frustum.planes[i];
+	}
+	constants.eye = glm::vec4(_cameraEye, CAMERA_NEAR_PLANE);
+	constants.lodScale = _surface_size_y * 0.5f / std::tan(glm::radians(CAMERA_FOV_Y_DEGREES) * 0.5f);
+	constants.instanceCount = _resources->GetScene()->GetInstanceCount();
+	constants.drawCount16 = _resources->GetDrawTemplateCount16();
+	constants.drawCount = _resources->GetDrawTemplateCount();
 
-	void* data;
-	vkMapMemory(_renderer->GetVulkanDevice(), stagingBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, indices.data(), (size_t)bufferSize);
-	vkUnmapMemory(_renderer->GetVulkanDevice(), stagingBufferMemory);
+	_UpdateCullDescriptorSet(static_cast<uint32_t>(currentFrame));
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _resources->GetCullPipelineLayout(), 0, 1, &_cullDescriptorSets[currentFrame], 0, nullptr);
+	vkCmdPushConstants(commandBuffer, _resources->GetCullPipelineLayout(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
 
-	_CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _indexBuffer, _indexBufferMemory);
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _resources->GetCullPipeline(0));
+	vkCmdDispatch(commandBuffer, (constants.instanceCount + GPU_CULL_GROUP_SIZE - 1) / GPU_CULL_GROUP_SIZE, 1, 1);
 
-	_CopyBuffer(stagingBuffer, _indexBuffer, bufferSize);
+	// The draw pass reads the group counts the cull pass has finished
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
 
-	vkDestroyBuffer(_renderer->GetVulkanDevice(), stagingBuffer, nullptr);
-	vkFreeMemory(_renderer->GetVulkanDevice(), stagingBufferMemory, nullptr);
-}
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _resources->GetCullPipeline(1));
+	vkCmdDispatch(commandBuffer, (constants.drawCount + GPU_CULL_GROUP_SIZE - 1) / GPU_CULL_GROUP_SIZE, 1, 1);
 
-void Window::_DeInitIndexBuffers()
-{
-	vkDestroyBuffer(_renderer->GetVulkanDevice(), _indexBuffer, nullptr);
-	vkFreeMemory(_renderer->GetVulkanDevice(), _indexBufferMemory, nullptr);
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
 }
 
 void Window::_InitUniformBuffers()
 {
-	VkDeviceSize bufferSize = sizeof(UniformBufferObject);
-
-	_uniformBuffers.resize(_swapchainImages.size());
-	_uniformBuffersMemory.resize(_swapchainImages.size());
-
-	for (size_t i = 0; i < _swapchainImages.size(); i++) {
-		_CreateBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, _uniformBuffers[i], _uniformBuffersMemory[i]);
-	}
+	_uniformRingBuffer = new UniformRingBuffer(_renderer, UNIFORM_RING_BYTES_PER_FRAME, _framesInFlight);
 }
 
 void Window::_DeInitUniformBuffers()
 {
-	for (size_t i = 0; i < _swapchainImages.size(); i++) {
-		vkDestroyBuffer(_renderer->GetVulkanDevice(), _uniformBuffers[i], nullptr);
-		vkFreeMemory(_renderer->GetVulkanDevice(), _uniformBuffersMemory[i], nullptr);
-	}
+	delete _uniformRingBuffer;
+	_uniformRingBuffer = nullptr;
 }
 
-void Window::_UpdateUniformBuffers(uint32_t currentImage)
+uint32_t Window::_UpdateUniformBuffers()
 {
-	static auto startTime = std::chrono::high_resolution_clock::now();
-
-	auto currentTime = std::chrono::high_resolution_clock::now();
-	float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
-
 	UniformBufferObject ubo = {};
-	ubo.model = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-
-	ubo.view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-
-	ubo.proj = glm::perspective(glm::radians(45.0f), _surface_size_x / (float)_surface_size_y, 0.1f, 10.0f);
+	_GetViewProjection(ubo.view, ubo.proj);
 
-	ubo.proj[1][1] *= -1;
-
-	void* data;
-	vkMapMemory(_renderer->GetVulkanDevice(), _uniformBuffersMemory[currentImage], 0, sizeof(ubo), 0, &data);
-	memcpy(data, &ubo, sizeof(ubo));
-	vkUnmapMemory(_renderer->GetVulkanDevice(), _uniformBuffersMemory[currentImage]);
+	uint32_t dynamicOffset = 0;
+	_uniformRingBuffer->BeginFrame(static_cast<uint32_t>(currentFrame));
+	memcpy(_uniformRingBuffer->Allocate(sizeof(ubo), dynamicOffset), &ubo, sizeof(ubo));
+	return dynamicOffset;
 }
 
 void Window::_InitDescriptorPool()
 {
-	std::array<VkDescriptorPoolSize, 2> poolSizes = {};
-	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	poolSizes[0].descriptorCount = static_cast<uint32_t>(_swapchainImages.size());
-	poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	poolSizes[1].descriptorCount = static_cast<uint32_t>(_swapchainImages.size());
+	// Textures are in the shared bindless set
+	std::array<VkDescriptorPoolSize, 1> poolSizes = {};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	poolSizes[0].descriptorCount = _framesInFlight;
 
 	VkDescriptorPoolCreateInfo poolInfo = {};
 	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
 	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
 	poolInfo.pPoolSizes = poolSizes.data();
-	poolInfo.maxSets = static_cast<uint32_t>(_swapchainImages.size());
+	poolInfo.maxSets = _framesInFlight;
 
 	ErrorCheck(vkCreateDescriptorPool(_renderer->GetVulkanDevice(), &poolInfo, nullptr, &_descriptorPool));
 }
@@ -930,47 +927,20 @@ void Window::_DeInitDescriptorPool()
 
 void Window::_InitDescriptorSets()
 {
-	std::vector<VkDescriptorSetLayout> layouts(_swapchainImages.size(), _descriptorSetLayout);
+	_descriptorSets.resize(_framesInFlight);
+	std::vector<VkDescriptorSetLayout> layouts(_framesInFlight, _resources->GetDescriptorSetLayout());
+
 	VkDescriptorSetAllocateInfo allocInfo = {};
 	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
 	allocInfo.descriptorPool = _descriptorPool;
-	allocInfo.descriptorSetCount = static_cast<uint32_t>(_swapchainImages.size());
+	allocInfo.descriptorSetCount = _framesInFlight;
 	allocInfo.pSetLayouts = layouts.data();
 
-	descriptorSets.resize(_swapchainImages.size());
-	ErrorCheck(vkAllocateDescriptorSets(_renderer->GetVulkanDevice(), &allocInfo, descriptorSets.data()));
-
-	for (size_t i = 0; i < _swapchainImages.size(); i++) {
-		VkDescriptorBufferInfo bufferInfo = {};
-		bufferInfo.buffer = _uniformBuffers[i];
-		bufferInfo.offset = 0;
-		bufferInfo.range = sizeof(UniformBufferObject);
-
-		VkDescriptorImageInfo imageInfo = {};
-		imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		imageInfo.imageView = _textureImageView;
-		imageInfo.sampler = _textureSampler;
-
-		std::array<VkWriteDescriptorSet, 2> descriptorWrites = {};
-
-		descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		descriptorWrites[0].dstSet = descriptorSets[i];
-		descriptorWrites[0].dstBinding = 0;
-		descriptorWrites[0].dstArrayElement = 0;
-		descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		descriptorWrites[0].descriptorCount = 1;
-		descriptorWrites[0].pBufferInfo = &bufferInfo;
-
-		descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		descriptorWrites[1].dstSet = descriptorSets[i];
-		descriptorWrites[1].dstBinding = 1;
-		descriptorWrites[1].dstArrayElement = 0;
-		descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		descriptorWrites[1].descriptorCount = 1;
-		descriptorWrites[1].pImageInfo = &imageInfo;
+	ErrorCheck(vkAllocateDescriptorSets(_renderer->GetVulkanDevice(), &allocInfo, _descriptorSets.data()));
 
-
-		vkUpdateDescriptorSets(_renderer->GetVulkanDevice(), static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+	for (uint32_t i = 0; i < _framesInFlight; i++)
+	{
+		_UpdateDescriptorSet(i);
 	}
 }
 
@@ -978,498 +948,352 @@ void Window::_DeInitDescriptorSets()
 {
 }
 
-void Window::_InitCommandBuffers()
+void Window::_UpdateDescriptorSet(uint32_t frame)
 {
-	_commandBuffers.resize(_framebuffers.size());
-
-	VkCommandBufferAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	allocInfo.commandPool = _commandPool;
-	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	allocInfo.commandBufferCount = (uint32_t)_commandBuffers.size();
-
-	ErrorCheck(vkAllocateCommandBuffers(_renderer->GetVulkanDevice(), &allocInfo, _commandBuffers.data()));
-
-	for (size_t i = 0; i < _commandBuffers.size(); i++) {
-		VkCommandBufferBeginInfo beginInfo = {};
-		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
-
-		ErrorCheck(vkBeginCommandBuffer(_commandBuffers[i], &beginInfo));
-
-		std::array<VkClearValue, 2> clearValues{};
-		clearValues[0].color.float32[0] = 0.0f;
-		clearValues[0].color.float32[1] = 0.0f;
-		clearValues[0].color.float32[2] = 1.0f;
-		clearValues[0].color.float32[3] = 1.0f;
-		clearValues[1].depthStencil.depth = 1.0f;
-		clearValues[1].depthStencil.stencil = 0;
+	// Every frame reads the same buffer, the segment is picked with the dynamic offset at bind time
+	VkDescriptorBufferInfo bufferInfo = {};
+	bufferInfo.buffer = _uniformRingBuffer->GetBuffer();
+	bufferInfo.offset = 0;
+	bufferInfo.range = sizeof(UniformBufferObject);
 
-		VkRenderPassBeginInfo renderPassInfo = {};
-		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		renderPassInfo.renderPass = _renderPass;
-		renderPassInfo.framebuffer = _framebuffers[i];
-		renderPassInfo.renderArea.offset = { 0, 0 };
-		renderPassInfo.renderArea.extent = {_surface_size_x,_surface_size_y};
-		renderPassInfo.clearValueCount = clearValues.size();
-		renderPassInfo.pClearValues = clearValues.data();
-
-		vkCmdBeginRenderPass(_commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-		vkCmdBindPipeline(_commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, _graphicsPipeline);
-
-		VkBuffer vertexBuffers[] = { _vertexBuffer };
-		VkDeviceSize offsets[] = { 0 };
-		vkCmdBindVertexBuffers(_commandBuffers[i], 0, 1, vertexBuffers, offsets);
-
-		vkCmdBindIndexBuffer(_commandBuffers[i], _indexBuffer, 0, VK_INDEX_TYPE_UINT32);
-		vkCmdBindDescriptorSets(_commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, _pipelineLayout, 0, 1, &descriptorSets[i], 0, nullptr);
-		vkCmdDrawIndexed(_commandBuffers[i], static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
-
-		vkCmdEndRenderPass(_commandBuffers[i]);
-
-		ErrorCheck(vkEndCommandBuffer(_commandBuffers[i]));
-	}
+	VkWriteDescriptorSet descriptorWrite = {};
+	descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrite.dstSet = _descriptorSets[frame];
+	descriptorWrite.dstBinding = 0;
+	descriptorWrite.dstArrayElement = 0;
+	descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	descriptorWrite.descriptorCount = 1;
+	descriptorWrite.pBufferInfo = &bufferInfo;
 
+	vkUpdateDescriptorSets(_renderer->GetVulkanDevice(), 1, &descriptorWrite, 0, nullptr);
 }
 
-void Window::_DeInitCommandBuffers()
+VkCommandBuffer Window::_RecordCommandBuffer(uint32_t imageIndex, uint32_t uniformOffset)
 {
-	vkFreeCommandBuffers(_renderer->GetVulkanDevice(), _commandPool, _commandBuffers.size(), _commandBuffers.data());
-}
+	// GPU culling draws everything with a few indirect draws, otherwise the draw calls are split into contiguous
+	// ranges, one secondary command buffer each, recorded in parallel. A few meshes already make enough calls
+	// with their submeshes, so the ranges may split a draw
+	VkBuffer vertexBuffer = _resources->GetVertexBuffer();
+	bool gpuCulling = _resources->GetGpuCulling() && _cullCounterBuffer != VK_NULL_HANDLE && vertexBuffer != VK_NULL_HANDLE;
+	std::vector<VkCommandBuffer> secondaries;
+	if (gpuCulling)
+	{
+		secondaries.push_back(_RecordIndirectSecondaryCommandBuffer(imageIndex, uniformOffset));
+	}
+	else if (!_resources->GetGpuCulling())
+	{
+		const std::vector<MeshDraw>& draws = _resources->GetScene()->GetDraws();
+		uint32_t callCount = 0;
+		if (vertexBuffer != VK_NULL_HANDLE)
+		{
+			for (const MeshDraw& draw : draws)
+			{
+				callCount += _GetDrawCallCount(draw);
+			}
+		}
+		uint32_t rangeCount = std::min(_renderer->GetJobSystem()->GetWorkerCount(), (callCount + MIN_DRAW_CALLS_PER_SECONDARY_COMMAND_BUFFER - 1) / MIN_DRAW_CALLS_PER_SECONDARY_COMMAND_BUFFER);
+		secondaries.resize(rangeCount);
+		_renderer->GetJobSystem()->ParallelFor(rangeCount, [&](uint32_t range, uint32_t worker)
+		{
+			uint32_t firstCall = static_cast<uint32_t>(uint64_t(callCount) * range / rangeCount);
+			uint32_t lastCall = static_cast<uint32_t>(uint64_t(callCount) * (range + 1) / rangeCount);
+			secondaries[range] = _RecordSecondaryCommandBuffer(worker, imageIndex, uniformOffset, draws, firstCall, lastCall);
+		});
+	}
 
-void Window::_InitSyncObjects()
-{
-	_imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-	_renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-	_inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
+	VkCommandBuffer commandBuffer = _resources->GetPrimaryCommandBuffer();
+	uint32_t firstQuery = 2 * static_cast<uint32_t>(currentFrame);
 
-	VkSemaphoreCreateInfo semaphoreInfo = {};
-	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
-	VkFenceCreateInfo fenceInfo = {};
-	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+	ErrorCheck(vkBeginCommandBuffer(commandBuffer, &beginInfo));
 
-	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) 
+	if (_timestampQueryPool != VK_NULL_HANDLE)
 	{
-		ErrorCheck(vkCreateSemaphore(_renderer->GetVulkanDevice(), &semaphoreInfo, nullptr, &_imageAvailableSemaphores[i]));
-		ErrorCheck(vkCreateSemaphore(_renderer->GetVulkanDevice(), &semaphoreInfo, nullptr, &_renderFinishedSemaphores[i]));
-		ErrorCheck(vkCreateFence(_renderer->GetVulkanDevice(), &fenceInfo, nullptr, &_inFlightFences[i]));
+		vkCmdResetQueryPool(commandBuffer, _timestampQueryPool, firstQuery, 2);
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, _timestampQueryPool, firstQuery);
 	}
-}
 
-void Window::_DeInitSyncObjects()
-{
-	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) 
+	if (gpuCulling)
 	{
-		vkDestroySemaphore(_renderer->GetVulkanDevice(), _imageAvailableSemaphores[i], nullptr);
-		vkDestroySemaphore(_renderer->GetVulkanDevice(), _renderFinishedSemaphores[i], nullptr);
-		vkDestroyFence(_renderer->GetVulkanDevice(), _inFlightFences[i], nullptr);
+		_RecordGpuCulling(commandBuffer);
 	}
-}
-
-void Window::_CleanUpOldSwapChain()
-{
-	_DeInitCommandBuffers();
-	_DeInitDescriptorPool();
-	_DeInitUniformBuffers();
-	//_DeInitVertexBuffers();
-	_DeInitFramebuffers();
-	_DeInitDepthStencilImage();
-	_DeInitColorResources();
-	_DeInitGraphicsPipeline();
-	_DeInitRenderPass();
-	_DeInitSwapchainImages();
-	_DeInitSwapchain();
-	_DeInitSurface();
 
-	//_DeInitOSWindow();
-}
-
-void Window::_ReInitSwapChain()
-{
-	vkDeviceWaitIdle(_renderer->GetVulkanDevice());
-	while (_surface_size_x == 0 || _surface_size_y == 0)
+	std::array<VkClearValue, 2> clearValues{};
+	clearValues[0].color.float32[0] = 0.0f;
+	clearValues[0].color.float32[1] = 0.0f;
+	clearValues[0].color.float32[2] = 1.0f;
+	clearValues[0].color.float32[3] = 1.0f;
+	clearValues[1].depthStencil.depth = 1.0f;
+	clearValues[1].depthStencil.stencil = 0;
+
+	VkRenderPassBeginInfo renderPassInfo = {};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassInfo.renderPass = _renderPass;
+	renderPassInfo.framebuffer = _framebuffers[imageIndex];
+	renderPassInfo.renderArea.offset = { 0, 0 };
+	renderPassInfo.renderArea.extent = {_surface_size_x,_surface_size_y};
+	renderPassInfo.clearValueCount = clearValues.size();
+	renderPassInfo.pClearValues = clearValues.data();
+
+	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+	if (!secondaries.empty())
 	{
-		_GetWindowSize();
-		_WaitForEvents();
+		vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(secondaries.size()), secondaries.data());
 	}
-	_CleanUpOldSwapChain();
-
-	_InitSurface();
-	_InitSwapchain();
-	_InitSwapchainImages();
-	_InitRenderPass();
-	_InitGraphicsPipeline();
-	_InitColorResources();
-	_InitDepthStencilImage();
-	_InitFramebuffers();
-	//_InitVertexBuffers();
-	_InitUniformBuffers();
-	_InitDescriptorPool();
-	_InitDescriptorSets();
-	_InitCommandBuffers();
+	vkCmdEndRenderPass(commandBuffer);
 
-}
-
-std::vector<char> Window::readFile(const std::string & filename)
-{
-	std::ifstream file(filename, std::ios::ate | std::ios::binary);
-
-	if (!file.is_open()) {
-		throw std::runtime_error("failed to open file!");
+	if (_timestampQueryPool != VK_NULL_HANDLE)
+	{
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, _timestampQueryPool, firstQuery + 1);
 	}
 
-	size_t fileSize = (size_t)file.tellg();
-	std::vector<char> buffer(fileSize);
-	file.seekg(0);
-	file.read(buffer.data(), fileSize);
-	file.close();
-	return buffer;
-}
-
-VkShaderModule Window::_CreateShaderModule(const std::vector<char>& code)
-{
-	VkShaderModuleCreateInfo createInfo = {};
-	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	createInfo.codeSize = code.size();
-	createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
-	VkShaderModule shaderModule;
-	if (vkCreateShaderModule(_renderer->GetVulkanDevice(), &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
-		throw std::runtime_error("failed to create shader module!");
-	}
-	return shaderModule;
+	ErrorCheck(vkEndCommandBuffer(commandBuffer));
+	return commandBuffer;
 }
 
-void Window::_CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer & buffer, VkDeviceMemory & bufferMemory)
+VkCommandBuffer Window::_BeginSecondaryCommandBuffer(uint32_t worker, uint32_t imageIndex, uint32_t uniformOffset, VkBuffer instanceBuffer, VkDeviceSize instanceOffset)
 {
-	VkBufferCreateInfo bufferInfo = {};
-	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-	bufferInfo.size = size;
-	bufferInfo.usage = usage;
-	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	VkCommandBuffer commandBuffer = _resources->GetSecondaryCommandBuffer(worker);
 
-	if (vkCreateBuffer(_renderer->GetVulkanDevice(), &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
-		throw std::runtime_error("failed to create buffer!");
-	}
+	VkCommandBufferInheritanceInfo inheritanceInfo = {};
+	inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	inheritanceInfo.renderPass = _renderPass;
+	inheritanceInfo.subpass = 0;
+	inheritanceInfo.framebuffer = _framebuffers[imageIndex];
 
-	VkMemoryRequirements memRequirements;
-	vkGetBufferMemoryRequirements(_renderer->GetVulkanDevice(), buffer, &memRequirements);
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+	beginInfo.pInheritanceInfo = &inheritanceInfo;
 
-	VkMemoryAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memRequirements.size;
-	allocInfo.memoryTypeIndex = FindMemoryTypeIndex(&_renderer->GetVulkanPhysicalDeviceMemoryProperties(), &memRequirements, properties);
+	ErrorCheck(vkBeginCommandBuffer(commandBuffer, &beginInfo));
 
-	if (vkAllocateMemory(_renderer->GetVulkanDevice(), &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
-		throw std::runtime_error("failed to allocate buffer memory!");
-	}
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _resources->GetGraphicsPipeline(_renderPass));
 
-	vkBindBufferMemory(_renderer->GetVulkanDevice(), buffer, bufferMemory, 0);
-}
+	VkViewport viewport = {};
+	viewport.x = 0.0f;
+	viewport.y = 0.0f;
+	viewport.width = (float)_surface_size_x;
+	viewport.height = (float)_surface_size_y;
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 
-void Window::_CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size)
-{
-	VkCommandBuffer commandBuffer = _BeginSingleTimeCommands();
+	VkRect2D scissor = {};
+	scissor.offset = { 0, 0 };
+	scissor.extent = { _surface_size_x, _surface_size_y };
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-	VkBufferCopy copyRegion = {};
-	copyRegion.size = size;
-	vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
+	VkBuffer vertexBuffers[] = { _resources->GetVertexBuffer(), instanceBuffer };
+	VkDeviceSize offsets[] = { 0, instanceOffset };
+	vkCmdBindVertexBuffers(commandBuffer, 0, 2, vertexBuffers, offsets);
 
-	_EndSingleTimeCommands(commandBuffer);
+	// Materials index the texture array per instance, so one bind covers every draw
+	VkDescriptorSet descriptorSets[] = { _descriptorSets[currentFrame], _resources->GetBindlessDescriptorSet() };
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _resources->GetPipelineLayout(), 0, 2, descriptorSets, 1, &uniformOffset);
+	return commandBuffer;
 }
 
-void Window::_CreateImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkSampleCountFlagBits numSamples, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage & image, VkDeviceMemory & imageMemory)
+uint32_t Window::_GetDrawCallCount(const MeshDraw & draw) const
 {
-	VkImageCreateInfo imageInfo = {};
-	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-	imageInfo.imageType = VK_IMAGE_TYPE_2D;
-	imageInfo.extent.width = width;
-	imageInfo.extent.height = height;
-	imageInfo.extent.depth = 1;
-	imageInfo.mipLevels = mipLevels;
-	imageInfo.arrayLayers = 1;
-	imageInfo.format = format;
-	imageInfo.tiling = tiling;
-	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	imageInfo.usage = usage;
-	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-	imageInfo.samples = numSamples;
-	imageInfo.flags = 0; // Optional
-	ErrorCheck(vkCreateImage(_renderer->GetVulkanDevice(), &imageInfo, nullptr, &image));
-
-	VkMemoryRequirements memRequirements;
-	vkGetImageMemoryRequirements(_renderer->GetVulkanDevice(), image, &memRequirements);
-
-	VkMemoryAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memRequirements.size;
-	allocInfo.memoryTypeIndex = FindMemoryTypeIndex(&_renderer->GetVulkanPhysicalDeviceMemoryProperties(), &memRequirements, properties);
-
-	ErrorCheck(vkAllocateMemory(_renderer->GetVulkanDevice(), &allocInfo, nullptr, &imageMemory));
-
-	vkBindImageMemory(_renderer->GetVulkanDevice(), image, imageMemory, 0);
-
+	// Meshes whose geometry hasn't been uploaded yet draw nothing
+	if (draw.mesh + 1 >= _resources->GetMeshFirstSubmeshDraw().size())
+	{
+		return 0;
+	}
+	return _resources->GetScene()->GetMeshes()[draw.mesh].submeshCount;
 }
 
-VkCommandBuffer Window::_BeginSingleTimeCommands()
+VkCommandBuffer Window::_RecordSecondaryCommandBuffer(uint32_t worker, uint32_t imageIndex, uint32_t uniformOffset, const std::vector<MeshDraw>& draws, uint32_t firstCall, uint32_t lastCall)
 {
-	VkCommandBufferAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	allocInfo.commandPool = _commandPool;
-	allocInfo.commandBufferCount = 1;
-
-	VkCommandBuffer commandBuffer;
-	vkAllocateCommandBuffers(_renderer->GetVulkanDevice(), &allocInfo, &commandBuffer);
-
-	VkCommandBufferBeginInfo beginInfo = {};
-	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	VkCommandBuffer commandBuffer = _BeginSecondaryCommandBuffer(worker, imageIndex, uniformOffset, _instanceBuffer, sizeof(InstanceData) * _instanceCapacity * currentFrame);
 
-	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+	// The index buffer is only rebound when the index type changes between submeshes
+	VkIndexType boundIndexType = VK_INDEX_TYPE_MAX_ENUM;
+	const std::vector<Mesh>& meshes = _resources->GetScene()->GetMeshes();
+	const std::vector<uint32_t>& meshFirstSubmeshDraw = _resources->GetMeshFirstSubmeshDraw();
+	const std::vector<SharedResources::SubmeshDraw>& submeshDraws = _resources->GetSubmeshDraws();
+	uint32_t drawFirstCall = 0;
+	for (uint32_t i = 0; i < draws.size() && drawFirstCall < lastCall; i++)
+	{
+		const MeshDraw& draw = draws[i];
+		uint32_t drawCallCount = _GetDrawCallCount(draw);
+		uint32_t begin = std::max(firstCall, drawFirstCall) - drawFirstCall;
+		uint32_t end = std::min(lastCall, drawFirstCall + drawCallCount) - drawFirstCall;
+		drawFirstCall += drawCallCount;
+		if (begin >= end)
+		{
+			continue;
+		}
+		const Mesh& mesh = meshes[draw.mesh];
+		uint32_t firstSubmeshDraw = meshFirstSubmeshDraw[draw.mesh] + std::min(draw.lod, mesh.lodCount - 1) * mesh.submeshCount;
+		for (uint32_t s = firstSubmeshDraw + begin; s < firstSubmeshDraw + end; s++)
+		{
+			const SharedResources::SubmeshDraw& submesh = submeshDraws[s];
+			if (submesh.indexType != boundIndexType)
+			{
+				VkDeviceSize offset = submesh.indexType == VK_INDEX_TYPE_UINT16 ? 0 : _resources->GetIndexBuffer32Offset();
+				vkCmdBindIndexBuffer(commandBuffer, _resources->GetIndexBuffer(), offset, submesh.indexType);
+				boundIndexType = submesh.indexType;
+			}
+			vkCmdDrawIndexed(commandBuffer, submesh.indexCount, draw.instanceCount, submesh.firstIndex, submesh.vertexOffset, draw.firstInstance);
+		}
+	}
 
+	ErrorCheck(vkEndCommandBuffer(commandBuffer));
 	return commandBuffer;
 }
 
-void Window::_EndSingleTimeCommands(VkCommandBuffer commandBuffer)
+VkCommandBuffer Window::_RecordIndirectSecondaryCommandBuffer(uint32_t imageIndex, uint32_t uniformOffset)
 {
-	vkEndCommandBuffer(commandBuffer);
-
-	VkSubmitInfo submitInfo = {};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffer;
+	// Recorded on the render thread alone, so the first worker's pool is free
+	VkCommandBuffer commandBuffer = _BeginSecondaryCommandBuffer(0, imageIndex, uniformOffset, _visibleInstanceBuffer, _visibleInstanceSegmentSize * currentFrame);
 
-	vkQueueSubmit(_renderer->GetVulkanQueue(), 1, &submitInfo, VK_NULL_HANDLE);
-	vkQueueWaitIdle(_renderer->GetVulkanQueue());
+	// One draw call per index type. Without draw indirect count the empty draws are still issued with no instances
+	PFN_vkCmdDrawIndexedIndirectCountKHR drawIndexedIndirectCount = _renderer->GetCmdDrawIndexedIndirectCount();
+	uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+	uint32_t drawTemplateCount16 = _resources->GetDrawTemplateCount16();
+	uint32_t drawTemplateCount = _resources->GetDrawTemplateCount();
+	for (uint32_t indexType = 0; indexType < 2; indexType++)
+	{
+		uint32_t firstDraw = indexType == 0 ? 0 : drawTemplateCount16;
+		uint32_t maxDrawCount = indexType == 0 ? drawTemplateCount16 : drawTemplateCount - drawTemplateCount16;
+		if (maxDrawCount == 0)
+		{
+			continue;
+		}
+		vkCmdBindIndexBuffer(commandBuffer, _resources->GetIndexBuffer(), indexType == 0 ? 0 : _resources->GetIndexBuffer32Offset(), indexType == 0 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32);
+		VkDeviceSize commandOffset = _drawCommandSegmentSize * currentFrame + VkDeviceSize(stride) * firstDraw;
+		if (drawIndexedIndirectCount != nullptr)
+		{
+			VkDeviceSize countOffset = _cullCounterSegmentSize * currentFrame + sizeof(uint32_t) * indexType;
+			drawIndexedIndirectCount(commandBuffer, _drawCommandBuffer, commandOffset, _cullCounterBuffer, countOffset, maxDrawCount, stride);
+		}
+		else if (_renderer->GetEnabledFeatures().multiDrawIndirect)
+		{
+			vkCmdDrawIndexedIndirect(commandBuffer, _drawCommandBuffer, commandOffset, maxDrawCount, stride);
+		}
+		else
+		{
+			for (uint32_t i = 0; i < maxDrawCount; i++)
+			{
+				vkCmdDrawIndexedIndirect(commandBuffer, _drawCommandBuffer, commandOffset + VkDeviceSize(stride) * i, 1, stride);
+			}
+		}
+	}
 
-	vkFreeCommandBuffers(_renderer->GetVulkanDevice(), _commandPool, 1, &commandBuffer);
+	ErrorCheck(vkEndCommandBuffer(commandBuffer));
+	return commandBuffer;
 }
 
-void Window::_TransitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels)
+void Window::_InitSyncObjects()
 {
-	VkCommandBuffer commandBuffer = _BeginSingleTimeCommands();
-
-	VkImageMemoryBarrier barrier = {};
-	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-	barrier.oldLayout = oldLayout;
-	barrier.newLayout = newLayout;
-	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.image = image;
-	if (newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
-		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-
-		if (_HasStencilComponent(format)) {
-			barrier.subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
-		}
-	}
-	else {
-		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	}
-	barrier.subresourceRange.baseMipLevel = 0;
-	barrier.subresourceRange.levelCount = mipLevels;
-	barrier.subresourceRange.baseArrayLayer = 0;
-	barrier.subresourceRange.layerCount = 1;
+	_imageAvailableSemaphores.resize(_framesInFlight);
+	_renderFinishedSemaphores.resize(_framesInFlight);
 
-	VkPipelineStageFlags sourceStage;
-	VkPipelineStageFlags destinationStage;
-
-	if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
-		barrier.srcAccessMask = 0;
-		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	VkSemaphoreCreateInfo semaphoreInfo = {};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-		sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-		destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+	for (size_t i = 0; i < _framesInFlight; i++) 
+	{
+		ErrorCheck(vkCreateSemaphore(_renderer->GetVulkanDevice(), &semaphoreInfo, nullptr, &_imageAvailableSemaphores[i]));
+		ErrorCheck(vkCreateSemaphore(_renderer->GetVulkanDevice(), &semaphoreInfo, nullptr, &_renderFinishedSemaphores[i]));
 	}
-	else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
-		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
 
-		sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-		destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-	}
-	else if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
-		barrier.srcAccessMask = 0;
-		barrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+}
 
-		sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-		destinationStage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+void Window::_DeInitSyncObjects()
+{
+	for (size_t i = 0; i < _imageAvailableSemaphores.size(); i++) 
+	{
+		vkDestroySemaphore(_renderer->GetVulkanDevice(), _imageAvailableSemaphores[i], nullptr);
+		vkDestroySemaphore(_renderer->GetVulkanDevice(), _renderFinishedSemaphores[i], nullptr);
 	}
-	else if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL) {
-		barrier.srcAccessMask = 0;
-		barrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	_imageAvailableSemaphores.clear();
+	_renderFinishedSemaphores.clear();
+}
 
-		sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-		destinationStage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	}
-	else {
-		throw std::invalid_argument("unsupported layout transition!");
+void Window::_InitTimestampQueries()
+{
+	_frameTimestampsWritten.assign(_framesInFlight, false);
+	if (_renderer->GetVulkanGraphicsQueueTimestampValidBits() == 0)
+	{
+		return;
 	}
 
-	vkCmdPipelineBarrier(
-		commandBuffer,
-		sourceStage, destinationStage,
-		0,
-		0, nullptr,
-		0, nullptr,
-		1, &barrier
-	);
+	// One begin/end pair per frame in flight
+	VkQueryPoolCreateInfo queryPoolInfo = {};
+	queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	queryPoolInfo.queryCount = 2 * _framesInFlight;
 
-	_EndSingleTimeCommands(commandBuffer);
+	ErrorCheck(vkCreateQueryPool(_renderer->GetVulkanDevice(), &queryPoolInfo, nullptr, &_timestampQueryPool));
 }
 
-void Window::_CopyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height)
+void Window::_DeInitTimestampQueries()
 {
-	VkCommandBuffer commandBuffer = _BeginSingleTimeCommands();
-
-	VkBufferImageCopy region = {};
-	region.bufferOffset = 0;
-	region.bufferRowLength = 0;
-	region.bufferImageHeight = 0;
-
-	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	region.imageSubresource.mipLevel = 0;
-	region.imageSubresource.baseArrayLayer = 0;
-	region.imageSubresource.layerCount = 1;
-
-	region.imageOffset = { 0, 0, 0 };
-	region.imageExtent = {
-		width,
-		height,
-		1
-	};
-
-	vkCmdCopyBufferToImage(
-		commandBuffer,
-		buffer,
-		image,
-		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-		1,
-		&region
-	);
-
-	_EndSingleTimeCommands(commandBuffer);
+	vkDestroyQueryPool(_renderer->GetVulkanDevice(), _timestampQueryPool, nullptr);
+	_timestampQueryPool = VK_NULL_HANDLE;
 }
 
-VkImageView Window::_CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels)
+void Window::_ReadTimestampQueries()
 {
-	VkImageViewCreateInfo viewInfo = {};
-	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-	viewInfo.image = image;
-	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-	viewInfo.format = format;
-	/*viewInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
-	viewInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
-	viewInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
-	viewInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;*/
-	viewInfo.subresourceRange.aspectMask = aspectFlags;
-	viewInfo.subresourceRange.baseMipLevel = 0;
-	viewInfo.subresourceRange.levelCount = mipLevels;
-	viewInfo.subresourceRange.baseArrayLayer = 0;
-	viewInfo.subresourceRange.layerCount = 1;
+	_frameTimings.gpuRenderPassMs = -1.0;
+	if (_timestampQueryPool == VK_NULL_HANDLE || !_frameTimestampsWritten[currentFrame])
+	{
+		return;
+	}
 
-	VkImageView imageView;
-	ErrorCheck(vkCreateImageView(_renderer->GetVulkanDevice(), &viewInfo, nullptr, &imageView));
+	std::array<uint64_t, 2> timestamps{};
+	VkResult result = vkGetQueryPoolResults(_renderer->GetVulkanDevice(), _timestampQueryPool, 2 * static_cast<uint32_t>(currentFrame), 2, sizeof(timestamps), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+	if (result != VK_SUCCESS)
+	{
+		return;
+	}
 
-	return imageView;
+	uint32_t validBits = _renderer->GetVulkanGraphicsQueueTimestampValidBits();
+	uint64_t mask = validBits >= 64 ? UINT64_MAX : ((uint64_t(1) << validBits) - 1);
+	uint64_t ticks = ((timestamps[1] & mask) - (timestamps[0] & mask)) & mask;
+	_frameTimings.gpuRenderPassMs = ticks * static_cast<double>(_renderer->GetVulkanPhysicalDeviceProperties().limits.timestampPeriod) / 1000000.0;
 }
 
-bool Window::_HasStencilComponent(VkFormat format)
+void Window::_CleanUpOldSwapChain()
 {
-	return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT;
+	_DeInitFramebuffers();
+	_DeInitDepthStencilImage();
+	_DeInitColorResources();
+	_DeInitSwapchainImages();
 }
 
-void Window::_GenerateMipMaps(VkImage image, VkFormat imageFormat, int32_t texWidth, int32_t texHeight, uint32_t mipLevels)
+void Window::_ReInitSwapChain()
 {
-
-	VkFormatProperties formatProperties;
-	vkGetPhysicalDeviceFormatProperties(_renderer->GetVulkanPhysicalDevice(), imageFormat, &formatProperties);
-
-	if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT)) {
-		throw std::runtime_error("texture image format does not support linear blitting!");
-	}
-
-	VkCommandBuffer commandBuffer = _BeginSingleTimeCommands();
-
-	VkImageMemoryBarrier barrier = {};
-	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-	barrier.image = image;
-	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	barrier.subresourceRange.baseArrayLayer = 0;
-	barrier.subresourceRange.layerCount = 1;
-	barrier.subresourceRange.levelCount = 1;
-
-	int32_t mipWidth = texWidth;
-	int32_t mipHeight = texHeight;
-
-	for (uint32_t i = 1; i < mipLevels; i++) {
-		barrier.subresourceRange.baseMipLevel = i - 1;
-		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-
-		vkCmdPipelineBarrier(commandBuffer,
-			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
-			0, nullptr,
-			0, nullptr,
-			1, &barrier);
-
-		VkImageBlit blit = {};
-		blit.srcOffsets[0] = { 0, 0, 0 };
-		blit.srcOffsets[1] = { mipWidth, mipHeight, 1 };
-		blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		blit.srcSubresource.mipLevel = i - 1;
-		blit.srcSubresource.baseArrayLayer = 0;
-		blit.srcSubresource.layerCount = 1;
-		blit.dstOffsets[0] = { 0, 0, 0 };
-		blit.dstOffsets[1] = { mipWidth > 1 ? mipWidth / 2 : 1, mipHeight > 1 ? mipHeight / 2 : 1, 1 };
-		blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		blit.dstSubresource.mipLevel = i;
-		blit.dstSubresource.baseArrayLayer = 0;
-		blit.dstSubresource.layerCount = 1;
-
-		vkCmdBlitImage(commandBuffer,
-			image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-			image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			1, &blit,
-			VK_FILTER_LINEAR);
-
-		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-		vkCmdPipelineBarrier(commandBuffer,
-			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
-			0, nullptr,
-			0, nullptr,
-			1, &barrier);
-
-		if (mipWidth > 1) mipWidth /= 2;
-		if (mipHeight > 1) mipHeight /= 2;
+	while (_surface_size_x == 0 || _surface_size_y == 0)
+	{
+		_GetWindowSize();
+		_WaitForEvents();
 	}
+	// The old attachments and framebuffers are destroyed once the frames in flight that use them have completed
+	_CleanUpOldSwapChain();
 
-	barrier.subresourceRange.baseMipLevel = mipLevels - 1;
-	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-	barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-	vkCmdPipelineBarrier(commandBuffer,
-		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
-		0, nullptr,
-		0, nullptr,
-		1, &barrier);
+	// Surface, render pass and pipeline don't depend on the extent and are kept
+	_UpdateSurfaceCapabilities();
+	_InitSwapchain();
+	_InitSwapchainImages();
+	_InitColorResources();
+	_InitDepthStencilImage();
+	_InitFramebuffers();
 
-	_EndSingleTimeCommands(commandBuffer);
+	// Attachments sized for the old extent may leave whole blocks empty once they are actually freed
+	MemoryAllocator* allocator = _renderer->GetMemoryAllocator();
+	_renderer->DestroyDeferred([allocator]()
+	{
+		allocator->ReleaseEmptyBlocks();
+	});
 }
 
-
 std::vector<VkImage> Window::GetSwapchainImages()
 {
 	return _swapchainImages;
@@ -1485,3 +1309,20 @@ uint32_t Window::GetSwapchainImagesCount()
 	return _swapchainImageCount;
 }
 
+const FrameTimings & Window::GetLastFrameTimings() const
+{
+	return _frameTimings;
+}
+
+VkExtent2D Window::GetSurfaceSize() const
+{
+	return { _surface_size_x, _surface_size_y };
+}
+
+void Window::SetCamera(const glm::vec3 & eye, const glm::vec3 & target, float farPlane)
+{
+	_cameraEye = eye;
+	_cameraTarget = target;
+	_cameraFarPlane = farPlane;
+}
+
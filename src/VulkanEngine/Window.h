@@ -4,30 +4,73 @@
 #include "Platform.h"
 #include <string>
 #include "Renderer.h"
+#include "SharedResources.h"
 #include <array>
-#include "Vertex.h"
+#include "Culling.h"
+#include "Benchmark.h"
 #include <chrono>
-#include <stb_image.h>
-#include <tiny_obj_loader.h>
-#include <unordered_map>
-const int MAX_FRAMES_IN_FLIGHT = 2;
+#include <deque>
+const VkDeviceSize UNIFORM_RING_BYTES_PER_FRAME = 64 * 1024;
+const float CAMERA_FOV_Y_DEGREES = 45.0f;
+const float CAMERA_NEAR_PLANE = 0.1f;
+// Instances per culling job, a multiple of the widest SIMD kernel
+const uint32_t CULLING_BLOCK_SIZE = 4096;
+// Fewer vkCmdDrawIndexed calls than this aren't worth a secondary command buffer of their own
+const uint32_t MIN_DRAW_CALLS_PER_SECONDARY_COMMAND_BUFFER = 4;
+// Presents a low latency window may have queued when its next frame starts, the wait needs VK_KHR_present_wait
+const uint64_t LOW_LATENCY_QUEUED_PRESENTS = 1;
+// Longest a present wait blocks, some platforms never report the presents of hidden windows
+const uint64_t PRESENT_WAIT_TIMEOUT_NS = 100 * 1000 * 1000;
+
+// LowLatency presents with mailbox, or with FIFO and as few images as the surface allows, and paces frames on
+// present wait so input is sampled late. Vsync is FIFO with a spare image for steady pacing. Uncapped prefers
+// immediate and may tear, for measuring throughput
+enum class PresentPolicy
+{
+	LowLatency,
+	Vsync,
+	Uncapped,
+};
 
 
+class UniformRingBuffer;
+// A surface and its swapchain, or a headless target, drawing the renderer's shared scene with its own camera.
+// Frames are driven by Renderer::DrawFrame
 class Window
 {
+	friend class Renderer;
+
 public:
 	Window(Renderer* renderer, uint32_t size_x, uint32_t size_y, std::string name);
 	~Window();
 
 	void Close();
+	// Handles the window's OS events, false once it has been closed
 	bool Update();
-	void DrawFrame();
 
 	std::vector<VkImage> GetSwapchainImages();
 	VkSwapchainKHR		 GetSwapchain();
 	uint32_t			 GetSwapchainImagesCount();
+	const FrameTimings&	 GetLastFrameTimings() const;
+	VkExtent2D			 GetSurfaceSize() const;
+
+	void				 SetCamera(const glm::vec3& eye, const glm::vec3& target, float farPlane);
+	// Recreates the swapchain with the present mode and image count of the policy
+	void				 SetPresentPolicy(PresentPolicy policy);
+	PresentPolicy		 GetPresentPolicy() const;
 
 private:
+	// The steps of Renderer::DrawFrame. Largest on-screen size of an instance in the window's last frame
+	float _GetMaxTexturePixels() const;
+	// False if the swapchain was out of date, the window then sits the frame out
+	bool _AcquireImage();
+	VkCommandBuffer _RecordFrame();
+	void _EndFrame(VkResult presentResult, std::chrono::high_resolution_clock::time_point presentEnd);
+	// Follows the scene's instance count and the shared GPU culling buffers
+	void _SyncBuffers();
+	// Called by Renderer::SetFramesInFlight with the device idle
+	void _SetFramesInFlight(uint32_t framesInFlight);
+
 	void _InitOSWindow();
 	void _DeInitOSWindow();
 	void _UpdateOSWindow();
@@ -35,95 +78,86 @@ private:
 
 	void _InitSurface();
 	void _DeInitSurface();
+	void _UpdateSurfaceCapabilities();
 
 	void _InitSwapchain();
 	void _DeInitSwapchain();
+	void _WaitForPresents();
 
 	void _InitSwapchainImages();
 	void _DeInitSwapchainImages();
 
+	void _InitHeadlessTarget();
+	void _DeInitHeadlessTarget();
+
 	void _InitColorResources();
 	void _DeInitColorResources();
 
 	void _InitDepthStencilImage();
 	void _DeInitDepthStencilImage();
 
-	void _InitRenderPass();
-	void _DeInitRenderPass();
-
 	void _InitFramebuffers();
 	void _DeInitFramebuffers();
 
-	void _InitDescriptorSetLayout();
-	void _DeInitDescriptorSetLayout();
-
-	void _InitGraphicsPipeline();
-	void _DeInitGraphicsPipeline();
-
-	void _InitCommandPool();
-	void _DeInitCommandPool();
-
-	void _InitTextureImage();
-	void _DeInitTextureImage();
-
-	void _InitTextureImageView();
-	void _DeInitTextureImageView();
-
-	void _InitTextureSampler();
-	void _DeInitTextureSampler();
+	void _InitUniformBuffers();
+	void _DeInitUniformBuffers();
+	uint32_t _UpdateUniformBuffers();
 
-	void _LoadModel();
+	void _InitInstanceBuffers();
+	void _DeInitInstanceBuffers();
+	void _UpdateInstanceBuffers();
 
-	void _InitVertexBuffers();
-	void _DeInitVertexBuffers();
+	void _InitCullDescriptorSets();
+	void _DeInitCullDescriptorSets();
 
-	void _InitIndexBuffers();
-	void _DeInitIndexBuffers();
+	void _InitCullBuffers();
+	void _DeInitCullBuffers();
+	void _UpdateCullDescriptorSet(uint32_t frame);
+	void _RecordGpuCulling(VkCommandBuffer commandBuffer);
 
-	void _InitUniformBuffers();
-	void _DeInitUniformBuffers();
-	void _UpdateUniformBuffers(uint32_t currentImage);
+	void _GetViewProjection(glm::mat4& view, glm::mat4& proj) const;
+	// Updates the instance bounding spheres and hides the instances outside the view frustum
+	void _CullInstances();
+	// Screen pixels one model space unit of the instance covers at the near side of its bounding sphere, valid after _CullInstances
+	float _GetPixelsPerUnit(InstanceHandle instance) const;
+	void _UpdateLods();
 
 	void _InitDescriptorPool();
 	void _DeInitDescriptorPool();
 
 	void _InitDescriptorSets();
 	void _DeInitDescriptorSets();
+	void _UpdateDescriptorSet(uint32_t frame);
 
-	void _InitCommandBuffers();
-	void _DeInitCommandBuffers();
+	VkCommandBuffer _RecordCommandBuffer(uint32_t imageIndex, uint32_t uniformOffset);
+	VkCommandBuffer _BeginSecondaryCommandBuffer(uint32_t worker, uint32_t imageIndex, uint32_t uniformOffset, VkBuffer instanceBuffer, VkDeviceSize instanceOffset);
+	uint32_t _GetDrawCallCount(const MeshDraw& draw) const;
+	// Records draw calls firstCall .. lastCall of the draws, each draw makes one call per submesh of its LOD
+	VkCommandBuffer _RecordSecondaryCommandBuffer(uint32_t worker, uint32_t imageIndex, uint32_t uniformOffset, const std::vector<MeshDraw>& draws, uint32_t firstCall, uint32_t lastCall);
+	VkCommandBuffer _RecordIndirectSecondaryCommandBuffer(uint32_t imageIndex, uint32_t uniformOffset);
 
 	void _InitSyncObjects();
 	void _DeInitSyncObjects();
 
+	void _InitTimestampQueries();
+	void _DeInitTimestampQueries();
+	void _ReadTimestampQueries();
+
 	void _CleanUpOldSwapChain();
 	void _ReInitSwapChain();
 
-	void _CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory);
-	void _CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
-	void _CreateImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkSampleCountFlagBits numSamples, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory);
-	VkCommandBuffer _BeginSingleTimeCommands();
-	void _EndSingleTimeCommands(VkCommandBuffer commandBuffer);
-	void _TransitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels);
-	void _CopyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height);
-	VkImageView _CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels);
-	bool _HasStencilComponent(VkFormat format);
-	void _GenerateMipMaps(VkImage image, VkFormat imageFormat, int32_t texWidth, int32_t texHeight, uint32_t mipLevels);
-
 	void _GetWindowSize();
 	void _WaitForEvents();
 
-	static std::vector<char> readFile(const std::string& filename);
-
-	VkShaderModule _CreateShaderModule(const std::vector<char>& code);
-
 	Renderer* _renderer;
+	SharedResources* _resources = nullptr;
 
 	VkSurfaceKHR _surface = VK_NULL_HANDLE;
 	VkSwapchainKHR _swapchain = VK_NULL_HANDLE;
 	VkRenderPass _renderPass = VK_NULL_HANDLE;
 
 	bool _windowShouldRun = true;
+	bool _headless = false;
 
 	uint32_t							_surface_size_x = 512;
 	uint32_t							_surface_size_y = 512;
@@ -133,59 +167,80 @@ private:
 	std::vector<VkImage>				_swapchainImages;
 	std::vector<VkImageView>			_swapchainImageViews;
 	std::vector<VkFramebuffer>			_framebuffers;
+	std::vector<Allocation>				_headlessImagesMemory;
 
 	VkImage								_depthStencilImage = VK_NULL_HANDLE;
-	VkDeviceMemory						_depthStencilImageMemory = VK_NULL_HANDLE;
+	Allocation							_depthStencilImageMemory;
 	VkImageView							_depthStencilImageView = VK_NULL_HANDLE;
 	
 	VkSurfaceCapabilitiesKHR _surfaceCapabilites{};
 	VkSurfaceFormatKHR _surfaceFormat{};
 
 	VkFormat _depthStencilFormat = VK_FORMAT_UNDEFINED;
-	bool _stencilAvailable = false;
-
-	VkShaderModule _vertShaderModule = VK_NULL_HANDLE;
-	VkShaderModule _fragShaderModule = VK_NULL_HANDLE;
-
-	VkViewport viewport = {};
-	VkPipelineLayout _pipelineLayout = VK_NULL_HANDLE;
-	VkPipeline _graphicsPipeline = VK_NULL_HANDLE;
-	VkCommandPool _commandPool = VK_NULL_HANDLE;
-	std::vector<VkCommandBuffer> _commandBuffers;
 
+	// Per frame resources are indexed by currentFrame, the renderer's scheduler slot of the frame being recorded
+	uint32_t _framesInFlight = DEFAULT_FRAMES_IN_FLIGHT;
 	std::vector<VkSemaphore> _imageAvailableSemaphores;
 	std::vector<VkSemaphore> _renderFinishedSemaphores;
-	std::vector<VkFence> _inFlightFences;
 	size_t currentFrame = 0;
+	uint32_t _imageIndex = 0;
+	std::chrono::high_resolution_clock::time_point _acquireStart;
 
-	bool framebufferResized = false;
+	VkQueryPool _timestampQueryPool = VK_NULL_HANDLE;
+	std::vector<bool> _frameTimestampsWritten;
+	FrameTimings _frameTimings;
 
-	std::vector<Vertex> vertices;
-	std::vector<uint32_t> indices;
+	bool framebufferResized = false;
 
-	VkBuffer _vertexBuffer = VK_NULL_HANDLE;
-	VkDeviceMemory _vertexBufferMemory = VK_NULL_HANDLE;
-	VkBuffer _indexBuffer = VK_NULL_HANDLE;
-	VkDeviceMemory _indexBufferMemory = VK_NULL_HANDLE;
-	VkDescriptorSetLayout _descriptorSetLayout = VK_NULL_HANDLE;
+	PresentPolicy _presentPolicy = PresentPolicy::LowLatency;
+	VkPresentModeKHR _presentMode = VK_PRESENT_MODE_FIFO_KHR;
+	std::chrono::high_resolution_clock::time_point _inputSampleTime;
+	// VK_KHR_present_id of the last present, the current swapchain's first present has _swapchainFirstPresentId
+	uint64_t _presentId = 0;
+	uint64_t _swapchainFirstPresentId = 1;
+	struct PendingPresent
+	{
+		uint64_t presentId = 0;
+		std::chrono::high_resolution_clock::time_point acquireStart;
+		std::chrono::high_resolution_clock::time_point inputSample;
+	};
+	std::deque<PendingPresent> _pendingPresents;
+
+	glm::vec3 _cameraEye = glm::vec3(2.0f, 2.0f, 2.0f);
+	glm::vec3 _cameraTarget = glm::vec3(0.0f, 0.0f, 0.0f);
+	float _cameraFarPlane = 10.0f;
+
+	BoundingSpheres _instanceSpheres;
+	std::vector<uint8_t> _instanceVisibility;
+	VkBuffer _instanceBuffer = VK_NULL_HANDLE;
+	Allocation _instanceBufferMemory;
+	uint32_t _instanceCapacity = 0;
 	VkDescriptorPool _descriptorPool = VK_NULL_HANDLE;
 
-	VkImage _textureImage = VK_NULL_HANDLE;
-	VkDeviceMemory _textureImageMemory = VK_NULL_HANDLE;
-	VkImageView _textureImageView = VK_NULL_HANDLE;
-	VkSampler _textureSampler = VK_NULL_HANDLE;
-	uint32_t mipLevels;
+	// Outputs of the GPU culling passes, one segment per frame in flight. Rebuilt whenever the shared inputs are,
+	// which _sharedCullBufferVersion tracks
+	VkDescriptorPool _cullDescriptorPool = VK_NULL_HANDLE;
+	std::vector<VkDescriptorSet> _cullDescriptorSets;
+	// Sets are rewritten lazily once their frame is free again
+	uint64_t _cullBufferVersion = 0;
+	std::vector<uint64_t> _cullDescriptorSetVersions;
+	uint64_t _sharedCullBufferVersion = UINT64_MAX;
+	VkBuffer _visibleInstanceBuffer = VK_NULL_HANDLE;
+	Allocation _visibleInstanceBufferMemory;
+	VkDeviceSize _visibleInstanceSegmentSize = 0;
+	VkBuffer _drawCommandBuffer = VK_NULL_HANDLE;
+	Allocation _drawCommandBufferMemory;
+	VkDeviceSize _drawCommandSegmentSize = 0;
+	VkBuffer _cullCounterBuffer = VK_NULL_HANDLE;
+	Allocation _cullCounterBufferMemory;
+	VkDeviceSize _cullCounterSegmentSize = 0;
 
 	VkImage _colorImage;
-	VkDeviceMemory _colorImageMemory;
+	Allocation _colorImageMemory;
 	VkImageView _colorImageView;
 
-	std::vector<VkBuffer> _uniformBuffers;
-	std::vector<VkDeviceMemory> _uniformBuffersMemory;
-	std::vector<VkDescriptorSet> descriptorSets;
-
-	const std::string MODEL_PATH = "models/chalet.obj";
-	const std::string TEXTURE_PATH = "textures/chalet.jpg";
+	UniformRingBuffer* _uniformRingBuffer = nullptr;
+	std::vector<VkDescriptorSet> _descriptorSets;
 
 #if USE_FRAMEWORK_GLFW
 	GLFWwindow						*	_glfw_window = nullptr;
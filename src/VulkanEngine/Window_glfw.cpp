@@ -22,10 +22,14 @@ Niko Kauppi (Code maintenance)
 
 #if USE_FRAMEWORK_GLFW
 
+// GLFW is shared by every window of the process, it is terminated with the last one
+static uint32_t _glfw_window_count = 0;
+
 void Window::_InitOSWindow()
 {
 	int rc = glfwInit();
 	assert(rc == GLFW_TRUE);
+	_glfw_window_count++;
 	glfwWindowHint( GLFW_CLIENT_API, GLFW_NO_API );
 	_glfw_window = glfwCreateWindow((int) _surface_size_x,(int) _surface_size_y, _window_name.c_str(), nullptr, nullptr );
 	glfwSetWindowUserPointer(_glfw_window, this);
@@ -36,7 +40,10 @@ void Window::_InitOSWindow()
 void Window::_DeInitOSWindow()
 {
 	glfwDestroyWindow( _glfw_window );
-	glfwTerminate();
+	if (--_glfw_window_count == 0)
+	{
+		glfwTerminate();
+	}
 }
 
 void Window::_UpdateOSWindow()
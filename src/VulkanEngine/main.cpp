@@ -3,8 +3,11 @@
 #include "Renderer.h"
 #include <conio.h>
 #include "Window.h"
+#include "SharedResources.h"
 #include <vulkan/vulkan.h>
 #include "Shared.h"
+#include <algorithm>
+#include <cmath>
 
 VkCommandPool createCommandPool(VkDevice device, uint32_t familyIndex)
 {
@@ -28,10 +31,145 @@ VkSemaphore createSemaphore(VkDevice device)
 	return semaphore;
 }
 
-int main()
+int main(int argc, char** argv)
 {
-	Renderer r;
-	Window* window = r.OpenWindow(800, 600, "Test");
+	bool headless = false;
+	uint32_t frameCount = 0;
+	uint32_t benchmarkFrameCount = 0;
+	uint32_t benchmarkWarmupFrameCount = 10;
+	std::string benchmarkOutput = "benchmark.json";
+	uint32_t instanceCount = 1;
+	VkDeviceSize textureBudget = DEFAULT_TEXTURE_BUDGET;
+	VertexLayout vertexLayout;
+	bool gpuCulling = true;
+	uint32_t framesInFlight = DEFAULT_FRAMES_IN_FLIGHT;
+	PresentPolicy presentPolicy = PresentPolicy::LowLatency;
+	double frameRateLimit = 0.0;
+	uint32_t windowCount = 1;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "--headless")
+		{
+			headless = true;
+		}
+		else if (arg == "--frames" && i + 1 < argc)
+		{
+			frameCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+		}
+		else if (arg == "--benchmark" && i + 1 < argc)
+		{
+			benchmarkFrameCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+		}
+		else if (arg == "--benchmark-warmup" && i + 1 < argc)
+		{
+			benchmarkWarmupFrameCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+		}
+		else if (arg == "--benchmark-out" && i + 1 < argc)
+		{
+			benchmarkOutput = argv[++i];
+		}
+		else if (arg == "--instances" && i + 1 < argc)
+		{
+			instanceCount = std::max(static_cast<uint32_t>(std::stoul(argv[++i])), 1u);
+		}
+		else if (arg == "--vertex-layout" && i + 1 < argc)
+		{
+			// "float" is the uncompressed layout, "compact" the quantised default and "compact-uv" also
+			// quantises texture coordinates, for scenes that keep them in [0, 1]
+			std::string layout = argv[++i];
+			if (layout == "float")
+			{
+				vertexLayout.position = VertexPositionFormat::Float32;
+				vertexLayout.normal = VertexNormalFormat::Float32;
+				vertexLayout.texCoord = VertexTexCoordFormat::Float32;
+			}
+			else if (layout == "compact-uv")
+			{
+				vertexLayout.texCoord = VertexTexCoordFormat::Unorm16;
+			}
+		}
+		else if (arg == "--cpu-culling")
+		{
+			gpuCulling = false;
+		}
+		else if (arg == "--frames-in-flight" && i + 1 < argc)
+		{
+			framesInFlight = std::max(static_cast<uint32_t>(std::stoul(argv[++i])), 1u);
+		}
+		else if (arg == "--present" && i + 1 < argc)
+		{
+			// "low-latency" (default), "vsync" or "uncapped"
+			std::string policy = argv[++i];
+			if (policy == "vsync")
+			{
+				presentPolicy = PresentPolicy::Vsync;
+			}
+			else if (policy == "uncapped")
+			{
+				presentPolicy = PresentPolicy::Uncapped;
+			}
+		}
+		else if (arg == "--fps-limit" && i + 1 < argc)
+		{
+			frameRateLimit = std::stod(argv[++i]);
+		}
+		else if (arg == "--texture-budget" && i + 1 < argc)
+		{
+			textureBudget = VkDeviceSize(std::stoull(argv[++i])) * 1024 * 1024;
+		}
+		else if (arg == "--windows" && i + 1 < argc)
+		{
+			windowCount = std::max(static_cast<uint32_t>(std::stoul(argv[++i])), 1u);
+		}
+	}
+
+	Renderer r(headless);
+	// Every window shows the same scene from its own side, the first one is benchmarked
+	std::vector<Window*> windows(windowCount);
+	for (uint32_t i = 0; i < windowCount; i++)
+	{
+		windows[i] = r.OpenWindow(800, 600, windowCount > 1 ? "Test " + std::to_string(i) : "Test");
+		if (presentPolicy != windows[i]->GetPresentPolicy())
+		{
+			windows[i]->SetPresentPolicy(presentPolicy);
+		}
+	}
+	Window* window = windows[0];
+	SharedResources* resources = r.GetSharedResources();
+	resources->SetTextureBudget(textureBudget);
+	resources->SetVertexLayout(vertexLayout);
+	if (!gpuCulling)
+	{
+		resources->SetGpuCulling(false);
+	}
+	r.SetFramesInFlight(framesInFlight);
+	r.SetFrameRateLimit(frameRateLimit);
+
+	// Lay the instances out on a square grid and pull the camera back far enough to see all of them
+	Scene* scene = resources->GetScene();
+	MeshHandle chalet = resources->LoadMesh("models/chalet.obj");
+	uint32_t gridSize = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(instanceCount))));
+	const float spacing = 2.0f;
+	float cameraScale = std::max(gridSize * spacing * 0.5f, 1.0f);
+	std::vector<glm::vec3> instancePositions(instanceCount);
+	std::vector<InstanceHandle> instances(instanceCount);
+	for (uint32_t i = 0; i < instanceCount; i++)
+	{
+		instancePositions[i] = glm::vec3((i % gridSize) * spacing, (i / gridSize) * spacing, 0.0f) - glm::vec3((gridSize - 1) * spacing * 0.5f, (gridSize - 1) * spacing * 0.5f, 0.0f);
+		instances[i] = scene->AddInstance(chalet, glm::translate(glm::mat4(1.0f), instancePositions[i]));
+	}
+	for (uint32_t i = 0; i < windowCount; i++)
+	{
+		glm::mat4 side = glm::rotate(glm::mat4(1.0f), i * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+		windows[i]->SetCamera(glm::vec3(side * glm::vec4(glm::vec3(2.0f, 2.0f, 2.0f) * cameraScale, 1.0f)), glm::vec3(0.0f), 10.0f * cameraScale);
+	}
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	Benchmark benchmark(benchmarkFrameCount, benchmarkWarmupFrameCount);
+	benchmark.SetDeviceName(r.GetVulkanPhysicalDeviceProperties().deviceName);
+	benchmark.SetResolution(window->GetSurfaceSize().width, window->GetSurfaceSize().height);
+	auto frameStart = std::chrono::high_resolution_clock::now();
 
 	/*VkSemaphore acquireSemaphore = createSemaphore(r.GetVulkanDevice());
 	assert(acquireSemaphore);
@@ -51,9 +189,32 @@ int main()
 	VkCommandBuffer commandBuffer = 0;
 	ErrorCheck(vkAllocateCommandBuffers(r.GetVulkanDevice(), &allocateInfo, &commandBuffer));*/
 
+	uint32_t frame = 0;
 	while (r.Run())
 	{
-		window->DrawFrame();
+		float time = std::chrono::duration<float, std::chrono::seconds::period>(std::chrono::high_resolution_clock::now() - startTime).count();
+		glm::mat4 rotation = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+		for (uint32_t i = 0; i < instanceCount; i++)
+		{
+			scene->SetInstanceTransform(instances[i], glm::translate(glm::mat4(1.0f), instancePositions[i]) * rotation);
+		}
+
+		r.DrawFrame();
+
+		if (benchmarkFrameCount > 0)
+		{
+			auto frameEnd = std::chrono::high_resolution_clock::now();
+			benchmark.AddFrame(std::chrono::duration<double, std::milli>(frameEnd - frameStart).count(), window->GetLastFrameTimings());
+			frameStart = frameEnd;
+			if (benchmark.IsDone())
+			{
+				break;
+			}
+		}
+		if (frameCount > 0 && ++frame >= frameCount)
+		{
+			break;
+		}
 		/*
 		uint32_t imageIndex = 0;
 		for (uint32_t imageIndex = 0; imageIndex < window->GetSwapchainImagesCount(); imageIndex++)
@@ -109,5 +270,14 @@ int main()
 	}
 
 	vkDeviceWaitIdle(r.GetVulkanDevice());
+
+	if (benchmarkFrameCount > 0)
+	{
+		benchmark.SetMemoryStats(r.GetMemoryAllocator()->GetStats());
+		benchmark.SetMeshOptimizationStats(resources->GetMeshOptimizationStats());
+		std::ofstream benchmarkFile(benchmarkOutput);
+		benchmark.WriteJson(benchmarkFile);
+		benchmark.WriteJson(std::cout);
+	}
 	return 0;
 }
\ No newline at end of file